@@ -2,8 +2,11 @@
 #include "imgui.h"
 
 #include "gl.h"
+#include "gl_state.h"
 #include "texture.h" 
 #include "shader.h"
+#include "shader_batch.h"
+#include "shader_library.h"
 #include "material.h"
 #include "vertex.h"
 #include "utils.h"
@@ -14,6 +17,7 @@
 #include "voxelisation.h"
 
 #include <sstream>
+#include <random>
 #include "im3d.h"
 #include "im3d_gl.h"
 #include "gtc/matrix_transform.hpp"
@@ -24,9 +28,13 @@
 #include "asset.h"
 #include "lights.h"
 #include "transform.h"
+#include "transform_kernel.h"
+#include "job_system.h"
 #include "tech/vxgi.h"
 #include "tech/gbuffer.h"
+#include "tech/gpu_culling.h"
 #include "tech/shadow.h"
+#include "tech/point_shadow.h"
 #include "tech/lighting.h"
 #include "tech/tech_utils.h"
 #include "tech/taa.h"
@@ -53,7 +61,7 @@ const float SCREEN_H = 720.0;
 void dispatch_cone_tracing_pass_taa(shader& taa, shader& denoise, shader& present_shader, framebuffer& buffer_conetracing, framebuffer& buffer_conetracing_resolve, framebuffer& buffer_conetracing_denoise, framebuffer& history_buffer_conetracing, framebuffer& gbuffer, float aSigma, float aThreshold, float aKSigma, glm::ivec2 window_res)
 {
     
-    glViewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
+    gl_state::viewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
 
     tech::taa::dispatch_taa_pass(taa, buffer_conetracing, buffer_conetracing_resolve, history_buffer_conetracing, gbuffer.m_colour_attachments[4], window_res);
     tech::utils::dispatch_denoise_image(denoise, buffer_conetracing_resolve, buffer_conetracing_denoise, aSigma, aThreshold, aKSigma, window_res);
@@ -61,7 +69,7 @@ void dispatch_cone_tracing_pass_taa(shader& taa, shader& denoise, shader& presen
     
     texture::bind_sampler_handle(0, GL_TEXTURE0);
     
-    glViewport(0, 0, window_res.x, window_res.y);
+    gl_state::viewport(0, 0, window_res.x, window_res.y);
 
 }
 
@@ -116,37 +124,27 @@ int main()
     engine::init(window_res);
     custom_orientation = glm::vec3(0, 1, 0);
 
-    std::string gbuffer_vert = utils::load_string_from_path("assets/shaders/gbuffer.vert.glsl");
-    std::string gbuffer_frag = utils::load_string_from_path("assets/shaders/gbuffer.frag.glsl");
-    std::string gbuffer_floats_frag = utils::load_string_from_path("assets/shaders/gbuffer_floats.frag.glsl");
-    std::string gbuffer_lighting_frag = utils::load_string_from_path("assets/shaders/lighting.frag.glsl");
-    std::string visualize_3dtex_vert = utils::load_string_from_path("assets/shaders/visualize_3d_tex.vert.glsl");
-    std::string visualize_3dtex_frag = utils::load_string_from_path("assets/shaders/visualize_3d_tex.frag.glsl");
-    std::string present_vert = utils::load_string_from_path("assets/shaders/present.vert.glsl");
-    std::string present_frag = utils::load_string_from_path("assets/shaders/present.frag.glsl");
-    std::string dir_light_shadow_vert = utils::load_string_from_path("assets/shaders/dir_light_shadow.vert.glsl");
-    std::string dir_light_shadow_frag = utils::load_string_from_path("assets/shaders/dir_light_shadow.frag.glsl");
-    std::string voxelization_compute = utils::load_string_from_path("assets/shaders/gbuffer_voxelization.comp.glsl");
-    std::string voxelization_mips_compute = utils::load_string_from_path("assets/shaders/voxel_mips.comp.glsl");
-    std::string voxel_cone_tracing_frag = utils::load_string_from_path("assets/shaders/voxel_cone_tracing.frag.glsl");
-    std::string ssr_frag = utils::load_string_from_path("assets/shaders/ssr.frag.glsl");
-    std::string taa_frag = utils::load_string_from_path("assets/shaders/taa.frag.glsl");
-    std::string denoise_frag = utils::load_string_from_path("assets/shaders/denoise.frag.glsl");
-    std::string gi_combine_frag = utils::load_string_from_path("assets/shaders/gi_combine.frag.glsl");
-
-    shader gbuffer_shader(gbuffer_vert, gbuffer_frag);
-    shader gbuffer_floats_shader(gbuffer_vert, gbuffer_floats_frag);
-    shader lighting_shader(present_vert, gbuffer_lighting_frag);
-    shader present_shader(present_vert, present_frag);
-    shader shadow_shader(dir_light_shadow_vert, dir_light_shadow_frag);
-    shader visualize_3dtex(visualize_3dtex_vert, visualize_3dtex_frag);
-    shader voxelization(voxelization_compute);
-    shader voxelization_mips(voxelization_mips_compute);
-    shader voxel_cone_tracing(present_vert, voxel_cone_tracing_frag);
-    shader ssr(present_vert, ssr_frag);
-    shader taa(present_vert, taa_frag);
-    shader denoise(present_vert, denoise_frag);
-    shader gi_combine(present_vert, gi_combine_frag);
+    // every map present, materials missing some get their own permutation in create_entity_from_model
+    const shader_defines gbuffer_defines = { {"HAS_NORMAL_MAP", "1"}, {"HAS_METALLIC_MAP", "1"}, {"HAS_ROUGHNESS_MAP", "1"}, {"HAS_AO_MAP", "1"} };
+    const shader_defines voxel_defines = { {"VOXEL_RESOLUTION", std::to_string(_3d_tex_res)} };
+
+    // submit every program up front so the driver can compile them in parallel
+    shader_batch shader_compiler;
+    shader& gbuffer_shader = shader_library::get(shader_desc::graphics("gbuffer.vert.glsl", "gbuffer.frag.glsl", gbuffer_defines), shader_compiler);
+    shader& lighting_shader = shader_library::get(shader_desc::graphics("present.vert.glsl", "lighting.frag.glsl"), shader_compiler);
+    shader& present_shader = shader_library::get(shader_desc::graphics("present.vert.glsl", "present.frag.glsl"), shader_compiler);
+    shader& shadow_shader = shader_library::get(shader_desc::graphics("dir_light_shadow.vert.glsl", "dir_light_shadow.frag.glsl"), shader_compiler);
+    shader& visualize_3dtex = shader_library::get(shader_desc::graphics("visualize_3d_tex.vert.glsl", "visualize_3d_tex.frag.glsl"), shader_compiler);
+    shader& voxelization = shader_library::get(shader_desc::compute("gbuffer_voxelization.comp.glsl"), shader_compiler);
+    shader& voxelization_mips = shader_library::get(shader_desc::compute("voxel_mips.comp.glsl"), shader_compiler);
+    shader& voxel_cone_tracing = shader_library::get(shader_desc::graphics("present.vert.glsl", "voxel_cone_tracing.frag.glsl", voxel_defines), shader_compiler);
+    shader& ssr = shader_library::get(shader_desc::graphics("present.vert.glsl", "ssr.frag.glsl"), shader_compiler);
+    shader& taa = shader_library::get(shader_desc::graphics("present.vert.glsl", "taa.frag.glsl"), shader_compiler);
+    shader& denoise = shader_library::get(shader_desc::graphics("present.vert.glsl", "denoise.frag.glsl"), shader_compiler);
+    shader& gi_combine = shader_library::get(shader_desc::graphics("present.vert.glsl", "gi_combine.frag.glsl"), shader_compiler);
+    shader& hiz_build = shader_library::get(shader_desc::compute("hiz_build.comp.glsl"), shader_compiler);
+    shader& gpu_cull = shader_library::get(shader_desc::compute("gpu_cull.comp.glsl"), shader_compiler);
+    shader_compiler.wait();
 
     camera cam{};
     debug_camera_controller controller{};
@@ -154,13 +152,14 @@ int main()
     entity e = scene.create_entity("Daddalus");
     e.has_component<entity_data>();
     entity_data& data = e.get_component<entity_data>();
-    material mat(gbuffer_shader);
 
-    e.add_component<material>(gbuffer_shader);
-    model sponza = model::load_model_from_path("assets/models/sponza/Sponza.gltf");
+    e.add_component<material_handle>(material_registry::create(gbuffer_shader));
+    model_load_options sponza_options{};
+    sponza_options.build_triangle_bvh = true;
+    model sponza = model::load_model_from_path("assets/models/sponza/Sponza.gltf", sponza_options);
     framebuffer gbuffer{};
 
-    scene.create_entity_from_model(sponza, gbuffer_shader, glm::vec3(0.1),
+    scene.create_entity_from_model(sponza, shader_desc::graphics("gbuffer.vert.glsl", "gbuffer.frag.glsl"), glm::vec3(0.1),
         {
             {"u_diffuse_map", texture_map_type::diffuse},
             {"u_normal_map", texture_map_type::normal},
@@ -182,28 +181,11 @@ int main()
     gbuffer.add_depth_attachment_sampler_friendly(window_res.x, window_res.y);
     gbuffer.check();
     gbuffer.unbind();
+    tech::gpu_culling::init(hiz_build, gpu_cull, window_res);
 
     
 
-    framebuffer dir_light_shadow_buffer{};
-    dir_light_shadow_buffer.bind();
-    gl_handle depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        shadow_resolution, shadow_resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    dir_light_shadow_buffer.m_depth_attachment = depthMap;
-    dir_light_shadow_buffer.m_height = shadow_resolution;
-    dir_light_shadow_buffer.m_width = shadow_resolution;
-    dir_light_shadow_buffer.unbind();
+    tech::shadow::s_resolution = shadow_resolution;
 
     framebuffer lightpass_buffer{};
     lightpass_buffer.bind();
@@ -286,10 +268,11 @@ int main()
         2.75f
     };
     std::vector<point_light> lights;
-    lights.push_back({ {0.0, 0.0, 0.0}, {255.0, 0.0, 0.0}, 10.0f});
-    lights.push_back({ {10.0, 0.0, 10.0}, {255.0, 255.0, 0.0}, 20.0f });
-    lights.push_back({ {-10.0, 0.0, -10.0}, {0.0, 255.0, 0.0}, 30.0f });
-    lights.push_back({ {-10.0, 0.0, 10.0}, {0.0, 0.0, 255.0} , 40.0f});
+    std::mt19937 light_rng(7);
+    lights.push_back({ {0.0, 0.0, 0.0}, {255.0, 0.0, 0.0}, 10.0f, 1.0f, true });
+    lights.push_back({ {10.0, 0.0, 10.0}, {255.0, 255.0, 0.0}, 20.0f, 1.0f, true });
+    lights.push_back({ {-10.0, 0.0, -10.0}, {0.0, 255.0, 0.0}, 30.0f, 1.0f, true });
+    lights.push_back({ {-10.0, 0.0, 10.0}, {0.0, 0.0, 255.0} , 40.0f, 1.0f, true });
 
 
     constexpr glm::vec3 _3d_tex_res_vec = { _3d_tex_res, _3d_tex_res, _3d_tex_res };
@@ -312,7 +295,6 @@ int main()
     voxelization.use();
     voxelization.set_int("u_gbuffer_pos", 0);
     voxelization.set_int("u_gbuffer_lighting", 1);
-    voxelization.set_vec3("u_voxel_resolution", glm::vec3( _3d_tex_res));
 
     bool draw_debug_3d_texture = false;
     bool draw_direct_lighting = true;
@@ -323,6 +305,9 @@ int main()
     bool draw_final_pass = true;
 
     bool draw_im3d = true;
+    entt::entity picked_entity = entt::null;
+    float picked_distance = 0.0f;
+    u32 picked_triangle = 0;
 
     auto im3d_s =  im3d_gl::load_im3d();
 
@@ -340,7 +325,7 @@ int main()
     {
         glm::mat4 model = utils::get_model_matrix(pos, euler, scale);
 
-        glEnable(GL_DEPTH_TEST);
+        gl_state::enable(GL_DEPTH_TEST);
         
         engine::process_sdl_event();
         engine::engine_pre_frame();        
@@ -351,6 +336,19 @@ int main()
         controller.update(window_dim, cam);
         cam.update(window_dim);
         scene.on_update();
+        tech::utils::upload_frame_data(cam, frame_index, window_res);
+
+        // left click picks the triangle under the cursor
+        if (input::get_mouse_button(mouse_button::left) && !engine::s_imgui_io->WantCaptureMouse)
+        {
+            glm::vec3 ray = utils::get_mouse_world_pos(input::get_mouse_position(), window_dim, cam.m_proj, cam.m_view);
+            picked_entity = scene.raycast(cam.m_pos, ray, cam.m_far, picked_distance, &picked_triangle);
+        }
+        if (picked_entity != entt::null && scene.m_registry.valid(picked_entity))
+        {
+            aabb& picked_box = scene.m_registry.get<mesh>(picked_entity).m_transformed_aabb;
+            Im3d::DrawAlignedBox(ToIm3D(picked_box.min), ToIm3D(picked_box.max));
+        }
 
 
         // compute
@@ -358,11 +356,12 @@ int main()
 
         tech::vxgi::dispatch_gen_voxel_mips(voxelization_mips, voxel_data, _3d_tex_res_vec);
         
-        tech::gbuffer::dispatch_gbuffer(frame_index, gbuffer, history_buffer_position, gbuffer_shader, cam, scene, window_res);
+        tech::gbuffer::dispatch_gbuffer(gbuffer, history_buffer_position, gbuffer_shader, cam, scene);
 
-        tech::shadow::dispatch_shadow_pass(dir_light_shadow_buffer, shadow_shader, dir, scene, window_res);
+        tech::shadow::dispatch_shadow_pass(shadow_shader, dir, cam, scene, window_res);
+        tech::point_shadow::dispatch_point_shadow_pass(shadow_shader, lights, cam, scene, window_res);
 
-        tech::lighting::dispatch_light_pass(lighting_shader, lightpass_buffer, gbuffer, dir_light_shadow_buffer, cam, lights, dir);
+        tech::lighting::dispatch_light_pass(lighting_shader, lightpass_buffer, gbuffer, tech::shadow::get_cascade_texture(), tech::point_shadow::get_atlas_texture(), cam, lights, dir);
                 
         if (draw_direct_lighting)
         {
@@ -371,7 +370,7 @@ int main()
 
         if (draw_cone_tracing_pass || draw_cone_tracing_pass_no_taa)
         {
-            tech::vxgi::dispatch_cone_tracing_pass(voxel_cone_tracing, voxel_data, buffer_conetracing, gbuffer, window_res, sponza.m_aabb, _3d_tex_res_vec, cam, vxgi_cone_distance, gi_resolution_scale, diffuse_spec_mix);
+            tech::vxgi::dispatch_cone_tracing_pass(voxel_cone_tracing, voxel_data, buffer_conetracing, gbuffer, window_res, sponza.m_aabb, _3d_tex_res_vec, vxgi_cone_distance, gi_resolution_scale, diffuse_spec_mix);
         }
 
         if (draw_direct_lighting)
@@ -383,7 +382,7 @@ int main()
         {
             shapes::s_screen_quad.use();
             buffer_ssr.bind();
-            glViewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
+            gl_state::viewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
             glClearColor(0, 0, 0, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT);
             glDepthMask(GL_FALSE);
@@ -410,7 +409,7 @@ int main()
             glDepthMask(GL_TRUE);
 
             tech::taa::dispatch_taa_pass(taa, buffer_ssr, buffer_ssr_resolve, history_buffer_ssr, gbuffer.m_colour_attachments[4], window_res);
-            glViewport(0, 0, window_res.x, window_res.y);
+            gl_state::viewport(0, 0, window_res.x, window_res.y);
         }
 
         if (draw_cone_tracing_pass)
@@ -456,6 +455,48 @@ int main()
 
             ImGui::Begin("Hello, world!");                          
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / engine::s_imgui_io->Framerate, engine::s_imgui_io->Framerate);
+            ImGui::Text("GL state calls issued %u, skipped %u", gl_state::s_last_frame.issued, gl_state::s_last_frame.skipped);
+            ImGui::Text("Materials %u", material_registry::get_material_count());
+            ImGui::Text("Transform kernel %s", transform_kernel::get_path_name(transform_kernel::get_path()));
+            ImGui::Text("Job workers %u", job_system::get_worker_count());
+            ImGui::Text("G-buffer draws visible %u / %u", tech::gbuffer::s_last_visible_count, tech::gbuffer::s_last_renderable_count);
+            ImGui::Checkbox("GPU occlusion culling", &tech::gpu_culling::s_enabled);
+            ImGui::Checkbox("CPU occlusion culling", &tech::gbuffer::s_occlusion_culling);
+            ImGui::Text("  occluded %u, occluder triangles %u", tech::gbuffer::s_last_occluded_count, tech::gbuffer::s_last_occluder_triangles);
+            ImGui::Text("Shadow cache redraws %u%s", tech::shadow::s_static_redraw_count, tech::shadow::s_static_redrawn_last_frame ? " (this frame)" : "");
+            int cascade_count = (int)tech::shadow::s_cascade_count;
+            if (ImGui::SliderInt("Shadow cascades", &cascade_count, 1, (int)dir_light::s_max_cascades))
+            {
+                tech::shadow::s_cascade_count = (u32)cascade_count;
+            }
+            ImGui::SliderFloat("Cascade split lambda", &tech::shadow::s_split_lambda, 0.0f, 1.0f);
+            int far_interval = (int)tech::shadow::s_far_cascade_interval;
+            if (ImGui::SliderInt("Far cascade interval", &far_interval, 1, 8))
+            {
+                tech::shadow::s_far_cascade_interval = (u32)far_interval;
+            }
+            ImGui::Checkbox("Shadow receiver culling", &tech::shadow::s_receiver_culling);
+            for (u32 c = 0; c < tech::shadow::s_cascade_count; c++)
+            {
+                ImGui::Text("  cascade %u : split %.1f, casters %u, receiver culled %u", c, dir.cascade_splits[c], tech::shadow::s_last_cascade_casters[c], tech::shadow::s_last_cascade_receiver_culled[c]);
+            }
+            int face_updates = (int)tech::point_shadow::s_max_face_updates;
+            if (ImGui::SliderInt("Point shadow face budget", &face_updates, 6, 96))
+            {
+                tech::point_shadow::s_max_face_updates = (u32)face_updates;
+            }
+            ImGui::Text("Point shadows %u, faces drawn %u, pending %u, atlas %.1f%% used", tech::point_shadow::s_last_shadowed_lights, tech::point_shadow::s_last_rendered_faces,
+                tech::point_shadow::s_last_pending_lights, 100.0 * (double)tech::point_shadow::get_used_texels() / ((double)tech::point_shadow::s_atlas_size * tech::point_shadow::s_atlas_size));
+            ImGui::Text("Spatial index proxies %u, height %d", scene.m_spatial_index.get_proxy_count(), scene.m_spatial_index.get_height());
+            if (picked_entity != entt::null && scene.m_registry.valid(picked_entity))
+            {
+                ImGui::Text("Picked %s, triangle %u at %.2f", scene.m_registry.get<entity_data>(picked_entity).m_name.c_str(), picked_triangle, picked_distance);
+            }
+            ImGui::Text("Scene systems %.3f ms", scene.m_systems.get_last_frame_ms());
+            for (const auto& system : scene.m_systems.get_systems())
+            {
+                ImGui::Text("  %s %.3f ms", system.m_name.c_str(), system.m_last_ms);
+            }
             ImGui::Separator();
             ImGui::Checkbox("Render 3D Voxel Grid", &draw_debug_3d_texture);
             ImGui::Checkbox("Render Final Pass", &draw_final_pass);
@@ -490,6 +531,19 @@ int main()
             ImGui::DragFloat3("Dir Light Rotation", &dir.direction[0], 1.0f, 0.0f, 360.0f);
             ImGui::DragFloat("Dir Light Intensity", &dir.intensity, 1.0f, 0.0f, 1000.0f);
 
+            ImGui::Text("Point lights %u, cluster entries %u, max per cluster %u", (u32)lights.size(), tech::lighting::s_clusters.get_index_count(), tech::lighting::s_clusters.get_max_cluster_lights());
+            if (ImGui::Button("Add 256 point lights"))
+            {
+                // scattered through sponza (drawn at 0.1 scale)
+                std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+                for (int l = 0; l < 256; l++)
+                {
+                    glm::vec3 position = glm::mix(sponza.m_aabb.min, sponza.m_aabb.max, glm::vec3(unit(light_rng), unit(light_rng), unit(light_rng))) * 0.1f;
+                    glm::vec3 colour = glm::vec3(unit(light_rng), unit(light_rng), unit(light_rng)) * 255.0f;
+                    lights.push_back({ position, colour, 2.0f + unit(light_rng) * 4.0f });
+                }
+            }
+
             for (int l = 0; l < lights.size(); l++)
             {
                 std::stringstream name;
@@ -2,8 +2,11 @@
 #include "imgui.h"
 
 #include "gl.h"
+#include "gl_state.h"
 #include "texture.h" 
 #include "shader.h"
+#include "shader_batch.h"
+#include "shader_library.h"
 #include "material.h"
 #include "vertex.h"
 #include "utils.h"
@@ -12,6 +15,9 @@
 #include "framebuffer.h"
 #include "shape.h"
 #include "voxelisation.h"
+#include "indirect_draw.h"
+#include "transform.h"
+#include "transform_buffer.h"
 
 #include <sstream>
 #include "im3d.h"
@@ -24,6 +30,8 @@
 #include "asset.h"
 #include "lights.h"
 #include "tech/vxgi.h"
+#include "tech/lighting.h"
+#include "tech/tech_utils.h"
 
 using namespace nlohmann;
 static glm::vec3 custom_orientation;
@@ -33,29 +41,38 @@ Im3d::Vec3 ToIm3D(glm::vec3& input)
     return { input.x, input.y, input.z };
 }
 
-static glm::mat4 last_vp = glm::mat4(1.0);
 inline static int frame_index = 0;
 inline static constexpr float gi_resolution_scale = 0.5;
 inline static constexpr int shadow_resolution = 2048;
 inline static constexpr int _3d_tex_res = 128;
+inline static indirect_draw_buffer sponza_draws;
 
 
 void dispatch_gbuffer(framebuffer& gbuffer, framebuffer& previous_position_buffer, shader& gbuffer_shader, glm::mat4 mvp, glm::mat4 model_mat, glm::mat3 normal, camera& cam, std::vector<point_light>& lights, model& sponza, glm::ivec2 win_res)
 {
     frame_index++;
+    tech::utils::upload_frame_data(cam, frame_index, win_res);
     gbuffer.bind();
-    glm::mat4 current_vp = cam.m_proj * cam.m_view;
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_CULL_FACE);
+    gl_state::enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
+    transform sponza_transform{};
+    sponza_transform.m_model = model_mat;
+    sponza_transform.m_last_model = model_mat;
+    sponza_transform.m_normal_matrix = normal;
+    // not part of a scene, so it keeps its own slot and is rewritten every frame
+    static u32 sponza_transform_slot = transform_buffer::allocate();
+    sponza_transform.m_gpu_index = sponza_transform_slot;
+    transform_buffer::write(sponza_transform_slot, sponza_transform);
+    sponza_draws.clear();
+    for (auto& entry : sponza.m_meshes)
+    {
+        sponza_draws.add(entry, sponza_transform, entry.m_material_index);
+    }
+    sponza_draws.upload();
+    sponza_draws.bind();
+
     gbuffer_shader.use();
-    gbuffer_shader.set_vec2("u_resolution", {win_res.x, win_res.y});
-    gbuffer_shader.set_mat4("u_vp", current_vp);
-    gbuffer_shader.set_mat4("u_model", model_mat);
-    gbuffer_shader.set_mat4("u_last_vp", last_vp);
-    gbuffer_shader.set_mat4("u_last_model", model_mat);
-    gbuffer_shader.set_mat4("u_normal", normal);
-    gbuffer_shader.set_int("u_frame_index", frame_index);
     gbuffer_shader.set_int("u_diffuse_map", 0);
     gbuffer_shader.set_int("u_normal_map", 1);
     gbuffer_shader.set_int("u_metallic_map", 2);
@@ -70,8 +87,9 @@ void dispatch_gbuffer(framebuffer& gbuffer, framebuffer& previous_position_buffe
     texture::bind_sampler_handle(0, GL_TEXTURE4);
 
     texture::bind_sampler_handle(previous_position_buffer.m_colour_attachments.front(), GL_TEXTURE5);
-    for (auto& entry : sponza.m_meshes)
+    for (u32 i = 0; i < sponza.m_meshes.size(); i++)
     {
+        auto& entry = sponza.m_meshes[i];
         auto& maps = sponza.m_materials[entry.m_material_index].m_material_maps;
         entry.m_vao.use();
         maps[texture_map_type::diffuse].bind_sampler(GL_TEXTURE0);
@@ -93,10 +111,10 @@ void dispatch_gbuffer(framebuffer& gbuffer, framebuffer& previous_position_buffe
             texture::bind_sampler_handle(maps[texture_map_type::ao].m_handle, GL_TEXTURE4);
         }
 
-        glDrawElements(GL_TRIANGLES, entry.m_index_count, GL_UNSIGNED_INT, 0);
+        // textures change per mesh, so each command is its own draw here
+        sponza_draws.draw(i, 1);
     }
     gbuffer.unbind();
-    last_vp = current_vp;
 }
 
 void dispatch_present_image(shader& present_shader, const std::string& uniform_name, const int texture_slot, gl_handle texture)
@@ -116,7 +134,7 @@ void blit_to_fb(framebuffer& fb, shader& present_shader, const std::string& unif
     fb.unbind();
 }
 
-void dispatch_shadow_pass(framebuffer& shadow_fb, shader& shadow_shader, dir_light& sun, model& model, glm::mat4 model_mat, glm::ivec2 window_res)
+void dispatch_shadow_pass(framebuffer& shadow_fb, shader& shadow_shader, dir_light& sun, model& model, glm::ivec2 window_res)
 {
     float near_plane = 0.01f, far_plane = 1000.0f;
     glm::mat4 lightProjection = glm::ortho(-200.0f, 200.0f, -200.0f, 200.0f, near_plane, far_plane);
@@ -133,23 +151,24 @@ void dispatch_shadow_pass(framebuffer& shadow_fb, shader& shadow_shader, dir_lig
 
     shadow_fb.bind();
     glClear(GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, shadow_fb.m_width, shadow_fb.m_height);
-    glEnable(GL_CULL_FACE);
+    gl_state::viewport(0, 0, shadow_fb.m_width, shadow_fb.m_height);
+    gl_state::enable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
     shadow_shader.use();
     shadow_shader.set_mat4("lightSpaceMatrix", lightSpaceMatrix);
-    shadow_shader.set_mat4("model", model_mat);
 
-    for (auto& entry : model.m_meshes)
+    // reuses the commands recorded by dispatch_gbuffer, every sponza mesh lives in the same geometry heap
+    if (!model.m_meshes.empty())
     {
-        entry.m_vao.use();
-        glDrawElements(GL_TRIANGLES, entry.m_index_count, GL_UNSIGNED_INT, 0);
+        sponza_draws.bind();
+        model.m_meshes.front().m_vao.use();
+        sponza_draws.draw(0, sponza_draws.size());
     }
 
 
     shadow_fb.unbind();
-    glDisable(GL_CULL_FACE);
-    glViewport(0, 0, window_res.x, window_res.y);
+    gl_state::disable(GL_CULL_FACE);
+    gl_state::viewport(0, 0, window_res.x, window_res.y);
 
 }
 
@@ -165,31 +184,7 @@ void dispatch_light_pass(shader& lighting_shader, framebuffer& lighting_buffer,
     lighting_shader.set_int("u_pbr_map", 3);
     lighting_shader.set_int("u_dir_light_shadow_map", 4);
 
-    lighting_shader.set_vec3("u_cam_pos", cam.m_pos);
-
-    lighting_shader.set_vec3("u_dir_light.direction", utils::get_forward(sun.direction));
-    lighting_shader.set_vec3("u_dir_light.colour", sun.colour);
-    lighting_shader.set_mat4("u_dir_light.light_space_matrix", sun.light_space_matrix);
-    lighting_shader.set_float("u_dir_light.intensity", sun.intensity);
-
-    int num_point_lights = std::min((int)point_lights.size(), 16);
-
-    for (int i = 0; i < num_point_lights; i++)
-    {
-        std::stringstream pos_name;
-        pos_name << "u_point_lights[" << i << "].position";
-        std::stringstream col_name;
-        col_name << "u_point_lights[" << i << "].colour";
-        std::stringstream rad_name;
-        rad_name << "u_point_lights[" << i << "].radius";
-        std::stringstream int_name;
-        int_name << "u_point_lights[" << i << "].intensity";
-
-        lighting_shader.set_vec3(pos_name.str(), point_lights[i].position);
-        lighting_shader.set_vec3(col_name.str(), point_lights[i].colour);
-        lighting_shader.set_float(rad_name.str(), point_lights[i].radius);
-        lighting_shader.set_float(int_name.str(), point_lights[i].intensity);
-    }
+    tech::lighting::upload_light_data(point_lights, sun, cam);
 
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[0], GL_TEXTURE0);
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[1], GL_TEXTURE1);
@@ -224,19 +219,16 @@ void dispatch_direct_light_pass_taa(shader& taa, framebuffer& lightpass_buffer_r
 
 }
 
-void dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::grid& voxel_data, framebuffer& buffer_conetracing, framebuffer& gbuffer, glm::ivec2 window_res, model& sponza, glm::vec3 _3d_tex_res, camera& cam)
+void dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::grid& voxel_data, framebuffer& buffer_conetracing, framebuffer& gbuffer, glm::ivec2 window_res, model& sponza, glm::vec3 _3d_tex_res)
 {
-    glBindTexture(GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
 
-    glViewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
+    gl_state::viewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
     shapes::s_screen_quad.use();
     buffer_conetracing.bind();
     voxel_cone_tracing.use();
-    voxel_cone_tracing.set_vec3("u_aabb.min", sponza.m_aabb.min);
-    voxel_cone_tracing.set_vec3("u_aabb.max", sponza.m_aabb.max);
-    voxel_cone_tracing.set_vec3("u_voxel_resolution", _3d_tex_res);
+    tech::vxgi::upload_vxgi_data(sponza.m_aabb, _3d_tex_res, window_res);
     voxel_cone_tracing.set_int("u_position_map", 0);
-    voxel_cone_tracing.set_vec3("u_cam_position", cam.m_pos);
 
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[1], GL_TEXTURE0);
     voxel_cone_tracing.set_int("u_normal_map", 1);
@@ -248,13 +240,13 @@ void dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::grid& voxel_d
     texture::bind_sampler_handle(0, GL_TEXTURE0);
     texture::bind_sampler_handle(0, GL_TEXTURE1);
     texture::bind_sampler_handle(0, GL_TEXTURE2);
-    glViewport(0, 0, window_res.x, window_res.y);
+    gl_state::viewport(0, 0, window_res.x, window_res.y);
 }
 
 void dispatch_cone_tracing_pass_taa(shader& taa, shader& denoise, shader& present_shader, framebuffer& buffer_conetracing, framebuffer& buffer_conetracing_resolve, framebuffer& buffer_conetracing_denoise, framebuffer& history_buffer_conetracing, framebuffer& gbuffer, float aSigma, float aThreshold, float aKSigma, glm::ivec2 window_res)
 {
 
-    glViewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
+    gl_state::viewport(0, 0, window_res.x * gi_resolution_scale, window_res.y * gi_resolution_scale);
     buffer_conetracing_resolve.bind();
     shapes::s_screen_quad.use();
     taa.use();
@@ -285,7 +277,7 @@ void dispatch_cone_tracing_pass_taa(shader& taa, shader& denoise, shader& presen
 
     dispatch_present_image(present_shader, "u_image_sampler", 0, buffer_conetracing_denoise.m_colour_attachments.front());
     texture::bind_sampler_handle(0, GL_TEXTURE0);
-    glViewport(0, 0, window_res.x, window_res.y);
+    gl_state::viewport(0, 0, window_res.x, window_res.y);
 
 }
 
@@ -356,36 +348,23 @@ int main()
     engine::init(window_res);
     custom_orientation = glm::vec3(0, 1, 0);
 
-    std::string gbuffer_vert = utils::load_string_from_path("assets/shaders/gbuffer.vert.glsl");
-    std::string gbuffer_frag = utils::load_string_from_path("assets/shaders/gbuffer.frag.glsl");
-    std::string gbuffer_floats_frag = utils::load_string_from_path("assets/shaders/gbuffer_floats.frag.glsl");
-    std::string gbuffer_lighting_frag = utils::load_string_from_path("assets/shaders/lighting.frag.glsl");
-    std::string visualize_3dtex_vert = utils::load_string_from_path("assets/shaders/visualize_3d_tex.vert.glsl");
-    std::string visualize_3dtex_frag = utils::load_string_from_path("assets/shaders/visualize_3d_tex.frag.glsl");
-    std::string present_vert = utils::load_string_from_path("assets/shaders/present.vert.glsl");
-    std::string present_frag = utils::load_string_from_path("assets/shaders/present.frag.glsl");
-    std::string dir_light_shadow_vert = utils::load_string_from_path("assets/shaders/dir_light_shadow.vert.glsl");
-    std::string dir_light_shadow_frag = utils::load_string_from_path("assets/shaders/dir_light_shadow.frag.glsl");
-    std::string voxelization_compute = utils::load_string_from_path("assets/shaders/gbuffer_voxelization.comp.glsl");
-    std::string voxelization_mips_compute = utils::load_string_from_path("assets/shaders/voxel_mips.comp.glsl");
-    std::string voxel_cone_tracing_frag = utils::load_string_from_path("assets/shaders/voxel_cone_tracing.frag.glsl");
-    std::string taa_frag = utils::load_string_from_path("assets/shaders/taa.frag.glsl");
-    std::string denoise_frag = utils::load_string_from_path("assets/shaders/denoise.frag.glsl");
-    std::string gi_combine_frag = utils::load_string_from_path("assets/shaders/gi_combine.frag.glsl");
-
-
-    shader gbuffer_shader(gbuffer_vert, gbuffer_frag);
-    shader gbuffer_floats_shader(gbuffer_vert, gbuffer_floats_frag);
-    shader lighting_shader(present_vert, gbuffer_lighting_frag);
-    shader present_shader(present_vert, present_frag);
-    shader shadow_shader(dir_light_shadow_vert, dir_light_shadow_frag);
-    shader visualize_3dtex(visualize_3dtex_vert, visualize_3dtex_frag);
-    shader voxelization(voxelization_compute);
-    shader voxelization_mips(voxelization_mips_compute);
-    shader voxel_cone_tracing(present_vert, voxel_cone_tracing_frag);
-    shader taa(present_vert, taa_frag);
-    shader denoise(present_vert, denoise_frag);
-    shader gi_combine(present_vert, gi_combine_frag);
+    // gi_demo binds every map slot itself, so the gbuffer permutation assumes all of them are present
+    const shader_defines gbuffer_defines = { {"HAS_NORMAL_MAP", "1"}, {"HAS_METALLIC_MAP", "1"}, {"HAS_ROUGHNESS_MAP", "1"}, {"HAS_AO_MAP", "1"} };
+    const shader_defines voxel_defines = { {"VOXEL_RESOLUTION", std::to_string(_3d_tex_res)} };
+
+    shader_batch shader_compiler;
+    shader& gbuffer_shader = shader_library::get(shader_desc::graphics("gbuffer.vert.glsl", "gbuffer.frag.glsl", gbuffer_defines), shader_compiler);
+    shader& lighting_shader = shader_library::get(shader_desc::graphics("present.vert.glsl", "lighting.frag.glsl", { {"SINGLE_SHADOW_MAP", "1"} }), shader_compiler);
+    shader& present_shader = shader_library::get(shader_desc::graphics("present.vert.glsl", "present.frag.glsl"), shader_compiler);
+    shader& shadow_shader = shader_library::get(shader_desc::graphics("dir_light_shadow.vert.glsl", "dir_light_shadow.frag.glsl"), shader_compiler);
+    shader& visualize_3dtex = shader_library::get(shader_desc::graphics("visualize_3d_tex.vert.glsl", "visualize_3d_tex.frag.glsl"), shader_compiler);
+    shader& voxelization = shader_library::get(shader_desc::compute("gbuffer_voxelization.comp.glsl"), shader_compiler);
+    shader& voxelization_mips = shader_library::get(shader_desc::compute("voxel_mips.comp.glsl"), shader_compiler);
+    shader& voxel_cone_tracing = shader_library::get(shader_desc::graphics("present.vert.glsl", "voxel_cone_tracing.frag.glsl", voxel_defines), shader_compiler);
+    shader& taa = shader_library::get(shader_desc::graphics("present.vert.glsl", "taa.frag.glsl"), shader_compiler);
+    shader& denoise = shader_library::get(shader_desc::graphics("present.vert.glsl", "denoise.frag.glsl"), shader_compiler);
+    shader& gi_combine = shader_library::get(shader_desc::graphics("present.vert.glsl", "gi_combine.frag.glsl"), shader_compiler);
+    shader_compiler.wait();
 
     camera cam{};
     debug_camera_controller controller{};
@@ -419,7 +398,7 @@ int main()
     dir_light_shadow_buffer.bind();
     gl_handle depthMap;
     glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, depthMap);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
         shadow_resolution, shadow_resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -429,7 +408,6 @@ int main()
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
     dir_light_shadow_buffer.m_depth_attachment = depthMap;
     dir_light_shadow_buffer.m_height = shadow_resolution;
     dir_light_shadow_buffer.m_width = shadow_resolution;
@@ -516,7 +494,6 @@ int main()
     voxelization.use();
     voxelization.set_int("u_gbuffer_pos", 0);
     voxelization.set_int("u_gbuffer_lighting", 1);
-    voxelization.set_vec3("u_voxel_resolution", glm::vec3( _3d_tex_res));
 
     bool draw_debug_3d_texture = false;
     bool draw_direct_lighting = true;
@@ -541,7 +518,7 @@ int main()
     {
         glm::mat4 model = utils::get_model_matrix(pos, euler, scale);
 
-        glEnable(GL_DEPTH_TEST);
+        gl_state::enable(GL_DEPTH_TEST);
         
         engine::process_sdl_event();
         engine::engine_pre_frame();        
@@ -558,7 +535,7 @@ int main()
         
         dispatch_gbuffer(gbuffer, history_buffer_position, gbuffer_shader, mvp, model, normal, cam, lights, sponza, window_res);
 
-        dispatch_shadow_pass(dir_light_shadow_buffer, shadow_shader, dir, sponza, model, window_res);
+        dispatch_shadow_pass(dir_light_shadow_buffer, shadow_shader, dir, sponza, window_res);
 
         dispatch_light_pass(lighting_shader, lightpass_buffer, gbuffer, dir_light_shadow_buffer, cam, lights, dir);
                 
@@ -569,7 +546,7 @@ int main()
 
         if (draw_cone_tracing_pass || draw_cone_tracing_pass_no_taa)
         {
-            dispatch_cone_tracing_pass(voxel_cone_tracing, voxel_data, buffer_conetracing, gbuffer, window_res, sponza, _3d_tex_res_vec, cam);
+            dispatch_cone_tracing_pass(voxel_cone_tracing, voxel_data, buffer_conetracing, gbuffer, window_res, sponza, _3d_tex_res_vec);
         }
 
         if (draw_direct_lighting)
@@ -0,0 +1,10 @@
+struct AABB
+{
+	vec3 min;
+	vec3 max;
+};
+
+bool is_in_aabb(vec3 pos, AABB aabb)
+{
+	return all(greaterThanEqual(pos, aabb.min)) && all(lessThanEqual(pos, aabb.max));
+}
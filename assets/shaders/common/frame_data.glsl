@@ -0,0 +1,12 @@
+// per-frame camera state, uploaded once per frame (see frame_block in uniform_buffer.h)
+layout(std140, binding = 0) uniform frame_data
+{
+	mat4	u_vp;
+	mat4	u_last_vp;
+	mat4	u_view;
+	mat4	u_proj;
+	vec3	u_cam_pos;
+	float	u_delta_time;
+	vec2	u_resolution;
+	int		u_frame_index;
+};
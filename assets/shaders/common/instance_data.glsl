@@ -0,0 +1,25 @@
+// per-instance data written by indirect_draw_buffer (see instance_data in indirect_draw.h)
+// every command's base_instance points at its first entry, so instance i of a command lives at gl_BaseInstanceARB + i
+// needs #extension GL_ARB_shader_draw_parameters : require before any declarations in the including shader
+#include "transform_data.glsl"
+
+struct instance_data
+{
+	uint	transform_index;
+	uint	material_index;
+};
+
+layout(std430, binding = 0) readonly buffer instance_data_buffer
+{
+	instance_data u_instances[];
+};
+
+instance_data get_instance_data()
+{
+	return u_instances[uint(gl_BaseInstanceARB + gl_InstanceID)];
+}
+
+transform_data get_instance_transform()
+{
+	return u_transforms[get_instance_data().transform_index];
+}
@@ -0,0 +1,69 @@
+// scene lights, uploaded once per frame by the lighting pass (see light_block in uniform_buffer.h).
+// point lights are culled into view space clusters by light_clusters, a pixel only walks its cluster's list
+struct DirLight
+{
+	vec3	direction;
+	float	intensity;
+	vec3	colour;
+	mat4	light_space_matrix;
+};
+
+struct PointLight
+{
+	vec3	position;
+	float	radius;
+	vec3	colour;
+	float	intensity;
+	// index into u_point_shadows, -1 = no shadow
+	int		shadow_index;
+};
+
+// cube faces of a shadowed point light in the shadow atlas (see tech::point_shadow), faces are +x -x +y -y +z -z
+struct PointShadow
+{
+	mat4	face_matrices[6];
+	// xy = atlas uv of the tile's corner, zw = its uv size
+	vec4	face_tiles[6];
+};
+
+layout(std140, binding = 1) uniform light_data
+{
+	DirLight	u_dir_light;
+	int			u_point_light_count;
+	float		u_cluster_slice_scale;
+	float		u_cluster_slice_bias;
+	ivec3		u_cluster_grid;
+	// world -> light clip space per shadow cascade, cascade i covers view depths up to u_cascade_splits[i]
+	mat4		u_cascade_matrices[4];
+	vec4		u_cascade_splits;
+	int			u_cascade_count;
+};
+
+layout(std430, binding = 6) readonly buffer point_light_buffer
+{
+	PointLight u_point_lights[];
+};
+
+// x = first entry in u_light_indices, y = light count
+layout(std430, binding = 7) readonly buffer light_cluster_buffer
+{
+	uvec2 u_light_clusters[];
+};
+
+layout(std430, binding = 8) readonly buffer light_index_buffer
+{
+	uint u_light_indices[];
+};
+
+layout(std430, binding = 9) readonly buffer point_shadow_buffer
+{
+	PointShadow u_point_shadows[];
+};
+
+// uv is the screen position, view_depth the positive distance along the view axis
+uvec2 get_light_cluster(vec2 uv, float view_depth)
+{
+	int slice = clamp(int(floor(log(max(view_depth, 1e-4)) * u_cluster_slice_scale - u_cluster_slice_bias)), 0, u_cluster_grid.z - 1);
+	ivec2 tile = clamp(ivec2(uv * vec2(u_cluster_grid.xy)), ivec2(0), u_cluster_grid.xy - 1);
+	return u_light_clusters[(slice * u_cluster_grid.y + tile.y) * u_cluster_grid.x + tile.x];
+}
@@ -0,0 +1,12 @@
+// every transform of the frame, written by transform_buffer (see transform_data in transform_buffer.h)
+struct transform_data
+{
+	mat4	model;
+	mat4	last_model;
+	mat4	normal;
+};
+
+layout(std430, binding = 1) readonly buffer transform_data_buffer
+{
+	transform_data u_transforms[];
+};
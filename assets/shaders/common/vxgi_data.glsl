@@ -0,0 +1,11 @@
+// per-pass parameters shared by voxelization and cone tracing (see vxgi_block in uniform_buffer.h)
+#include "aabb.glsl"
+
+layout(std140, binding = 2) uniform vxgi_data
+{
+	AABB	u_aabb;
+	vec3	u_voxel_resolution;
+	float	u_max_trace_distance;
+	vec2	u_input_resolution;
+	float	u_diffuse_spec_mix;
+};
@@ -1,12 +1,14 @@
-#version 330 core
+#version 450
+#extension GL_ARB_shader_draw_parameters : require
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aUV;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+
+#include "common/instance_data.glsl"
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrix * get_instance_transform().model * vec4(aPos, 1.0);
 }  
\ No newline at end of file
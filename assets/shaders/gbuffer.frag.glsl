@@ -16,35 +16,24 @@ layout(location = 4) out vec2 oVelocity;
 layout(location = 5) out vec4 oCurrentClip;
 layout(location = 6) out vec4 oLastClip;
 
+// HAS_*_MAP are injected per material by shader_library, missing maps fall back to constants
 uniform sampler2D u_diffuse_map;
+#ifdef HAS_NORMAL_MAP
 uniform sampler2D u_normal_map;
+#endif
+#ifdef HAS_METALLIC_MAP
 uniform sampler2D u_metallic_map;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
 uniform sampler2D u_roughness_map;
+#endif
+#ifdef HAS_AO_MAP
 uniform sampler2D u_ao_map;
+#endif
 uniform sampler2D u_prev_position_map;
 
-uniform mat4 u_last_vp;
-uniform int u_frame_index;
-
-const vec2 halton_seq[16] = vec2[16] 
-(
-    vec2(0.500000, 0.333333),
-    vec2(0.250000, 0.666667),
-    vec2(0.750000, 0.111111),
-    vec2(0.125000, 0.444444),
-    vec2(0.625000, 0.777778),
-    vec2(0.375000, 0.222222),
-    vec2(0.875000, 0.555556),
-    vec2(0.062500, 0.888889),
-    vec2(0.562500, 0.037037),
-    vec2(0.312500, 0.370370),
-    vec2(0.812500, 0.703704),
-    vec2(0.187500, 0.148148),
-    vec2(0.687500, 0.481481),
-    vec2(0.437500, 0.814815),
-    vec2(0.937500, 0.259259),
-    vec2(0.031250, 0.592593)
-);
+#include "common/frame_data.glsl"
+
 
 vec3 UnpackNormalMap( vec3 TextureSample )
 {
@@ -57,6 +46,9 @@ vec3 UnpackNormalMap( vec3 TextureSample )
 }
 
 vec3 getNormalFromMap() {
+#ifndef HAS_NORMAL_MAP
+    return normalize(aNormal);
+#else
     vec3 tangentNormal = texture(u_normal_map, aUV).xyz * 2.0 - 1.0;
 
     if(abs(tangentNormal.z) < 0.0001) {
@@ -75,6 +67,7 @@ vec3 getNormalFromMap() {
     mat3 TBN = mat3(T, B, N);
 
     return normalize(TBN * tangentNormal);
+#endif
 }
 
 void main()
@@ -98,8 +91,20 @@ void main()
 
     // velocity 
     oVelocity = currentPosNDC - previousPosNDC;
+#ifdef HAS_METALLIC_MAP
     float metallic = texture(u_metallic_map, aUV).r;
+#else
+    float metallic = 0.0;
+#endif
+#ifdef HAS_ROUGHNESS_MAP
     float roughness = texture(u_roughness_map, aUV).r;
+#else
+    float roughness = 0.0;
+#endif
+#ifdef HAS_AO_MAP
     float ao = texture(u_ao_map, aUV).r;
+#else
+    float ao = 0.0;
+#endif
     oPBR = vec3(metallic, roughness, ao);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_ARB_shader_draw_parameters : require
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
@@ -10,43 +11,22 @@ layout(location = 2) out vec3 oNormal;
 layout(location = 3) out vec4 oClipPos;
 layout(location = 4) out vec4 oLastClipPos;
 
-uniform mat4      u_vp;
-uniform mat4      u_model;
-uniform mat4      u_last_vp;
-uniform mat4      u_last_model;
-uniform mat4      u_normal;
-uniform int       u_frame_index;
-uniform vec2      u_resolution;
-
-const vec2 halton_seq[16] = vec2[16] 
-(
-    vec2(0.500000, 0.333333),
-    vec2(0.250000, 0.666667),
-    vec2(0.750000, 0.111111),
-    vec2(0.125000, 0.444444),
-    vec2(0.625000, 0.777778),
-    vec2(0.375000, 0.222222),
-    vec2(0.875000, 0.555556),
-    vec2(0.062500, 0.888889),
-    vec2(0.562500, 0.037037),
-    vec2(0.312500, 0.370370),
-    vec2(0.812500, 0.703704),
-    vec2(0.187500, 0.148148),
-    vec2(0.687500, 0.481481),
-    vec2(0.437500, 0.814815),
-    vec2(0.937500, 0.259259),
-    vec2(0.031250, 0.592593)
-);
+#include "common/frame_data.glsl"
+
+#include "common/instance_data.glsl"
+
+#include "common/halton.glsl"
 
 void main()
 {
+    transform_data instance = get_instance_transform();
     oUV = aUV;
-    oNormal = (vec4(aNormal, 1.0) * u_normal).xyz;
-    oPosition = (u_model * vec4(aPos , 1.0));
-    vec4 pos =  u_vp * u_model * vec4(aPos, 1.0);
+    oNormal = (vec4(aNormal, 1.0) * instance.normal).xyz;
+    oPosition = (instance.model * vec4(aPos , 1.0));
+    vec4 pos =  u_vp * instance.model * vec4(aPos, 1.0);
     oClipPos = pos;
 
-    oLastClipPos = u_last_vp * u_last_model * vec4(aPos, 1.0);
+    oLastClipPos = u_last_vp * instance.last_model * vec4(aPos, 1.0);
 
     int jitter_index = u_frame_index % 16;
     vec2 offset = halton_seq[jitter_index];
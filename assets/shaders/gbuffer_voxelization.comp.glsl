@@ -2,17 +2,10 @@
 
 layout(local_size_x = 10, local_size_y = 10, local_size_z = 1) in;
 
-struct AABB
-{
-	vec3 min;
-	vec3 max;
-};
+#include "common/vxgi_data.glsl"
 
 uniform sampler2D u_gbuffer_pos;
 uniform sampler2D u_gbuffer_lighting;
-uniform AABB	  u_aabb;
-uniform vec3	  u_voxel_resolution;
-uniform vec2	  u_input_resolution;
 layout(binding = 0, rgba32f) uniform image3D imgOutput;
 layout(binding = 1, rgba32f) uniform image3D imgOutput1;
 layout(binding = 2, rgba32f) uniform image3D imgOutput2;
@@ -20,19 +13,6 @@ layout(binding = 3, rgba32f) uniform image3D imgOutput3;
 layout(binding = 4, rgba32f) uniform image3D imgOutput4;
 layout(binding = 5, rgba32f) uniform image3D imgOutput5;
 
-bool is_in_aabb(vec3 pos)
-{
-	if (pos.x < u_aabb.min.x) { return false; }
-	if (pos.y < u_aabb.min.y) { return false; }
-	if (pos.z < u_aabb.min.z) { return false; }
-
-	if (pos.x > u_aabb.max.x) { return false; }
-	if (pos.y > u_aabb.max.y) { return false; }
-	if (pos.z > u_aabb.max.z) { return false; }
-
-	return true;
-}
-
 ivec3 get_texel_from_pos(vec3 position, vec3 resolution)
 {
 	vec3 aabb_dim = u_aabb.max - u_aabb.min;
@@ -60,7 +40,7 @@ void main() {
 	vec3 pos = texture(u_gbuffer_pos, uv).xyz;
 
 	// is the pixel position within the bounding volume, if not do nothing
-	if (!is_in_aabb(pos))
+	if (!is_in_aabb(pos, u_aabb))
 	{
 		return;
 	}
@@ -0,0 +1,157 @@
+#version 450
+
+// instance culling for tech::gpu_culling. phase 0 keeps last frame's visible instances that pass the frustum,
+// phase 1 tests everything against the frustum + hi-z, records the result per transform and appends the
+// instances phase 0 didn't draw. survivors are appended to their command through an atomic instance count
+layout(local_size_x = 64) in;
+
+#include "common/frame_data.glsl"
+#include "common/transform_data.glsl"
+
+// mirror of tech::gpu_culling::cull_instance
+struct cull_instance
+{
+	vec3	local_min;
+	uint	command_index;
+	vec3	local_max;
+	uint	transform_index;
+	uint	material_index;
+};
+
+// mirror of draw_elements_indirect_command in indirect_draw.h
+struct draw_command
+{
+	uint	count;
+	uint	instance_count;
+	uint	first_index;
+	int		base_vertex;
+	uint	base_instance;
+};
+
+struct instance_data
+{
+	uint	transform_index;
+	uint	material_index;
+};
+
+layout(std430, binding = 2) readonly buffer cull_instance_buffer
+{
+	cull_instance u_cull_instances[];
+};
+
+layout(std430, binding = 3) buffer command_buffer
+{
+	draw_command u_commands[];
+};
+
+layout(std430, binding = 4) writeonly buffer output_instance_buffer
+{
+	instance_data u_output_instances[];
+};
+
+// 1 if the transform was visible at the end of the last phase 1
+layout(std430, binding = 5) buffer visibility_buffer
+{
+	uint u_visibility[];
+};
+
+layout(binding = 0) uniform sampler2D u_hiz;
+
+uniform int		u_phase;
+uniform uint	u_instance_count;
+uniform int		u_hiz_levels;
+uniform ivec2	u_hiz_size;
+uniform vec4	u_frustum_planes[6];
+
+bool in_frustum(vec3 center, vec3 extent)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = u_frustum_planes[i];
+		if (dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extent) < 0.0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool occluded(vec3 box_min, vec3 box_max)
+{
+	vec2 uv_min = vec2(1.0);
+	vec2 uv_max = vec2(0.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = mix(box_min, box_max, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+		vec4 clip = u_vp * vec4(corner, 1.0);
+		// crosses the near plane
+		if (clip.w < 1e-4)
+		{
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		uv_min = min(uv_min, ndc.xy * 0.5 + 0.5);
+		uv_max = max(uv_max, ndc.xy * 0.5 + 0.5);
+		nearest = min(nearest, ndc.z * 0.5 + 0.5);
+	}
+	uv_min = clamp(uv_min, 0.0, 1.0);
+	uv_max = clamp(uv_max, 0.0, 1.0);
+
+	// the level where the box spans at most 2x2 texels
+	vec2 size = (uv_max - uv_min) * vec2(u_hiz_size);
+	int level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, u_hiz_levels - 1);
+	ivec2 level_size = textureSize(u_hiz, level);
+	// levels round down, the last texel of a row covers the remainder, so clamp instead of rescaling uvs
+	ivec2 first = min(ivec2(uv_min * vec2(u_hiz_size)) >> level, level_size - 1);
+	ivec2 last = min(ivec2(uv_max * vec2(u_hiz_size)) >> level, level_size - 1);
+
+	float farthest = 0.0;
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			farthest = max(farthest, texelFetch(u_hiz, ivec2(x, y), level).r);
+		}
+	}
+	return nearest > farthest;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+	if (index >= u_instance_count)
+	{
+		return;
+	}
+
+	cull_instance instance = u_cull_instances[index];
+	mat4 model = u_transforms[instance.transform_index].model;
+	vec3 local_center = (instance.local_min + instance.local_max) * 0.5;
+	vec3 local_extent = (instance.local_max - instance.local_min) * 0.5;
+	vec3 center = (model * vec4(local_center, 1.0)).xyz;
+	vec3 extent = abs(model[0].xyz) * local_extent.x + abs(model[1].xyz) * local_extent.y + abs(model[2].xyz) * local_extent.z;
+
+	bool visible = in_frustum(center, extent);
+	bool was_visible = u_visibility[instance.transform_index] != 0;
+	if (u_phase == 0)
+	{
+		if (!visible || !was_visible)
+		{
+			return;
+		}
+	}
+	else
+	{
+		visible = visible && !occluded(center - extent, center + extent);
+		u_visibility[instance.transform_index] = visible ? 1 : 0;
+		// anything visible last frame and inside the frustum was drawn by phase 0
+		if (!visible || was_visible)
+		{
+			return;
+		}
+	}
+
+	uint slot = atomicAdd(u_commands[instance.command_index].instance_count, 1);
+	u_output_instances[u_commands[instance.command_index].base_instance + slot] = instance_data(instance.transform_index, instance.material_index);
+}
@@ -0,0 +1,41 @@
+#version 450
+
+// one level of the hi-z pyramid (see tech::gpu_culling::build_hiz) : every texel keeps the farthest depth it covers.
+// levels round down, so on odd sources the last row / column also folds in the texel left over
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D u_depth;
+layout(binding = 0, r32f) readonly uniform image2D u_source;
+layout(binding = 1, r32f) writeonly uniform image2D u_destination;
+
+uniform bool	u_copy_depth;
+uniform ivec2	u_source_size;
+uniform ivec2	u_destination_size;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(texel, u_destination_size)))
+	{
+		return;
+	}
+
+	float farthest = 0.0;
+	if (u_copy_depth)
+	{
+		farthest = texelFetch(u_depth, texel, 0).r;
+	}
+	else
+	{
+		ivec2 extent = ivec2(2) + ivec2(equal(texel, u_destination_size - 1)) * (u_source_size & 1);
+		for (int y = 0; y < extent.y; y++)
+		{
+			for (int x = 0; x < extent.x; x++)
+			{
+				ivec2 source = min(texel * 2 + ivec2(x, y), u_source_size - 1);
+				farthest = max(farthest, imageLoad(u_source, source).r);
+			}
+		}
+	}
+	imageStore(u_destination, texel, vec4(farthest));
+}
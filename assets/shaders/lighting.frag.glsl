@@ -4,23 +4,9 @@ out vec4 FragColor;
 
 layout (location = 0) in vec2 aUV;
 
-struct DirLight
-{
-	vec3	direction;
-	vec3	colour;
-    mat4    light_space_matrix;
-    float   intensity;
-};
-
-struct PointLight
-{
-	vec3	position;
-	vec3	colour;
-	float	radius;
-    float   intensity;
-};
+#include "common/frame_data.glsl"
+#include "common/light_data.glsl"
 
-const int NUM_POINT_LIGHTS = 16;
 const float PI = 3.14159265359;
 const float SHADOW_AMBIENT = 0.01;
 
@@ -28,10 +14,13 @@ uniform sampler2D   u_diffuse_map;
 uniform sampler2D   u_position_map;
 uniform sampler2D   u_normal_map;
 uniform sampler2D   u_pbr_map; // x = metallic, y = roughness, z = AO
-uniform sampler2D   u_dir_light_shadow_map; // x = metallic, y = roughness, z = AO
-uniform vec3        u_cam_pos;
-uniform DirLight    u_dir_light;
-uniform PointLight  u_point_lights[NUM_POINT_LIGHTS];
+#ifdef SINGLE_SHADOW_MAP
+uniform sampler2D   u_dir_light_shadow_map;
+#else
+// one layer per cascade, see tech::shadow
+uniform sampler2DArray u_dir_light_shadow_map;
+#endif
+uniform sampler2D   u_point_shadow_atlas;
 
 float DistributionGGX(vec3 N, vec3 H, float roughness)
 {
@@ -113,6 +102,7 @@ vec3 handle_dir_light(vec3 normal, float roughness, float metallic, vec3 albedo,
     return ((kD * max((1.0 - shadow), SHADOW_AMBIENT)) * (diffuse / PI + specular)) * (u_dir_light.colour * u_dir_light.intensity) * NdotL;
 }
 
+#ifdef SINGLE_SHADOW_MAP
 float ShadowCalculation(vec3 normal, vec4 fragPosLightSpace)
 {
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -123,6 +113,48 @@ float ShadowCalculation(vec3 normal, vec4 fragPosLightSpace)
     float shadow = currentDepth > closestDepth  ? 1.0 : 0.0;  
     return shadow;
 }
+#else
+// the first cascade reaching the pixel's view depth, nothing past the last one is shadowed
+float ShadowCalculation(vec3 world_pos, float view_depth)
+{
+    int cascade = 0;
+    while (cascade < u_cascade_count && view_depth > u_cascade_splits[cascade])
+    {
+        cascade++;
+    }
+    if (cascade == u_cascade_count)
+    {
+        return 0.0;
+    }
+
+    vec4 light_space = u_cascade_matrices[cascade] * vec4(world_pos, 1.0);
+    vec3 projCoords = light_space.xyz / light_space.w;
+    projCoords = projCoords * 0.5 + 0.5;
+    float closestDepth = texture(u_dir_light_shadow_map, vec3(projCoords.xy, float(cascade))).r;
+    float currentDepth = projCoords.z;
+    float shadow = currentDepth > closestDepth  ? 1.0 : 0.0;
+    return shadow;
+}
+#endif
+
+// the cube face the pixel falls in, then the same depth test as the sun inside that face's atlas tile
+float PointShadowCalculation(int shadow_index, vec3 light_position, vec3 world_pos)
+{
+    vec3 d = world_pos - light_position;
+    vec3 a = abs(d);
+    int face = a.x >= a.y && a.x >= a.z ? (d.x > 0.0 ? 0 : 1) : (a.y >= a.z ? (d.y > 0.0 ? 2 : 3) : (d.z > 0.0 ? 4 : 5));
+
+    vec4 light_space = u_point_shadows[shadow_index].face_matrices[face] * vec4(world_pos, 1.0);
+    vec3 projCoords = light_space.xyz / light_space.w;
+    projCoords = projCoords * 0.5 + 0.5;
+
+    // half a texel inside the tile so nothing is read from its neighbours
+    vec4 tile = u_point_shadows[shadow_index].face_tiles[face];
+    vec2 half_texel = 0.5 / vec2(textureSize(u_point_shadow_atlas, 0));
+    vec2 uv = clamp(tile.xy + projCoords.xy * tile.zw, tile.xy + half_texel, tile.xy + tile.zw - half_texel);
+    float closestDepth = texture(u_point_shadow_atlas, uv).r;
+    return projCoords.z > closestDepth ? 1.0 : 0.0;
+}
 
 
 void main()
@@ -133,7 +165,7 @@ void main()
    vec3 V = normalize(u_cam_pos - WorldPos);
    vec3 pbr = texture(u_pbr_map, aUV).xyz;
 
-   vec4 frag_pos_light_space = u_dir_light.light_space_matrix * vec4(WorldPos, 1.0);
+   float view_depth = -(u_view * vec4(WorldPos, 1.0)).z;
 
    float metallic = pbr.x;
    float roughness = pbr.y;
@@ -145,22 +177,36 @@ void main()
    // reflectance equation
    vec3 Lo = vec3(0.0);
 
-   float shadow = ShadowCalculation(N, frag_pos_light_space);
+#ifdef SINGLE_SHADOW_MAP
+   float shadow = ShadowCalculation(N, u_dir_light.light_space_matrix * vec4(WorldPos, 1.0));
+#else
+   float shadow = ShadowCalculation(WorldPos, view_depth);
+#endif
 
    Lo += handle_dir_light(N, roughness, metallic, albedo, V, F0, shadow);
 
-   for (int i = 0; i < NUM_POINT_LIGHTS; ++i)
+   // only the lights whose radius reaches this pixel's cluster
+   uvec2 cluster = get_light_cluster(aUV, view_depth);
+   for (uint c = 0; c < cluster.y; ++c)
    {
-       vec3 LightDir = u_point_lights[i].position - WorldPos;
+       PointLight light = u_point_lights[u_light_indices[cluster.x + c]];
+       vec3 LightDir = light.position - WorldPos;
        // calculate per-light radiance
        vec3 L = normalize(LightDir);
        vec3 H = normalize(V + L);
        //vec3 H = normalize(L);
 
        float distance = length(LightDir);
-       float attenuation = blinnPhongAttenuation(u_point_lights[i].radius, distance);
+       float attenuation = blinnPhongAttenuation(light.radius, distance);
        attenuation *= attenuation;
-       vec3 radiance = u_point_lights[i].colour;
+       // fades to 0 at the radius, clusters only list lights inside it
+       float range_window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+       attenuation *= range_window * range_window;
+       if (light.shadow_index >= 0)
+       {
+           attenuation *= 1.0 - PointShadowCalculation(light.shadow_index, light.position, WorldPos);
+       }
+       vec3 radiance = light.colour;
 
        // Cook-Torrance BRDF
        float NDF = DistributionGGX(N, H, roughness);
@@ -186,7 +232,7 @@ void main()
        float NdotL = max(dot(N, L), 0.0);
        vec3 diffuse = NdotL * albedo;
        // add to outgoing radiance Lo
-       Lo += (kD * attenuation * (diffuse / PI + specular)) * (radiance * u_point_lights[i].intensity)* NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
+       Lo += (kD * attenuation * (diffuse / PI + specular)) * (radiance * light.intensity)* NdotL;  // note that we already multiplied the BRDF by the Fresnel (kS) so we won't multiply by kS again
    }
 
    // ambient lighting (note that the next IBL tutorial will replace 
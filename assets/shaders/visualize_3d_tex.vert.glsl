@@ -5,11 +5,7 @@ layout(location = 1) in mat4 iTransform;
 
 layout(location = 0) out vec3 oUVW;
 
-struct AABB
-{
-	vec3 min;
-	vec3 max;
-};
+#include "common/aabb.glsl"
 
 
 
@@ -26,16 +22,6 @@ vec3 get_uv_from_invocation( int idx, ivec3 limits ) {
     return vec3( float(x) , float(y), float(z));
 }
 
-bool is_in_aabb(vec3 pos)
-{
-	if (pos.x < u_aabb.min.x) { return false; }
-	if (pos.y < u_aabb.min.y) { return false; }
-	if (pos.z < u_aabb.min.z) { return false; }
-	if (pos.x > u_aabb.max.x) { return false; }
-	if (pos.y > u_aabb.max.y) { return false; }
-	if (pos.z > u_aabb.max.z) { return false; }
-	return true;
-}
 
 
 void main()
@@ -12,22 +12,16 @@ out vec4 FragColor;
 #define QUADRATIC 1
 
 
-struct AABB
-{
-	vec3 min;
-	vec3 max;
-};
+#include "common/vxgi_data.glsl"
 
 
 uniform sampler2D   u_position_map;
 uniform sampler2D   u_normal_map;
 uniform sampler3D   u_voxel_map; // x = metallic, y = roughness, z = AO
-uniform AABB		u_aabb;
-uniform vec3		u_voxel_resolution;
-uniform vec3		u_cam_position;
-uniform float		u_max_trace_distance;
-uniform float		u_diffuse_spec_mix;
-#define VOXEL_SIZE (1/128.0)
+#ifndef VOXEL_RESOLUTION
+#define VOXEL_RESOLUTION 128
+#endif
+#define VOXEL_SIZE (1.0 / VOXEL_RESOLUTION)
 
 
 vec3 orthogonal(vec3 u) {
@@ -40,17 +34,6 @@ float rand(vec2 co){
     return fract(sin(dot(co, vec2(12.9898, 78.233))) * 43758.5453);
 }
 
-bool is_in_aabb(vec3 pos)
-{
-	if (pos.x < u_aabb.min.x) { return false; }
-	if (pos.y < u_aabb.min.y) { return false; }
-	if (pos.z < u_aabb.min.z) { return false; }
-	if (pos.x > u_aabb.max.x) { return false; }
-	if (pos.y > u_aabb.max.y) { return false; }
-	if (pos.z > u_aabb.max.z) { return false; }
-	return true;
-}
-
 
 vec3 get_texel_from_pos(vec3 position, vec3 unit)
 {
@@ -92,7 +75,7 @@ vec3 trace_ray(vec3 from, vec3 dir, vec3 unit)
 	int steps = 0;
 	const int MAX_LOD = 5;
 	int lod = 5;
-	while (accum.w < 0.99 && is_in_aabb(pos) && steps < MAX_STEPS)
+	while (accum.w < 0.99 && is_in_aabb(pos, u_aabb) && steps < MAX_STEPS)
 	{
 		pos += unit * (lod + 1) * dir;
 		vec4 result = get_voxel_colour(pos, unit, lod);
@@ -121,7 +104,7 @@ float easeOutQuart(float x) {
 
 vec3 trace_cone(vec3 from, vec3 dir, vec3 unit)
 {
-	const int MAX_STEPS = int(u_voxel_resolution.x); // should probs be the longest axis of minimum mip dimension
+	const int MAX_STEPS = VOXEL_RESOLUTION; // should probs be the longest axis of minimum mip dimension
 	const int MIN_LOD	= 2;
 	const int MAX_LOD	= 5;
 	vec4 accum = vec4(0.0);
@@ -131,7 +114,7 @@ vec3 trace_cone(vec3 from, vec3 dir, vec3 unit)
 	pos += dir * (length(unit * lod));
 	float cone_distance = distance(from, pos);
 
-	while (accum.w < 1.0 && is_in_aabb(pos) && cone_distance < u_max_trace_distance && steps < MAX_STEPS)
+	while (accum.w < 1.0 && is_in_aabb(pos, u_aabb) && cone_distance < u_max_trace_distance && steps < MAX_STEPS)
 	{
 		vec4 result = get_voxel_colour(pos, unit, lod);
 		cone_distance = distance(from, pos);
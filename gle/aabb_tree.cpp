@@ -0,0 +1,754 @@
+#include "aabb_tree.h"
+#include "transform_kernel.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+#if GLE_TRANSFORM_KERNEL_X86
+#include <xmmintrin.h>
+#endif
+
+static float box_area(const glm::vec4& min, const glm::vec4& max)
+{
+	glm::vec3 d = glm::vec3(max - min);
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static float union_area(const glm::vec4& a_min, const glm::vec4& a_max, const glm::vec4& b_min, const glm::vec4& b_max)
+{
+	return box_area(glm::min(a_min, b_min), glm::max(a_max, b_max));
+}
+
+static bool box_overlaps(const glm::vec4& a_min, const glm::vec4& a_max, const glm::vec4& b_min, const glm::vec4& b_max)
+{
+#if GLE_TRANSFORM_KERNEL_X86
+	__m128 lower = _mm_cmple_ps(_mm_loadu_ps(&a_min.x), _mm_loadu_ps(&b_max.x));
+	__m128 upper = _mm_cmple_ps(_mm_loadu_ps(&b_min.x), _mm_loadu_ps(&a_max.x));
+	return (_mm_movemask_ps(_mm_and_ps(lower, upper)) & 7) == 7;
+#else
+	return a_min.x <= b_max.x && a_min.y <= b_max.y && a_min.z <= b_max.z
+		&& b_min.x <= a_max.x && b_min.y <= a_max.y && b_min.z <= a_max.z;
+#endif
+}
+
+static bool box_contains(const glm::vec4& outer_min, const glm::vec4& outer_max, const glm::vec4& inner_min, const glm::vec4& inner_max)
+{
+	return outer_min.x <= inner_min.x && outer_min.y <= inner_min.y && outer_min.z <= inner_min.z
+		&& inner_max.x <= outer_max.x && inner_max.y <= outer_max.y && inner_max.z <= outer_max.z;
+}
+
+static float box_distance_sq(const glm::vec4& min, const glm::vec4& max, const glm::vec4& point)
+{
+#if GLE_TRANSFORM_KERNEL_X86
+	// w of the point and both corners is 0, so that lane adds nothing
+	__m128 p = _mm_loadu_ps(&point.x);
+	__m128 closest = _mm_min_ps(_mm_max_ps(p, _mm_loadu_ps(&min.x)), _mm_loadu_ps(&max.x));
+	__m128 d = _mm_sub_ps(p, closest);
+	__m128 d2 = _mm_mul_ps(d, d);
+	d2 = _mm_add_ps(d2, _mm_movehl_ps(d2, d2));
+	d2 = _mm_add_ss(d2, _mm_shuffle_ps(d2, d2, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(d2);
+#else
+	glm::vec3 d = glm::vec3(point) - glm::clamp(glm::vec3(point), glm::vec3(min), glm::vec3(max));
+	return glm::dot(d, d);
+#endif
+}
+
+// traversal stacks are per thread so const queries can run from several jobs at once
+static std::vector<i32>& get_stack()
+{
+	static thread_local std::vector<i32> stack;
+	stack.clear();
+	return stack;
+}
+
+aabb_tree::aabb_tree(float margin) : m_margin(margin)
+{
+}
+
+i32 aabb_tree::allocate_node()
+{
+	if (m_free_list == s_null)
+	{
+		m_nodes.emplace_back();
+		m_nodes.back().height = s_null;
+		m_nodes.back().parent = s_null;
+		m_free_list = (i32)m_nodes.size() - 1;
+	}
+
+	i32 index = m_free_list;
+	node& n = m_nodes[index];
+	m_free_list = n.parent;
+	n.parent = s_null;
+	n.child[0] = s_null;
+	n.child[1] = s_null;
+	n.height = 0;
+	n.user_data = 0;
+	m_node_count++;
+	return index;
+}
+
+void aabb_tree::free_node(i32 index)
+{
+	node& n = m_nodes[index];
+	n.parent = m_free_list;
+	n.height = s_null;
+	m_free_list = index;
+	m_node_count--;
+}
+
+i32 aabb_tree::create_proxy(const aabb& box, u32 user_data, bool defer_insert)
+{
+	i32 leaf = allocate_node();
+	node& n = m_nodes[leaf];
+	n.min = glm::vec4(box.min - glm::vec3(m_margin), 0.0f);
+	n.max = glm::vec4(box.max + glm::vec3(m_margin), 0.0f);
+	n.user_data = user_data;
+	m_proxy_count++;
+
+	if (defer_insert)
+	{
+		m_deferred.push_back(leaf);
+	}
+	else
+	{
+		insert_leaf(leaf);
+	}
+	return leaf;
+}
+
+void aabb_tree::destroy_proxy(i32 proxy)
+{
+	auto deferred = std::find(m_deferred.begin(), m_deferred.end(), proxy);
+	if (deferred != m_deferred.end())
+	{
+		m_deferred.erase(deferred);
+	}
+	else
+	{
+		remove_leaf(proxy);
+	}
+	free_node(proxy);
+	m_proxy_count--;
+}
+
+bool aabb_tree::move_proxy(i32 proxy, const aabb& box)
+{
+	node& n = m_nodes[proxy];
+	glm::vec4 tight_min = glm::vec4(box.min, 0.0f);
+	glm::vec4 tight_max = glm::vec4(box.max, 0.0f);
+	if (box_contains(n.min, n.max, tight_min, tight_max))
+	{
+		return false;
+	}
+
+	bool deferred = std::find(m_deferred.begin(), m_deferred.end(), proxy) != m_deferred.end();
+	if (!deferred)
+	{
+		remove_leaf(proxy);
+	}
+	n.min = tight_min - glm::vec4(glm::vec3(m_margin), 0.0f);
+	n.max = tight_max + glm::vec4(glm::vec3(m_margin), 0.0f);
+	if (!deferred)
+	{
+		insert_leaf(proxy);
+	}
+	return true;
+}
+
+aabb aabb_tree::get_fat_aabb(i32 proxy) const
+{
+	const node& n = m_nodes[proxy];
+	return aabb{ glm::vec3(n.min), glm::vec3(n.max) };
+}
+
+void aabb_tree::clear()
+{
+	m_nodes.clear();
+	m_deferred.clear();
+	m_root = s_null;
+	m_free_list = s_null;
+	m_node_count = 0;
+	m_proxy_count = 0;
+}
+
+i32 aabb_tree::find_best_sibling(i32 leaf) const
+{
+	const node& target = m_nodes[leaf];
+	const float leaf_area = box_area(target.min, target.max);
+
+	i32 best = m_root;
+	float best_cost = union_area(m_nodes[m_root].min, m_nodes[m_root].max, target.min, target.max);
+
+	// (cost the ancestors already pay for growing to include the leaf, node), cheapest candidates first so
+	// a good sibling is found early and prunes the rest
+	static thread_local std::vector<std::pair<float, i32>> heap;
+	heap.clear();
+	heap.push_back({ 0.0f, m_root });
+	auto cheaper = [](const std::pair<float, i32>& a, const std::pair<float, i32>& b) { return a.first > b.first; };
+
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), cheaper);
+		auto [inherited, index] = heap.back();
+		heap.pop_back();
+		if (leaf_area + inherited >= best_cost)
+		{
+			break;
+		}
+
+		const node& n = m_nodes[index];
+		float direct = union_area(n.min, n.max, target.min, target.max);
+		float cost = direct + inherited;
+		if (cost < best_cost)
+		{
+			best = index;
+			best_cost = cost;
+		}
+
+		// anything below pays at least the leaf's own area on top of what this level adds
+		float child_inherited = inherited + direct - box_area(n.min, n.max);
+		if (!n.is_leaf() && leaf_area + child_inherited < best_cost)
+		{
+			heap.push_back({ child_inherited, n.child[0] });
+			std::push_heap(heap.begin(), heap.end(), cheaper);
+			heap.push_back({ child_inherited, n.child[1] });
+			std::push_heap(heap.begin(), heap.end(), cheaper);
+		}
+	}
+	return best;
+}
+
+void aabb_tree::insert_leaf(i32 leaf)
+{
+	if (m_root == s_null)
+	{
+		m_root = leaf;
+		m_nodes[leaf].parent = s_null;
+		return;
+	}
+
+	i32 sibling = find_best_sibling(leaf);
+	i32 old_parent = m_nodes[sibling].parent;
+	i32 new_parent = allocate_node();
+
+	node& parent = m_nodes[new_parent];
+	parent.parent = old_parent;
+	parent.child[0] = sibling;
+	parent.child[1] = leaf;
+	m_nodes[sibling].parent = new_parent;
+	m_nodes[leaf].parent = new_parent;
+
+	if (old_parent == s_null)
+	{
+		m_root = new_parent;
+	}
+	else
+	{
+		node& grand = m_nodes[old_parent];
+		grand.child[grand.child[0] == sibling ? 0 : 1] = new_parent;
+	}
+
+	refit_upwards(new_parent);
+}
+
+void aabb_tree::remove_leaf(i32 leaf)
+{
+	if (leaf == m_root)
+	{
+		m_root = s_null;
+		return;
+	}
+
+	i32 parent = m_nodes[leaf].parent;
+	i32 grand = m_nodes[parent].parent;
+	i32 sibling = m_nodes[parent].child[0] == leaf ? m_nodes[parent].child[1] : m_nodes[parent].child[0];
+
+	if (grand == s_null)
+	{
+		m_root = sibling;
+		m_nodes[sibling].parent = s_null;
+		free_node(parent);
+		return;
+	}
+
+	node& grand_node = m_nodes[grand];
+	grand_node.child[grand_node.child[0] == parent ? 0 : 1] = sibling;
+	m_nodes[sibling].parent = grand;
+	free_node(parent);
+	refit_upwards(grand);
+}
+
+void aabb_tree::refit(i32 index)
+{
+	node& n = m_nodes[index];
+	const node& a = m_nodes[n.child[0]];
+	const node& b = m_nodes[n.child[1]];
+	n.min = glm::min(a.min, b.min);
+	n.max = glm::max(a.max, b.max);
+	n.height = 1 + std::max(a.height, b.height);
+}
+
+void aabb_tree::refit_upwards(i32 index)
+{
+	while (index != s_null)
+	{
+		refit(index);
+		rotate(index);
+		index = m_nodes[index].parent;
+	}
+}
+
+void aabb_tree::rotate(i32 index)
+{
+	node& a = m_nodes[index];
+	if (a.height < 2)
+	{
+		return;
+	}
+
+	// swap one child of a with a grandchild under the other child if that shrinks the other child the most
+	i32 best_child = s_null;
+	i32 best_grandchild = s_null;
+	float best_gain = 0.0f;
+
+	for (u32 side = 0; side < 2; side++)
+	{
+		i32 child = a.child[side];
+		i32 other = a.child[1 - side];
+		const node& other_node = m_nodes[other];
+		if (other_node.is_leaf())
+		{
+			continue;
+		}
+
+		float other_area = box_area(other_node.min, other_node.max);
+		for (u32 g = 0; g < 2; g++)
+		{
+			// child takes the place of grandchild g, other then bounds child + the remaining grandchild
+			const node& remaining = m_nodes[other_node.child[1 - g]];
+			float gain = other_area - union_area(m_nodes[child].min, m_nodes[child].max, remaining.min, remaining.max);
+			if (gain > best_gain)
+			{
+				best_gain = gain;
+				best_child = child;
+				best_grandchild = other_node.child[g];
+			}
+		}
+	}
+
+	if (best_child == s_null)
+	{
+		return;
+	}
+
+	i32 other = m_nodes[best_grandchild].parent;
+	node& other_node = m_nodes[other];
+	a.child[a.child[0] == best_child ? 0 : 1] = best_grandchild;
+	other_node.child[other_node.child[0] == best_grandchild ? 0 : 1] = best_child;
+	m_nodes[best_grandchild].parent = index;
+	m_nodes[best_child].parent = other;
+
+	refit(other);
+	refit(index);
+}
+
+void aabb_tree::rebuild()
+{
+	std::vector<i32> leaves = std::move(m_deferred);
+	m_deferred.clear();
+
+	std::vector<i32>& stack = get_stack();
+	if (m_root != s_null)
+	{
+		stack.push_back(m_root);
+	}
+	while (!stack.empty())
+	{
+		i32 index = stack.back();
+		stack.pop_back();
+		node& n = m_nodes[index];
+		if (n.is_leaf())
+		{
+			leaves.push_back(index);
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+		free_node(index);
+	}
+
+	for (i32 leaf : leaves)
+	{
+		m_nodes[leaf].height = 0;
+	}
+
+	m_root = leaves.empty() ? s_null : build_range(leaves, 0, (u32)leaves.size());
+	if (m_root != s_null)
+	{
+		m_nodes[m_root].parent = s_null;
+	}
+}
+
+i32 aabb_tree::build_range(std::vector<i32>& leaves, u32 first, u32 last)
+{
+	if (last - first == 1)
+	{
+		return leaves[first];
+	}
+
+	glm::vec3 centroid_min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 centroid_max = glm::vec3(-std::numeric_limits<float>::max());
+	for (u32 i = first; i < last; i++)
+	{
+		const node& n = m_nodes[leaves[i]];
+		glm::vec3 centroid = glm::vec3(n.min + n.max) * 0.5f;
+		centroid_min = glm::min(centroid_min, centroid);
+		centroid_max = glm::max(centroid_max, centroid);
+	}
+
+	glm::vec3 extent = centroid_max - centroid_min;
+	u32 axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	u32 mid = first + (last - first) / 2;
+	if (extent[axis] > 0.0f)
+	{
+		// binned sah : cost of a split is area * leaf count on both sides
+		constexpr u32 bin_count = 12;
+		struct bin
+		{
+			glm::vec4	min = glm::vec4(std::numeric_limits<float>::max());
+			glm::vec4	max = glm::vec4(-std::numeric_limits<float>::max());
+			u32			count = 0;
+		};
+		bin bins[bin_count];
+
+		float scale = (float)bin_count / extent[axis];
+		auto bin_of = [&](i32 leaf)
+		{
+			const node& n = m_nodes[leaf];
+			float centroid = (n.min[axis] + n.max[axis]) * 0.5f;
+			return std::min((u32)((centroid - centroid_min[axis]) * scale), bin_count - 1);
+		};
+
+		for (u32 i = first; i < last; i++)
+		{
+			bin& b = bins[bin_of(leaves[i])];
+			const node& n = m_nodes[leaves[i]];
+			b.min = glm::min(b.min, n.min);
+			b.max = glm::max(b.max, n.max);
+			b.count++;
+		}
+
+		float right_cost[bin_count] = {};
+		bin right;
+		for (u32 i = bin_count - 1; i > 0; i--)
+		{
+			right.min = glm::min(right.min, bins[i].min);
+			right.max = glm::max(right.max, bins[i].max);
+			right.count += bins[i].count;
+			right_cost[i] = right.count ? box_area(right.min, right.max) * (float)right.count : 0.0f;
+		}
+
+		u32 best_split = 0;
+		float best_cost = std::numeric_limits<float>::max();
+		bin left;
+		for (u32 i = 0; i < bin_count - 1; i++)
+		{
+			left.min = glm::min(left.min, bins[i].min);
+			left.max = glm::max(left.max, bins[i].max);
+			left.count += bins[i].count;
+			float cost = (left.count ? box_area(left.min, left.max) * (float)left.count : 0.0f) + right_cost[i + 1];
+			if (left.count > 0 && left.count < last - first && cost < best_cost)
+			{
+				best_cost = cost;
+				best_split = i;
+			}
+		}
+
+		if (best_cost < std::numeric_limits<float>::max())
+		{
+			auto split = std::partition(leaves.begin() + first, leaves.begin() + last, [&](i32 leaf) { return bin_of(leaf) <= best_split; });
+			mid = (u32)(split - leaves.begin());
+		}
+	}
+
+	if (mid == first || mid == last)
+	{
+		mid = first + (last - first) / 2;
+	}
+
+	i32 left_child = build_range(leaves, first, mid);
+	i32 right_child = build_range(leaves, mid, last);
+	i32 index = allocate_node();
+	node& n = m_nodes[index];
+	n.child[0] = left_child;
+	n.child[1] = right_child;
+	m_nodes[left_child].parent = index;
+	m_nodes[right_child].parent = index;
+	refit(index);
+	return index;
+}
+
+void aabb_tree::collect_leaves(i32 index, std::vector<u32>& out) const
+{
+	// separate stack, the caller's traversal is still using the shared one
+	static thread_local std::vector<i32> stack;
+	stack.clear();
+	stack.push_back(index);
+	while (!stack.empty())
+	{
+		const node& n = m_nodes[stack.back()];
+		stack.pop_back();
+		if (n.is_leaf())
+		{
+			out.push_back(n.user_data);
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+	}
+}
+
+void aabb_tree::query_aabb(const aabb& box, std::vector<u32>& out) const
+{
+	if (m_root == s_null)
+	{
+		return;
+	}
+
+	glm::vec4 query_min = glm::vec4(box.min, 0.0f);
+	glm::vec4 query_max = glm::vec4(box.max, 0.0f);
+	std::vector<i32>& stack = get_stack();
+	stack.push_back(m_root);
+	while (!stack.empty())
+	{
+		const node& n = m_nodes[stack.back()];
+		stack.pop_back();
+		if (!box_overlaps(n.min, n.max, query_min, query_max))
+		{
+			continue;
+		}
+		if (n.is_leaf())
+		{
+			out.push_back(n.user_data);
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+	}
+}
+
+void aabb_tree::query_sphere(glm::vec3 center, float radius, std::vector<u32>& out) const
+{
+	if (m_root == s_null)
+	{
+		return;
+	}
+
+	glm::vec4 point = glm::vec4(center, 0.0f);
+	float radius_sq = radius * radius;
+	std::vector<i32>& stack = get_stack();
+	stack.push_back(m_root);
+	while (!stack.empty())
+	{
+		const node& n = m_nodes[stack.back()];
+		stack.pop_back();
+		if (box_distance_sq(n.min, n.max, point) > radius_sq)
+		{
+			continue;
+		}
+		if (n.is_leaf())
+		{
+			out.push_back(n.user_data);
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+	}
+}
+
+void aabb_tree::query_frustum(const frustum& view_frustum, std::vector<u32>& out) const
+{
+	if (m_root == s_null)
+	{
+		return;
+	}
+
+	enum classification { outside, intersecting, inside };
+
+#if GLE_TRANSFORM_KERNEL_X86
+	// planes as two groups of four, the last group repeats the far plane
+	__m128 plane[2][4];
+	__m128 abs_normal[2][3];
+	for (u32 group = 0; group < 2; group++)
+	{
+		for (u32 c = 0; c < 4; c++)
+		{
+			float values[4];
+			for (u32 lane = 0; lane < 4; lane++)
+			{
+				values[lane] = view_frustum.m_planes[std::min(group * 4 + lane, 5u)][c];
+			}
+			plane[group][c] = _mm_loadu_ps(values);
+			if (c < 3)
+			{
+				abs_normal[group][c] = _mm_loadu_ps(values);
+				abs_normal[group][c] = _mm_andnot_ps(_mm_set1_ps(-0.0f), abs_normal[group][c]);
+			}
+		}
+	}
+
+	auto classify = [&](const node& n)
+	{
+		glm::vec3 center = glm::vec3(n.min + n.max) * 0.5f;
+		glm::vec3 extent = glm::vec3(n.max - n.min) * 0.5f;
+		__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+		__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+
+		int straddling = 0;
+		for (u32 group = 0; group < 2; group++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[group][0], cx), _mm_mul_ps(plane[group][1], cy)), _mm_add_ps(_mm_mul_ps(plane[group][2], cz), plane[group][3]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_normal[group][0], ex), _mm_mul_ps(abs_normal[group][1], ey)), _mm_mul_ps(abs_normal[group][2], ez));
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())))
+			{
+				return outside;
+			}
+			straddling |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps()));
+		}
+		return straddling ? intersecting : inside;
+	};
+#else
+	auto classify = [&](const node& n)
+	{
+		glm::vec3 center = glm::vec3(n.min + n.max) * 0.5f;
+		glm::vec3 extent = glm::vec3(n.max - n.min) * 0.5f;
+		bool straddling = false;
+		for (const glm::vec4& p : view_frustum.m_planes)
+		{
+			float distance = glm::dot(glm::vec3(p), center) + p.w;
+			float radius = glm::dot(glm::abs(glm::vec3(p)), extent);
+			if (distance + radius < 0.0f)
+			{
+				return outside;
+			}
+			straddling |= distance - radius < 0.0f;
+		}
+		return straddling ? intersecting : inside;
+	};
+#endif
+
+	std::vector<i32>& stack = get_stack();
+	stack.push_back(m_root);
+	while (!stack.empty())
+	{
+		i32 index = stack.back();
+		stack.pop_back();
+		const node& n = m_nodes[index];
+
+		classification result = classify(n);
+		if (result == outside)
+		{
+			continue;
+		}
+		if (result == inside || n.is_leaf())
+		{
+			collect_leaves(index, out);
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+	}
+}
+
+void aabb_tree::raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, const ray_callback& callback) const
+{
+	if (m_root == s_null)
+	{
+		return;
+	}
+
+	glm::vec3 inv_direction = 1.0f / direction;
+
+#if GLE_TRANSFORM_KERNEL_X86
+	__m128 ray_origin = _mm_setr_ps(origin.x, origin.y, origin.z, origin.x);
+	__m128 ray_inv = _mm_setr_ps(inv_direction.x, inv_direction.y, inv_direction.z, inv_direction.x);
+
+	// slab test, lane w repeats x so the horizontal min / max can run over all four lanes
+	auto entry_distance = [&](const node& n, float limit)
+	{
+		__m128 box_min = _mm_shuffle_ps(_mm_loadu_ps(&n.min.x), _mm_loadu_ps(&n.min.x), _MM_SHUFFLE(0, 2, 1, 0));
+		__m128 box_max = _mm_shuffle_ps(_mm_loadu_ps(&n.max.x), _mm_loadu_ps(&n.max.x), _MM_SHUFFLE(0, 2, 1, 0));
+		__m128 t0 = _mm_mul_ps(_mm_sub_ps(box_min, ray_origin), ray_inv);
+		__m128 t1 = _mm_mul_ps(_mm_sub_ps(box_max, ray_origin), ray_inv);
+		__m128 near_t = _mm_min_ps(t0, t1);
+		__m128 far_t = _mm_max_ps(t0, t1);
+		near_t = _mm_max_ps(near_t, _mm_shuffle_ps(near_t, near_t, _MM_SHUFFLE(2, 3, 0, 1)));
+		near_t = _mm_max_ps(near_t, _mm_shuffle_ps(near_t, near_t, _MM_SHUFFLE(1, 0, 3, 2)));
+		far_t = _mm_min_ps(far_t, _mm_shuffle_ps(far_t, far_t, _MM_SHUFFLE(2, 3, 0, 1)));
+		far_t = _mm_min_ps(far_t, _mm_shuffle_ps(far_t, far_t, _MM_SHUFFLE(1, 0, 3, 2)));
+		float t_near = std::max(_mm_cvtss_f32(near_t), 0.0f);
+		float t_far = std::min(_mm_cvtss_f32(far_t), limit);
+		return t_near <= t_far ? t_near : -1.0f;
+	};
+#else
+	auto entry_distance = [&](const node& n, float limit)
+	{
+		glm::vec3 t0 = (glm::vec3(n.min) - origin) * inv_direction;
+		glm::vec3 t1 = (glm::vec3(n.max) - origin) * inv_direction;
+		glm::vec3 near_t = glm::min(t0, t1);
+		glm::vec3 far_t = glm::max(t0, t1);
+		float t_near = std::max(std::max(near_t.x, near_t.y), std::max(near_t.z, 0.0f));
+		float t_far = std::min(std::min(far_t.x, far_t.y), std::min(far_t.z, limit));
+		return t_near <= t_far ? t_near : -1.0f;
+	};
+#endif
+
+	std::vector<i32>& stack = get_stack();
+	stack.push_back(m_root);
+	while (!stack.empty())
+	{
+		const node& n = m_nodes[stack.back()];
+		stack.pop_back();
+
+		float t = entry_distance(n, max_distance);
+		if (t < 0.0f)
+		{
+			continue;
+		}
+		if (n.is_leaf())
+		{
+			max_distance = std::min(max_distance, callback(n.user_data, t));
+			if (max_distance <= 0.0f)
+			{
+				return;
+			}
+			continue;
+		}
+		stack.push_back(n.child[0]);
+		stack.push_back(n.child[1]);
+	}
+}
+
+i32 aabb_tree::get_height() const
+{
+	return m_root == s_null ? 0 : m_nodes[m_root].height;
+}
+
+float aabb_tree::get_area_ratio() const
+{
+	if (m_root == s_null)
+	{
+		return 0.0f;
+	}
+
+	float total = 0.0f;
+	for (const node& n : m_nodes)
+	{
+		if (n.height > 0)
+		{
+			total += box_area(n.min, n.max);
+		}
+	}
+	return total / box_area(m_nodes[m_root].min, m_nodes[m_root].max);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include "glm.hpp"
+#include "shape.h"
+#include "alias.h"
+
+// dynamic bounding volume hierarchy over fat aabbs (box2d style). leaves keep a box grown by m_margin so small
+// movements don't touch the tree, inserts pick the sibling with the lowest surface area cost (branch and bound),
+// and every refit on the way back up tries a rotation to keep it balanced. rebuild() replaces the whole tree
+// with a binned sah build, which is both faster and better than inserting a large batch one by one.
+// node bounds are padded to vec4 so the query tests run on sse registers
+class aabb_tree
+{
+public:
+	static constexpr i32 s_null = -1;
+
+	struct ray_hit
+	{
+		u32		user_data;
+		float	distance;
+	};
+
+	// a leaf's user data and the distance the ray enters its fat box at, returns the new max distance of the ray
+	// (return max_distance to keep going, 0 to stop)
+	using ray_callback = std::function<float(u32 user_data, float box_distance)>;
+
+	aabb_tree(float margin = 0.1f);
+
+	// deferred proxies aren't in the tree (or any query) until the next rebuild
+	i32			create_proxy(const aabb& box, u32 user_data, bool defer_insert = false);
+	void		destroy_proxy(i32 proxy);
+	// returns true if the proxy had to be reinserted, false if box was still inside its fat box
+	bool		move_proxy(i32 proxy, const aabb& box);
+	void		rebuild();
+	void		clear();
+
+	u32			get_user_data(i32 proxy) const { return m_nodes[proxy].user_data; }
+	aabb		get_fat_aabb(i32 proxy) const;
+
+	void		query_aabb(const aabb& box, std::vector<u32>& out) const;
+	void		query_sphere(glm::vec3 center, float radius, std::vector<u32>& out) const;
+	// subtrees fully inside the frustum are appended without testing their children
+	void		query_frustum(const frustum& view_frustum, std::vector<u32>& out) const;
+	void		raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, const ray_callback& callback) const;
+
+	u32			get_proxy_count() const { return m_proxy_count; }
+	u32			get_node_count() const { return m_node_count; }
+	i32			get_height() const;
+	// sum of internal node areas / root area, lower is a better tree
+	float		get_area_ratio() const;
+
+	float		m_margin;
+
+private:
+	struct node
+	{
+		// xyz used, w padding so both load as one sse register
+		alignas(16) glm::vec4	min;
+		alignas(16) glm::vec4	max;
+		// next free node while on the free list
+		i32						parent;
+		i32						child[2];
+		// leaf = 0, s_null while free or deferred
+		i32						height;
+		u32						user_data;
+
+		bool	is_leaf() const { return child[0] == s_null; }
+	};
+
+	i32			allocate_node();
+	void		free_node(i32 index);
+	void		insert_leaf(i32 leaf);
+	void		remove_leaf(i32 leaf);
+	i32			find_best_sibling(i32 leaf) const;
+	// refits and rotates every node from index to the root
+	void		refit_upwards(i32 index);
+	void		rotate(i32 index);
+	void		refit(i32 index);
+	i32			build_range(std::vector<i32>& leaves, u32 first, u32 last);
+	void		collect_leaves(i32 index, std::vector<u32>& out) const;
+
+	std::vector<node>	m_nodes;
+	i32					m_root = s_null;
+	i32					m_free_list = s_null;
+	u32					m_node_count = 0;
+	u32					m_proxy_count = 0;
+	std::vector<i32>	m_deferred;
+};
@@ -26,6 +26,7 @@ void camera::update(glm::vec2 screen_dim)
         // todo
         break;
     }
+    m_frustum.extract(m_proj * m_view);
 }
 
 glm::mat4 camera::get_rotation_matrix()
@@ -1,5 +1,6 @@
 #pragma once
 #include "glm.hpp"
+#include "shape.h"
 
 struct camera
 {
@@ -18,6 +19,9 @@ struct camera
 
 	projection_type m_projection_type = projection_type::perspective;
 
+	// world space planes of m_proj * m_view, refreshed by update
+	frustum		m_frustum;
+
 	void update(glm::vec2 screen_dim);
 
 	glm::mat4 get_rotation_matrix();
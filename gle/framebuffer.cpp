@@ -1,4 +1,5 @@
 #include "framebuffer.h"
+#include "gl_state.h"
 #include <iostream>
 
 framebuffer::framebuffer()
@@ -8,7 +9,7 @@ framebuffer::framebuffer()
 
 void framebuffer::unbind()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_state::bind_framebuffer(0);
 }
 
 void framebuffer::cleanup()
@@ -21,11 +22,11 @@ void framebuffer::add_colour_attachment(GLenum attachment_index, uint32_t width,
 {
 	gl_handle textureColorbuffer;
 	glGenTextures(1, &textureColorbuffer);
-	glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, textureColorbuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, pixel_format, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, 0);
 
 	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment_index, GL_TEXTURE_2D, textureColorbuffer, 0);
 	m_colour_attachments.push_back(textureColorbuffer);
@@ -52,7 +53,7 @@ void framebuffer::add_depth_attachment_sampler_friendly(uint32_t width, uint32_t
 {
 	gl_handle depthMap;
 	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, depthMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
 		width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -96,5 +97,5 @@ void framebuffer::check()
 
 void framebuffer::bind()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_handle);
+	gl_state::bind_framebuffer(m_handle);
 }
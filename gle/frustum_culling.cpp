@@ -0,0 +1,145 @@
+#include "frustum_culling.h"
+#include <cmath>
+#if GLE_TRANSFORM_KERNEL_X86
+#include <xmmintrin.h>
+#endif
+
+void aabb_soa::clear()
+{
+	for (u32 axis = 0; axis < 3; axis++)
+	{
+		m_center[axis].clear();
+		m_extent[axis].clear();
+	}
+}
+
+void aabb_soa::push(const aabb& box)
+{
+	for (u32 axis = 0; axis < 3; axis++)
+	{
+		m_center[axis].push_back((box.min[axis] + box.max[axis]) * 0.5f);
+		m_extent[axis].push_back((box.max[axis] - box.min[axis]) * 0.5f);
+	}
+}
+
+void frustum_culling::cull(const frustum& view_frustum, const aabb_soa& boxes, std::vector<u32>& visible)
+{
+	const u32 count = boxes.size();
+	switch (transform_kernel::get_path())
+	{
+#if GLE_TRANSFORM_KERNEL_X86
+		case transform_kernel::path::avx2:
+		{
+			u32 wide = count & ~7u;
+			cull_avx2(view_frustum, boxes, 0, wide, visible);
+			cull_scalar(view_frustum, boxes, wide, count - wide, visible);
+			return;
+		}
+		case transform_kernel::path::sse4:
+		{
+			u32 wide = count & ~3u;
+			cull_sse(view_frustum, boxes, 0, wide, visible);
+			cull_scalar(view_frustum, boxes, wide, count - wide, visible);
+			return;
+		}
+#endif
+		default:
+			cull_scalar(view_frustum, boxes, 0, count, visible);
+			return;
+	}
+}
+
+void frustum_culling::refine(const frustum& view_frustum, const aabb_soa& boxes, std::vector<u32>& visible)
+{
+	// survivors are scattered, so this stays scalar and compacts in place
+	u32 kept = 0;
+	for (u32 index : visible)
+	{
+		bool inside = true;
+		for (const glm::vec4& p : view_frustum.m_planes)
+		{
+			float distance = p.x * boxes.m_center[0][index] + p.y * boxes.m_center[1][index] + p.z * boxes.m_center[2][index] + p.w;
+			float radius = std::abs(p.x) * boxes.m_extent[0][index] + std::abs(p.y) * boxes.m_extent[1][index] + std::abs(p.z) * boxes.m_extent[2][index];
+			if (distance < -radius)
+			{
+				inside = false;
+				break;
+			}
+		}
+		if (inside)
+		{
+			visible[kept++] = index;
+		}
+	}
+	visible.resize(kept);
+}
+
+void frustum_culling::cull_scalar(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible)
+{
+	for (u32 i = first; i < first + count; i++)
+	{
+		bool inside = true;
+		for (const glm::vec4& p : view_frustum.m_planes)
+		{
+			float distance = p.x * boxes.m_center[0][i] + p.y * boxes.m_center[1][i] + p.z * boxes.m_center[2][i] + p.w;
+			float radius = std::abs(p.x) * boxes.m_extent[0][i] + std::abs(p.y) * boxes.m_extent[1][i] + std::abs(p.z) * boxes.m_extent[2][i];
+			if (distance < -radius)
+			{
+				inside = false;
+				break;
+			}
+		}
+		if (inside)
+		{
+			visible.push_back(i);
+		}
+	}
+}
+
+#if GLE_TRANSFORM_KERNEL_X86
+void frustum_culling::cull_sse(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible)
+{
+	__m128 plane[6][4];
+	__m128 abs_normal[6][3];
+	for (u32 p = 0; p < 6; p++)
+	{
+		for (u32 c = 0; c < 4; c++)
+		{
+			plane[p][c] = _mm_set1_ps(view_frustum.m_planes[p][c]);
+		}
+		for (u32 c = 0; c < 3; c++)
+		{
+			abs_normal[p][c] = _mm_set1_ps(std::abs(view_frustum.m_planes[p][c]));
+		}
+	}
+
+	for (u32 i = first; i < first + count; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&boxes.m_center[0][i]);
+		__m128 cy = _mm_loadu_ps(&boxes.m_center[1][i]);
+		__m128 cz = _mm_loadu_ps(&boxes.m_center[2][i]);
+		__m128 ex = _mm_loadu_ps(&boxes.m_extent[0][i]);
+		__m128 ey = _mm_loadu_ps(&boxes.m_extent[1][i]);
+		__m128 ez = _mm_loadu_ps(&boxes.m_extent[2][i]);
+
+		int mask = 0xF;
+		for (u32 p = 0; p < 6 && mask; p++)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane[p][0], cx), _mm_mul_ps(plane[p][1], cy)), _mm_add_ps(_mm_mul_ps(plane[p][2], cz), plane[p][3]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_normal[p][0], ex), _mm_mul_ps(abs_normal[p][1], ey)), _mm_mul_ps(abs_normal[p][2], ez));
+			// distance + radius >= 0 keeps the box
+			mask &= _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		for (; mask; mask &= mask - 1)
+		{
+			u32 lane = 0;
+			while (!(mask & (1 << lane)))
+			{
+				lane++;
+			}
+			visible.push_back(i + lane);
+		}
+	}
+}
+#endif
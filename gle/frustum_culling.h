@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "shape.h"
+#include "alias.h"
+#include "transform_kernel.h"
+
+// world bounds as center / extent streams, the simd tests load 4 (sse) or 8 (avx) boxes per instruction from them
+struct aabb_soa
+{
+	std::vector<float>	m_center[3];
+	std::vector<float>	m_extent[3];
+
+	void	clear();
+	void	push(const aabb& box);
+	u32		size() const { return (u32)m_center[0].size(); }
+};
+
+// center / extent test against the six planes : a box is culled once it's fully behind any of them.
+// boxes straddling a plane corner can pass (conservative), never the other way around
+class frustum_culling
+{
+public:
+	// appends the index of every box that may be visible to visible, in input order
+	static void		cull(const frustum& view_frustum, const aabb_soa& boxes, std::vector<u32>& visible);
+	// second test on the survivors of cull : drops the indices in visible whose box is outside view_frustum
+	static void		refine(const frustum& view_frustum, const aabb_soa& boxes, std::vector<u32>& visible);
+
+	static void		cull_scalar(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible);
+#if GLE_TRANSFORM_KERNEL_X86
+	static void		cull_sse(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible);
+	// compiled for avx2 + fma (GLE_TARGET_AVX2), only called when transform_kernel detected avx2
+	static void		cull_avx2(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible);
+#endif
+};
@@ -0,0 +1,52 @@
+// compiled for avx2 + fma (GLE_TARGET_AVX2), only called when the cpu reports support for both
+#include "frustum_culling.h"
+#include <cmath>
+
+#if GLE_TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+
+GLE_TARGET_AVX2 void frustum_culling::cull_avx2(const frustum& view_frustum, const aabb_soa& boxes, u32 first, u32 count, std::vector<u32>& visible)
+{
+	__m256 plane[6][4];
+	__m256 abs_normal[6][3];
+	for (u32 p = 0; p < 6; p++)
+	{
+		for (u32 c = 0; c < 4; c++)
+		{
+			plane[p][c] = _mm256_set1_ps(view_frustum.m_planes[p][c]);
+		}
+		for (u32 c = 0; c < 3; c++)
+		{
+			abs_normal[p][c] = _mm256_set1_ps(std::abs(view_frustum.m_planes[p][c]));
+		}
+	}
+
+	for (u32 i = first; i < first + count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&boxes.m_center[0][i]);
+		__m256 cy = _mm256_loadu_ps(&boxes.m_center[1][i]);
+		__m256 cz = _mm256_loadu_ps(&boxes.m_center[2][i]);
+		__m256 ex = _mm256_loadu_ps(&boxes.m_extent[0][i]);
+		__m256 ey = _mm256_loadu_ps(&boxes.m_extent[1][i]);
+		__m256 ez = _mm256_loadu_ps(&boxes.m_extent[2][i]);
+
+		int mask = 0xFF;
+		for (u32 p = 0; p < 6 && mask; p++)
+		{
+			__m256 distance = _mm256_fmadd_ps(plane[p][0], cx, _mm256_fmadd_ps(plane[p][1], cy, _mm256_fmadd_ps(plane[p][2], cz, plane[p][3])));
+			__m256 radius = _mm256_fmadd_ps(abs_normal[p][0], ex, _mm256_fmadd_ps(abs_normal[p][1], ey, _mm256_mul_ps(abs_normal[p][2], ez)));
+			mask &= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		for (; mask; mask &= mask - 1)
+		{
+			u32 lane = 0;
+			while (!(mask & (1 << lane)))
+			{
+				lane++;
+			}
+			visible.push_back(i + lane);
+		}
+	}
+}
+#endif
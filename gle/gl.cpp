@@ -5,6 +5,10 @@
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_opengl3.h"
 #include "input.h"
+#include "uniform_buffer.h"
+#include "gl_state.h"
+#include "transform_buffer.h"
+#include "job_system.h"
 
 #undef main
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -357,6 +361,10 @@ void engine::init(glm::ivec2 resolution)
     s_last_counter  = 0;    
 
     init_built_in_assets();
+    uniform_ring_buffer::init();
+    transform_buffer::init();
+    gl_state::invalidate();
+    job_system::init();
 }
 
 void engine::process_sdl_event()
@@ -390,11 +398,17 @@ void engine::engine_pre_frame()
 
     s_frametime = (float)((s_now_counter - s_last_counter) / (float)SDL_GetPerformanceFrequency());
 
-    glViewport(0, 0, (int)s_imgui_io->DisplaySize.x, (int)s_imgui_io->DisplaySize.y);
+    gl_state::begin_frame();
+    gl_state::viewport(0, 0, (int)s_imgui_io->DisplaySize.x, (int)s_imgui_io->DisplaySize.y);
     glClearColor(clear_color.x * clear_color.w, clear_color.y * clear_color.w, clear_color.z * clear_color.w, clear_color.w);
     glClear(GL_COLOR_BUFFER_BIT);
     glClear(GL_DEPTH_BUFFER_BIT);
 
+    uniform_ring_buffer::begin_frame();
+    transform_buffer::begin_frame();
+    // gl work queued by worker jobs since last frame
+    job_system::run_main_thread_jobs();
+
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame();
@@ -406,12 +420,16 @@ void engine::engine_post_frame()
     // Rendering
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    // imgui sets its own program, vao, textures, blend and scissor state
+    gl_state::invalidate();
+    transform_buffer::end_frame();
     SDL_GL_SwapWindow(s_window);
 }
 
 void engine::engine_shut_down()
 {
     // Cleanup
+    job_system::shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,175 @@
+#include "gl_state.h"
+#include <algorithm>
+#include <iterator>
+
+void gl_state::use_program(gl_handle program)
+{
+	if (s_program == program)
+	{
+		s_frame.skipped++;
+		return;
+	}
+	glUseProgram(program);
+	s_program = program;
+	s_frame.issued++;
+}
+
+void gl_state::bind_vao(gl_handle vao)
+{
+	if (s_vao == vao)
+	{
+		s_frame.skipped++;
+		return;
+	}
+	glBindVertexArray(vao);
+	s_vao = vao;
+	s_frame.issued++;
+}
+
+void gl_state::bind_texture(GLenum texture_slot, GLenum texture_target, gl_handle texture)
+{
+	u32 unit = texture_slot - GL_TEXTURE0;
+	int target = get_target_index(texture_target);
+	bool tracked = unit < k_max_texture_units && target >= 0;
+
+	if (tracked && s_textures[unit][target] == texture)
+	{
+		s_frame.skipped++;
+		return;
+	}
+
+	if (s_active_texture != texture_slot)
+	{
+		glActiveTexture(texture_slot);
+		s_active_texture = texture_slot;
+		s_frame.issued++;
+	}
+	glBindTexture(texture_target, texture);
+	s_frame.issued++;
+
+	if (tracked)
+	{
+		s_textures[unit][target] = texture;
+	}
+}
+
+void gl_state::bind_framebuffer(gl_handle framebuffer)
+{
+	if (s_framebuffer == framebuffer)
+	{
+		s_frame.skipped++;
+		return;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	s_framebuffer = framebuffer;
+	s_frame.issued++;
+}
+
+void gl_state::viewport(i32 x, i32 y, i32 width, i32 height)
+{
+	if (s_viewport[0] == x && s_viewport[1] == y && s_viewport[2] == width && s_viewport[3] == height)
+	{
+		s_frame.skipped++;
+		return;
+	}
+	glViewport(x, y, width, height);
+	s_viewport[0] = x;
+	s_viewport[1] = y;
+	s_viewport[2] = width;
+	s_viewport[3] = height;
+	s_frame.issued++;
+}
+
+void gl_state::enable(GLenum cap)
+{
+	set_cap(cap, true);
+}
+
+void gl_state::disable(GLenum cap)
+{
+	set_cap(cap, false);
+}
+
+void gl_state::invalidate()
+{
+	s_program = k_unknown;
+	s_vao = k_unknown;
+	s_framebuffer = k_unknown;
+	s_active_texture = k_unknown;
+	for (auto& unit : s_textures)
+	{
+		std::fill(std::begin(unit), std::end(unit), k_unknown);
+	}
+	std::fill(std::begin(s_viewport), std::end(s_viewport), -1);
+	std::fill(std::begin(s_caps), std::end(s_caps), 2);
+}
+
+void gl_state::begin_frame()
+{
+	s_last_frame = s_frame;
+	s_frame = {};
+	invalidate();
+}
+
+int gl_state::get_target_index(GLenum texture_target)
+{
+	switch (texture_target)
+	{
+		case GL_TEXTURE_2D:
+			return 0;
+		case GL_TEXTURE_3D:
+			return 1;
+		case GL_TEXTURE_2D_ARRAY:
+			return 2;
+		case GL_TEXTURE_CUBE_MAP:
+			return 3;
+		default:
+			return -1;
+	}
+}
+
+int gl_state::get_cap_index(GLenum cap)
+{
+	switch (cap)
+	{
+		case GL_DEPTH_TEST:
+			return 0;
+		case GL_CULL_FACE:
+			return 1;
+		case GL_BLEND:
+			return 2;
+		case GL_STENCIL_TEST:
+			return 3;
+		case GL_SCISSOR_TEST:
+			return 4;
+		case GL_PROGRAM_POINT_SIZE:
+			return 5;
+		default:
+			return -1;
+	}
+}
+
+void gl_state::set_cap(GLenum cap, bool enabled)
+{
+	int index = get_cap_index(cap);
+	if (index >= 0 && s_caps[index] == (u8)enabled)
+	{
+		s_frame.skipped++;
+		return;
+	}
+
+	if (enabled)
+	{
+		glEnable(cap);
+	}
+	else
+	{
+		glDisable(cap);
+	}
+
+	if (index >= 0)
+	{
+		s_caps[index] = (u8)enabled;
+	}
+	s_frame.issued++;
+}
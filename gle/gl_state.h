@@ -0,0 +1,52 @@
+#pragma once
+#include "GL/glew.h"
+#include "alias.h"
+
+// shadows the bits of gl state the renderer touches every frame and drops calls that wouldn't change anything.
+// anything that talks to gl directly (imgui, im3d, resource creation) must be followed by invalidate()
+class gl_state
+{
+public:
+	static void		use_program(gl_handle program);
+	static void		bind_vao(gl_handle vao);
+	// texture_slot is GL_TEXTURE0 + n, like glActiveTexture
+	static void		bind_texture(GLenum texture_slot, GLenum texture_target, gl_handle texture);
+	static void		bind_framebuffer(gl_handle framebuffer);
+	static void		viewport(i32 x, i32 y, i32 width, i32 height);
+	static void		enable(GLenum cap);
+	static void		disable(GLenum cap);
+
+	// forget everything, the next call of each kind is always issued
+	static void		invalidate();
+	// publishes last frame's counters and invalidates, called from engine_pre_frame
+	static void		begin_frame();
+
+	struct frame_stats
+	{
+		u32	issued;
+		u32	skipped;
+	};
+
+	inline static frame_stats	s_last_frame = {};
+
+private:
+	static constexpr u32		k_max_texture_units = 32;
+	static constexpr u32		k_texture_targets = 4;
+	static constexpr u32		k_tracked_caps = 6;
+	static constexpr gl_handle	k_unknown = 0xFFFFFFFF;
+
+	static int					get_target_index(GLenum texture_target);
+	static int					get_cap_index(GLenum cap);
+	static void					set_cap(GLenum cap, bool enabled);
+
+	inline static gl_handle		s_program = k_unknown;
+	inline static gl_handle		s_vao = k_unknown;
+	inline static gl_handle		s_framebuffer = k_unknown;
+	inline static GLenum		s_active_texture = k_unknown;
+	inline static gl_handle		s_textures[k_max_texture_units][k_texture_targets];
+	inline static i32			s_viewport[4] = { -1, -1, -1, -1 };
+	// 0 = disabled, 1 = enabled, 2 = unknown
+	inline static u8			s_caps[k_tracked_caps] = { 2, 2, 2, 2, 2, 2 };
+
+	inline static frame_stats	s_frame = {};
+};
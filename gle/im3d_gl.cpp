@@ -1,4 +1,5 @@
 #include "im3d_gl.h"
+#include "shader_batch.h"
 #include "utils.h"
 #include "im3d.h"
 #include "im3d_math.h"
@@ -6,6 +7,7 @@
 #include "imgui.h"
 #include "input.h"
 #include "gl.h"
+#include "gl_state.h"
 
 Im3d::Mat4 ToIm3D(const glm::mat4& _m) {
     Im3d::Mat4 m(1.0);
@@ -134,9 +136,11 @@ im3d_state im3d_gl::load_im3d()
 
     std::string geo = utils::load_string_from_path("assets/shaders/im3d/im3d.geom.glsl");
 
-    shader points_shader(points_vert, points_frag);
-    shader line_shader(lines_vert, geo, lines_frag);
-    shader tris_shader(tris_vert, tris_frag);
+    shader_batch batch;
+    shader points_shader = batch.add("im3d_points", points_vert, points_frag);
+    shader line_shader = batch.add("im3d_lines", lines_vert, geo, lines_frag);
+    shader tris_shader = batch.add("im3d_tris", tris_vert, tris_frag);
+    batch.wait();
 
     gl_handle im3d_vertex_buffer;
     gl_handle im3d_vao;
@@ -184,11 +188,11 @@ void im3d_gl::end_frame_im3d(im3d_state& state, glm::ivec2 screen_dim, camera& c
 	//glEnable(GL_BLEND);
 	//glBlendEquation(GL_FUNC_ADD);
 	//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_PROGRAM_POINT_SIZE);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
+	gl_state::enable(GL_PROGRAM_POINT_SIZE);
+	gl_state::disable(GL_DEPTH_TEST);
+	gl_state::disable(GL_CULL_FACE);
 
-	glViewport(0, 0, (GLsizei)screen_dim.x, (GLsizei)screen_dim.y);
+	gl_state::viewport(0, 0, (GLsizei)screen_dim.x, (GLsizei)screen_dim.y);
 	glm::mat4 viewProj = cam.m_proj * cam.m_view;
 
 	for (uint32_t i = 0, n = Im3d::GetDrawListCount(); i < n; ++i)
@@ -202,12 +206,12 @@ void im3d_gl::end_frame_im3d(im3d_state& state, glm::ivec2 screen_dim, camera& c
 		case Im3d::DrawPrimitive_Points:
 			prim = GL_POINTS;
 			sh = state.points_shader.m_shader_id;
-			glDisable(GL_CULL_FACE); // points are view-aligned
+			gl_state::disable(GL_CULL_FACE); // points are view-aligned
 			break;
 		case Im3d::DrawPrimitive_Lines:
 			prim = GL_LINES;
 			sh = state.line_shader.m_shader_id;
-			glDisable(GL_CULL_FACE); // lines are view-aligned
+			gl_state::disable(GL_CULL_FACE); // lines are view-aligned
 			break;
 		case Im3d::DrawPrimitive_Triangles:
 			prim = GL_TRIANGLES;
@@ -219,12 +223,12 @@ void im3d_gl::end_frame_im3d(im3d_state& state, glm::ivec2 screen_dim, camera& c
 			return;
 		};
 
-		glBindVertexArray(state.im3d_vao);
+		gl_state::bind_vao(state.im3d_vao);
 		glBindBuffer(GL_ARRAY_BUFFER, state.im3d_vertex_buffer);
 		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)drawList.m_vertexCount * sizeof(Im3d::VertexData), (GLvoid*)drawList.m_vertexData, GL_STREAM_DRAW);
 
 		// AppData& ad = GetAppData();
-		glUseProgram(sh);
+		gl_state::use_program(sh);
 		glUniform2f(glGetUniformLocation(sh, "uViewport"), screen_dim.x, screen_dim.y);
 		glUniformMatrix4fv(glGetUniformLocation(sh, "uViewProjMatrix"), 1, false, glm::value_ptr(viewProj));
 		glDrawArrays(prim, 0, (GLsizei)drawList.m_vertexCount);
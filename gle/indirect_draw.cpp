@@ -0,0 +1,137 @@
+#include "indirect_draw.h"
+#include "mesh.h"
+#include "transform.h"
+#include "material.h"
+
+static bool same_geometry(const mesh& a, const mesh& b)
+{
+	return a.m_vao.m_vao_id == b.m_vao.m_vao_id
+		&& a.m_first_index == b.m_first_index
+		&& a.m_base_vertex == b.m_base_vertex
+		&& a.m_index_count == b.m_index_count;
+}
+
+void indirect_draw_buffer::clear()
+{
+	m_commands.clear();
+	m_instances.clear();
+	m_ranges.clear();
+}
+
+u32 indirect_draw_buffer::add(const mesh& geometry, const transform& trans, u32 material_index)
+{
+	draw_elements_indirect_command command{};
+	command.count = geometry.m_index_count;
+	command.instance_count = 1;
+	command.first_index = geometry.m_first_index;
+	command.base_vertex = geometry.m_base_vertex;
+	command.base_instance = (u32)m_instances.size();
+	m_commands.push_back(command);
+
+	m_instances.push_back({ trans.m_gpu_index, material_index });
+
+	return (u32)m_commands.size() - 1;
+}
+
+void indirect_draw_buffer::add_instance(const transform& trans, u32 material_index)
+{
+	m_commands.back().instance_count++;
+	m_instances.push_back({ trans.m_gpu_index, material_index });
+}
+
+void indirect_draw_buffer::record(const std::vector<draw_packet>& packets, bool split_by_material)
+{
+	const u32 packet_count = (u32)packets.size();
+	u32 first = 0;
+	while (first < packet_count)
+	{
+		const draw_packet& head = packets[first];
+
+		// the sort key puts draws of the same mesh + material next to each other
+		u32 last = first + 1;
+		while (last < packet_count
+			&& same_geometry(*packets[last].geometry, *head.geometry)
+			&& (!split_by_material || packets[last].mat == head.mat))
+		{
+			last++;
+		}
+
+		bool new_range = m_ranges.empty();
+		if (!new_range)
+		{
+			const draw_packet& range_head = packets[m_ranges.back().first_packet];
+			new_range = range_head.geometry->m_vao.m_vao_id != head.geometry->m_vao.m_vao_id
+				|| (split_by_material && range_head.mat->m_state_hash != head.mat->m_state_hash);
+		}
+		if (new_range)
+		{
+			m_ranges.push_back({ first, (u32)m_commands.size(), 0 });
+		}
+
+		if (last - first >= s_instancing_threshold)
+		{
+			add(*head.geometry, *head.trans, head.material_index);
+			for (u32 i = first + 1; i < last; i++)
+			{
+				add_instance(*packets[i].trans, packets[i].material_index);
+			}
+			m_ranges.back().command_count++;
+		}
+		else
+		{
+			for (u32 i = first; i < last; i++)
+			{
+				add(*packets[i].geometry, *packets[i].trans, packets[i].material_index);
+			}
+			m_ranges.back().command_count += last - first;
+		}
+
+		first = last;
+	}
+}
+
+void indirect_draw_buffer::upload()
+{
+	if (m_command_buffer == 0)
+	{
+		glGenBuffers(1, &m_command_buffer);
+		glGenBuffers(1, &m_instance_buffer);
+	}
+
+	// grow geometrically so a slowly growing scene doesn't reallocate every frame
+	const u32 command_count = (u32)m_commands.size();
+	const u32 instance_count = (u32)m_instances.size();
+	if (command_count > m_command_capacity)
+	{
+		m_command_capacity = command_count + command_count / 2;
+	}
+	if (instance_count > m_instance_capacity)
+	{
+		m_instance_capacity = instance_count + instance_count / 2;
+	}
+
+	// re-specifying the whole store orphans last frame's copy instead of waiting on it
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(draw_elements_indirect_command) * m_command_capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(draw_elements_indirect_command) * command_count, m_commands.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instance_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(instance_data) * m_instance_capacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(instance_data) * instance_count, m_instances.data());
+}
+
+void indirect_draw_buffer::bind()
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_instance_binding, m_instance_buffer);
+}
+
+void indirect_draw_buffer::draw(u32 first, u32 count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	const void* offset = (const void*)(sizeof(draw_elements_indirect_command) * first);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, count, sizeof(draw_elements_indirect_command));
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include "GL/glew.h"
+#include "alias.h"
+#include "render_queue.h"
+
+struct mesh;
+struct transform;
+
+// layout glMultiDrawElementsIndirect expects
+struct draw_elements_indirect_command
+{
+	u32		count;
+	u32		instance_count;
+	u32		first_index;
+	i32		base_vertex;
+	u32		base_instance;
+};
+
+// std430 mirror of instance_data in assets/shaders/common/instance_data.glsl, matrices live in transform_buffer
+struct instance_data
+{
+	u32			transform_index;
+	u32			material_index;
+};
+
+static_assert(sizeof(draw_elements_indirect_command) == 20, "draw_elements_indirect_command must match the gl command layout");
+static_assert(sizeof(instance_data) == 8, "instance_data must match the std430 layout of instance_data");
+
+// per pass list of indirect draw commands + the per instance data they read through
+// gl_BaseInstanceARB + gl_InstanceID. commands that share a vao (and material) are submitted as one
+// range with a single glMultiDrawElementsIndirect
+class indirect_draw_buffer
+{
+public:
+	inline static constexpr u32 s_instance_binding = 0;
+	// runs of the same mesh + material shorter than this stay one command per draw
+	inline static u32			s_instancing_threshold = 2;
+
+	// contiguous commands that can go out in one multi draw, first_packet is the packet whose state they use
+	struct draw_range
+	{
+		u32		first_packet;
+		u32		first_command;
+		u32		command_count;
+	};
+
+	void	clear();
+	// starts a new command with a single instance, returns its index
+	u32		add(const mesh& geometry, const transform& trans, u32 material_index);
+	// appends an instance to the last command
+	void	add_instance(const transform& trans, u32 material_index);
+	// turns sorted packets into commands, folding runs of identical mesh + material into instanced commands.
+	// a new range starts when the vao changes, or the material state when split_by_material is set
+	void	record(const std::vector<draw_packet>& packets, bool split_by_material);
+	// streams this frame's commands and instance data to the gpu, buffers grow as needed
+	void	upload();
+	// binds the command buffer and the instance ssbo, call once per pass after upload
+	void	bind();
+	// draws commands [first, first + count)
+	void	draw(u32 first, u32 count);
+
+	u32		size() const { return (u32)m_commands.size(); }
+	u32		instance_count() const { return (u32)m_instances.size(); }
+	const std::vector<draw_elements_indirect_command>&	get_commands() const { return m_commands; }
+	const std::vector<instance_data>&					get_instances() const { return m_instances; }
+
+	std::vector<draw_range>		m_ranges;
+
+private:
+	std::vector<draw_elements_indirect_command>	m_commands;
+	std::vector<instance_data>					m_instances;
+
+	gl_handle	m_command_buffer = 0;
+	gl_handle	m_instance_buffer = 0;
+	u32			m_command_capacity = 0;
+	u32			m_instance_capacity = 0;
+};
@@ -0,0 +1,244 @@
+#include "job_system.h"
+#include <algorithm>
+
+// 0 for the main thread and any other thread that isn't a worker
+static thread_local u32 t_queue_index = 0;
+
+void job_system::init(u32 worker_count)
+{
+	if (s_running)
+	{
+		return;
+	}
+
+	if (worker_count == 0)
+	{
+		u32 hardware_threads = std::thread::hardware_concurrency();
+		worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+	}
+
+	s_main_thread = std::this_thread::get_id();
+	s_running = true;
+
+	s_queues.clear();
+	for (u32 i = 0; i < worker_count + 1; i++)
+	{
+		s_queues.push_back(std::make_unique<work_queue>());
+	}
+	for (u32 i = 1; i <= worker_count; i++)
+	{
+		s_workers.emplace_back(worker_main, i);
+	}
+}
+
+void job_system::shutdown()
+{
+	if (!s_running)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(s_sleep_mutex);
+		s_running = false;
+	}
+	s_sleep_cv.notify_all();
+	for (std::thread& worker : s_workers)
+	{
+		worker.join();
+	}
+	s_workers.clear();
+	s_queues.clear();
+}
+
+void job_system::run(std::function<void()> fn, job_counter* counter, job_affinity affinity, job_counter* dependency)
+{
+	if (counter)
+	{
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	job new_job{ std::move(fn), counter, affinity };
+	if (dependency)
+	{
+		std::lock_guard<std::mutex> lock(dependency->m_mutex);
+		if (!dependency->is_done())
+		{
+			dependency->m_continuations.push_back(std::move(new_job));
+			return;
+		}
+	}
+	enqueue(std::move(new_job));
+}
+
+void job_system::enqueue(job&& new_job)
+{
+	// without workers (init not called) everything runs inline
+	if (s_queues.empty())
+	{
+		execute(new_job);
+		return;
+	}
+
+	if (new_job.affinity == job_affinity::main_thread)
+	{
+		std::lock_guard<std::mutex> lock(s_main_queue.mutex);
+		s_main_queue.jobs.push_back(std::move(new_job));
+		return;
+	}
+
+	{
+		work_queue& queue = *s_queues[t_queue_index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(std::move(new_job));
+	}
+	s_queued.fetch_add(1, std::memory_order_release);
+	s_sleep_cv.notify_one();
+}
+
+bool job_system::try_pop(u32 queue_index, job& out_job)
+{
+	work_queue& queue = *s_queues[queue_index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+	{
+		return false;
+	}
+	out_job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+	s_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool job_system::try_steal(u32 thief_index, job& out_job)
+{
+	const u32 queue_count = (u32)s_queues.size();
+	for (u32 offset = 1; offset < queue_count; offset++)
+	{
+		work_queue& victim = *s_queues[(thief_index + offset) % queue_count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			// oldest job first, it's usually the biggest piece of the victim's work
+			out_job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			s_queued.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool job_system::try_pop_main(job& out_job)
+{
+	std::lock_guard<std::mutex> lock(s_main_queue.mutex);
+	if (s_main_queue.jobs.empty())
+	{
+		return false;
+	}
+	out_job = std::move(s_main_queue.jobs.front());
+	s_main_queue.jobs.pop_front();
+	return true;
+}
+
+bool job_system::try_run_one(u32 queue_index)
+{
+	job current;
+	if ((is_main_thread() && try_pop_main(current)) || try_pop(queue_index, current) || try_steal(queue_index, current))
+	{
+		execute(current);
+		return true;
+	}
+	return false;
+}
+
+void job_system::execute(job& current)
+{
+	current.fn();
+	finish(current.counter);
+}
+
+void job_system::finish(job_counter* counter)
+{
+	if (!counter)
+	{
+		return;
+	}
+
+	// the last decrement happens under the lock : wait() takes it before returning, so the counter (often on the
+	// waiter's stack) outlives everything done to it here. the counter isn't touched once the lock is released
+	std::vector<job> continuations;
+	{
+		std::lock_guard<std::mutex> lock(counter->m_mutex);
+		if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return;
+		}
+		continuations.swap(counter->m_continuations);
+	}
+	for (job& continuation : continuations)
+	{
+		enqueue(std::move(continuation));
+	}
+}
+
+void job_system::wait(job_counter& counter)
+{
+	while (!counter.is_done())
+	{
+		if (s_queues.empty() || !try_run_one(t_queue_index))
+		{
+			std::this_thread::yield();
+		}
+	}
+	// finish() may still hold the lock after the count reached zero
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void job_system::run_main_thread_jobs()
+{
+	job current;
+	while (try_pop_main(current))
+	{
+		execute(current);
+	}
+}
+
+void job_system::parallel_for(u32 first, u32 last, u32 grain_size, const std::function<void(u32, u32)>& fn)
+{
+	if (first >= last)
+	{
+		return;
+	}
+
+	grain_size = std::max(grain_size, 1u);
+	if (last - first <= grain_size || s_workers.empty())
+	{
+		fn(first, last);
+		return;
+	}
+
+	job_counter counter;
+	for (u32 range_first = first; range_first < last; range_first += grain_size)
+	{
+		u32 range_last = std::min(range_first + grain_size, last);
+		run([&fn, range_first, range_last]() { fn(range_first, range_last); }, &counter);
+	}
+	wait(counter);
+}
+
+void job_system::worker_main(u32 queue_index)
+{
+	t_queue_index = queue_index;
+	while (s_running)
+	{
+		if (try_run_one(queue_index))
+		{
+			continue;
+		}
+
+		// nothing to pop or steal, sleep until a job is queued (or periodically, in case a notify was missed)
+		std::unique_lock<std::mutex> lock(s_sleep_mutex);
+		s_sleep_cv.wait_for(lock, std::chrono::milliseconds(2), []() { return !s_running || s_queued.load(std::memory_order_acquire) > 0; });
+	}
+}
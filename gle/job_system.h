@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "alias.h"
+
+struct job;
+
+// counts the unfinished jobs tied to it. wait on it to join them, or pass it as a dependency to
+// run() so a job only starts once everything counted here has finished
+class job_counter
+{
+public:
+	job_counter() = default;
+	job_counter(const job_counter&) = delete;
+	job_counter& operator=(const job_counter&) = delete;
+
+	bool	is_done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class job_system;
+
+	std::atomic<u32>					m_pending = 0;
+	// jobs waiting on this counter, submitted when it drops to zero
+	std::mutex							m_mutex;
+	std::vector<job>				m_continuations;
+};
+
+enum class job_affinity : u32
+{
+	any			= 0,
+	// gl work, only ever executed by the thread that called job_system::init
+	main_thread	= 1
+};
+
+struct job
+{
+	std::function<void()>	fn;
+	job_counter*			counter;
+	job_affinity			affinity;
+};
+
+// one work stealing deque per thread : owners push and pop at the back, idle threads steal from the front.
+// the thread that calls init is queue 0 and takes part whenever it waits on a counter
+class job_system
+{
+public:
+	// worker_count = 0 uses hardware concurrency - 1
+	static void		init(u32 worker_count = 0);
+	static void		shutdown();
+
+	static void		run(std::function<void()> fn, job_counter* counter = nullptr, job_affinity affinity = job_affinity::any, job_counter* dependency = nullptr);
+	// runs jobs (main thread jobs too, when called from the main thread) until counter reaches zero
+	static void		wait(job_counter& counter);
+	// drains queued main thread jobs, called once per frame from engine_pre_frame
+	static void		run_main_thread_jobs();
+
+	// splits [first, last) into ranges of at most grain_size indices, fn(range_first, range_last) runs on the workers.
+	// blocks until every range is done, the calling thread helps out meanwhile
+	static void		parallel_for(u32 first, u32 last, u32 grain_size, const std::function<void(u32, u32)>& fn);
+
+	static u32		get_worker_count() { return (u32)s_workers.size(); }
+	static bool		is_main_thread() { return std::this_thread::get_id() == s_main_thread; }
+
+private:
+	struct work_queue
+	{
+		std::mutex			mutex;
+		std::deque<job>		jobs;
+	};
+
+	static void		worker_main(u32 queue_index);
+	static void		enqueue(job&& new_job);
+	static bool		try_pop(u32 queue_index, job& out_job);
+	static bool		try_steal(u32 thief_index, job& out_job);
+	static bool		try_pop_main(job& out_job);
+	static bool		try_run_one(u32 queue_index);
+	static void		execute(job& current);
+	static void		finish(job_counter* counter);
+
+	inline static std::vector<std::unique_ptr<work_queue>>	s_queues;
+	inline static work_queue								s_main_queue;
+	inline static std::vector<std::thread>					s_workers;
+	inline static std::thread::id							s_main_thread;
+
+	inline static std::atomic<u32>							s_queued = 0;
+	inline static std::atomic<bool>							s_running = false;
+	inline static std::mutex								s_sleep_mutex;
+	inline static std::condition_variable					s_sleep_cv;
+};
@@ -0,0 +1,238 @@
+#include "light_clusters.h"
+#include "job_system.h"
+#include "transform_kernel.h"
+#include "uniform_buffer.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if GLE_TRANSFORM_KERNEL_X86
+#include <emmintrin.h>
+#endif
+
+void light_clusters::build_bounds(const glm::mat4& proj, float near_plane, float far_plane)
+{
+	m_bounds_proj = proj;
+	const float log_ratio = std::log(far_plane / near_plane);
+	m_slice_scale = (float)s_slices / log_ratio;
+	m_slice_bias = (float)s_slices * std::log(near_plane) / log_ratio;
+	for (u32 s = 0; s <= s_slices; s++)
+	{
+		m_slice_near[s] = near_plane * std::pow(far_plane / near_plane, (float)s / (float)s_slices);
+	}
+
+	for (u32 c = 0; c < 3; c++)
+	{
+		m_min[c].resize(s_cluster_count);
+		m_max[c].resize(s_cluster_count);
+	}
+
+	// every tile corner is a line from the near to the far plane (a ray for perspective, parallel for ortho),
+	// the cluster box holds where the corner lines cross the slice's two depths
+	const glm::mat4 inverse_proj = glm::inverse(proj);
+	auto unproject = [&](glm::vec2 ndc, float z)
+	{
+		glm::vec4 p = inverse_proj * glm::vec4(ndc, z, 1.0f);
+		return glm::vec3(p) / p.w;
+	};
+
+	for (u32 y = 0; y < s_tiles_y; y++)
+	{
+		for (u32 x = 0; x < s_tiles_x; x++)
+		{
+			glm::vec3 line_near[4];
+			glm::vec3 line_far[4];
+			for (u32 corner = 0; corner < 4; corner++)
+			{
+				glm::vec2 ndc = glm::vec2((float)(x + (corner & 1)) / s_tiles_x, (float)(y + (corner >> 1)) / s_tiles_y) * 2.0f - 1.0f;
+				line_near[corner] = unproject(ndc, -1.0f);
+				line_far[corner] = unproject(ndc, 1.0f);
+			}
+
+			for (u32 s = 0; s < s_slices; s++)
+			{
+				glm::vec3 box_min = glm::vec3(std::numeric_limits<float>::max());
+				glm::vec3 box_max = glm::vec3(-std::numeric_limits<float>::max());
+				for (u32 corner = 0; corner < 4; corner++)
+				{
+					for (u32 d = 0; d < 2; d++)
+					{
+						float depth = -m_slice_near[s + d];
+						float t = (depth - line_near[corner].z) / (line_far[corner].z - line_near[corner].z);
+						glm::vec3 p = glm::mix(line_near[corner], line_far[corner], t);
+						box_min = glm::min(box_min, p);
+						box_max = glm::max(box_max, p);
+					}
+				}
+				u32 cluster = (s * s_tiles_y + y) * s_tiles_x + x;
+				for (u32 c = 0; c < 3; c++)
+				{
+					m_min[c][cluster] = box_min[c];
+					m_max[c][cluster] = box_max[c];
+				}
+			}
+		}
+	}
+}
+
+void light_clusters::build(const glm::mat4& view, const glm::mat4& proj, float near_plane, float far_plane, const std::vector<point_light>& lights)
+{
+	if (proj != m_bounds_proj)
+	{
+		build_bounds(proj, near_plane, far_plane);
+	}
+
+	const u32 light_count = (u32)lights.size();
+	const u32 padded_count = (light_count + 3) & ~3u;
+	m_light_x.resize(padded_count);
+	m_light_y.resize(padded_count);
+	m_light_z.resize(padded_count);
+	m_light_radius.resize(padded_count);
+	for (u32 i = 0; i < padded_count; i++)
+	{
+		// padding sits far behind the camera with no radius
+		glm::vec3 p = i < light_count ? glm::vec3(view * glm::vec4(lights[i].position, 1.0f)) : glm::vec3(0.0f, 0.0f, 1e30f);
+		m_light_x[i] = p.x;
+		m_light_y[i] = p.y;
+		m_light_z[i] = p.z;
+		m_light_radius[i] = i < light_count ? lights[i].radius : 0.0f;
+	}
+
+	m_ranges.resize(s_cluster_count);
+	m_slice_indices.resize(s_slices);
+	job_system::parallel_for(0, s_slices, 1, [&](u32 first, u32 last)
+	{
+		for (u32 s = first; s < last; s++)
+		{
+			m_slice_indices[s].clear();
+			assign_slice(s, m_slice_indices[s], &m_ranges[s * s_tiles_x * s_tiles_y]);
+		}
+	});
+
+	// slices were filled independently, offsets become global once they're concatenated
+	m_indices.clear();
+	m_max_cluster_lights = 0;
+	for (u32 s = 0; s < s_slices; s++)
+	{
+		const u32 base = (u32)m_indices.size();
+		for (u32 c = s * s_tiles_x * s_tiles_y; c < (s + 1) * s_tiles_x * s_tiles_y; c++)
+		{
+			m_ranges[c].offset += base;
+			m_max_cluster_lights = std::max(m_max_cluster_lights, m_ranges[c].count);
+		}
+		m_indices.insert(m_indices.end(), m_slice_indices[s].begin(), m_slice_indices[s].end());
+	}
+}
+
+void light_clusters::assign_slice(u32 slice, std::vector<u32>& out, cluster_range* ranges) const
+{
+	// lights overlapping the slice's depth range, gathered so every cluster test runs on a dense 4 wide array
+	thread_local std::vector<float> x, y, z, radius;
+	thread_local std::vector<u32> ids;
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+	ids.clear();
+
+	const float slice_min = -m_slice_near[slice + 1];
+	const float slice_max = -m_slice_near[slice];
+	for (u32 i = 0; i < (u32)m_light_x.size(); i++)
+	{
+		if (m_light_z[i] - m_light_radius[i] <= slice_max && m_light_z[i] + m_light_radius[i] >= slice_min && m_light_radius[i] > 0.0f)
+		{
+			x.push_back(m_light_x[i]);
+			y.push_back(m_light_y[i]);
+			z.push_back(m_light_z[i]);
+			radius.push_back(m_light_radius[i]);
+			ids.push_back(i);
+		}
+	}
+	while (x.size() & 3)
+	{
+		x.push_back(0.0f);
+		y.push_back(0.0f);
+		z.push_back(1e30f);
+		radius.push_back(0.0f);
+		ids.push_back(0);
+	}
+
+	const u32 first_cluster = slice * s_tiles_x * s_tiles_y;
+	for (u32 tile = 0; tile < s_tiles_x * s_tiles_y; tile++)
+	{
+		const u32 cluster = first_cluster + tile;
+		ranges[tile] = { (u32)out.size(), 0 };
+
+#if GLE_TRANSFORM_KERNEL_X86
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 min_x = _mm_set1_ps(m_min[0][cluster]), max_x = _mm_set1_ps(m_max[0][cluster]);
+		const __m128 min_y = _mm_set1_ps(m_min[1][cluster]), max_y = _mm_set1_ps(m_max[1][cluster]);
+		const __m128 min_z = _mm_set1_ps(m_min[2][cluster]), max_z = _mm_set1_ps(m_max[2][cluster]);
+		for (u32 i = 0; i < (u32)x.size(); i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&x[i]);
+			__m128 cy = _mm_loadu_ps(&y[i]);
+			__m128 cz = _mm_loadu_ps(&z[i]);
+			__m128 r = _mm_loadu_ps(&radius[i]);
+			// distance from the sphere center to the box, per axis
+			__m128 dx = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_x, cx), _mm_sub_ps(cx, max_x)));
+			__m128 dy = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_y, cy), _mm_sub_ps(cy, max_y)));
+			__m128 dz = _mm_max_ps(zero, _mm_max_ps(_mm_sub_ps(min_z, cz), _mm_sub_ps(cz, max_z)));
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)), _mm_cmpgt_ps(r, zero)));
+			for (u32 lane = 0; mask != 0; lane++, mask >>= 1)
+			{
+				if (mask & 1)
+				{
+					out.push_back(ids[i + lane]);
+				}
+			}
+		}
+#else
+		for (u32 i = 0; i < (u32)x.size(); i++)
+		{
+			float dx = std::max(0.0f, std::max(m_min[0][cluster] - x[i], x[i] - m_max[0][cluster]));
+			float dy = std::max(0.0f, std::max(m_min[1][cluster] - y[i], y[i] - m_max[1][cluster]));
+			float dz = std::max(0.0f, std::max(m_min[2][cluster] - z[i], z[i] - m_max[2][cluster]));
+			if (radius[i] > 0.0f && dx * dx + dy * dy + dz * dz <= radius[i] * radius[i])
+			{
+				out.push_back(ids[i]);
+			}
+		}
+#endif
+		ranges[tile].count = (u32)out.size() - ranges[tile].offset;
+	}
+}
+
+void light_clusters::upload(const std::vector<point_light>& lights)
+{
+	if (m_light_buffer == 0)
+	{
+		glGenBuffers(1, &m_light_buffer);
+		glGenBuffers(1, &m_cluster_buffer);
+		glGenBuffers(1, &m_index_buffer);
+	}
+
+	std::vector<point_light_block> blocks(std::max<size_t>(lights.size(), 1));
+	for (u32 i = 0; i < (u32)lights.size(); i++)
+	{
+		blocks[i].position = lights[i].position;
+		blocks[i].radius = lights[i].radius;
+		blocks[i].colour = lights[i].colour;
+		blocks[i].intensity = lights[i].intensity;
+		blocks[i].shadow_index = lights[i].shadow_index;
+	}
+
+	// re-specifying the stores orphans last frame's copies, empty lists still get one element so the binding is valid
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_light_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(point_light_block) * blocks.size(), blocks.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cluster_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(cluster_range) * m_ranges.size(), m_ranges.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_index_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(u32) * std::max<size_t>(m_indices.size(), 1), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(u32) * m_indices.size(), m_indices.data());
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_light_binding, m_light_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_cluster_binding, m_cluster_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_index_binding, m_index_buffer);
+}
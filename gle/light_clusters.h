@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "alias.h"
+#include "lights.h"
+
+// clustered light culling : the view frustum is split into s_tiles_x * s_tiles_y screen tiles and s_slices
+// exponential depth slices. every point light is tested (sphere vs cluster box, 4 lights per sse test) against
+// the clusters it could touch, one job per depth slice, and the lighting shader only walks its pixel's list.
+// cluster boxes are view space, so they're only rebuilt when the projection changes
+class light_clusters
+{
+public:
+	static constexpr u32 s_tiles_x = 16;
+	static constexpr u32 s_tiles_y = 9;
+	static constexpr u32 s_slices = 24;
+	static constexpr u32 s_cluster_count = s_tiles_x * s_tiles_y * s_slices;
+
+	// std430 storage bindings, see assets/shaders/common/light_data.glsl
+	inline static constexpr u32 s_light_binding = 6;
+	inline static constexpr u32 s_cluster_binding = 7;
+	inline static constexpr u32 s_index_binding = 8;
+
+	// std430 mirror of uvec2 u_light_clusters[] : the cluster's lights are indices[offset, offset + count)
+	struct cluster_range
+	{
+		u32	offset;
+		u32	count;
+	};
+
+	// near / far must be the ones proj was built with
+	void	build(const glm::mat4& view, const glm::mat4& proj, float near_plane, float far_plane, const std::vector<point_light>& lights);
+	// streams lights, ranges and indices to their storage buffers and binds them
+	void	upload(const std::vector<point_light>& lights);
+
+	// slice = floor(log(view depth) * scale - bias)
+	float	get_slice_scale() const { return m_slice_scale; }
+	float	get_slice_bias() const { return m_slice_bias; }
+	u32		get_index_count() const { return (u32)m_indices.size(); }
+	u32		get_max_cluster_lights() const { return m_max_cluster_lights; }
+
+	std::vector<cluster_range>	m_ranges;
+	std::vector<u32>			m_indices;
+
+private:
+	void	build_bounds(const glm::mat4& proj, float near_plane, float far_plane);
+	void	assign_slice(u32 slice, std::vector<u32>& out, cluster_range* ranges) const;
+
+	// cache key for the cluster boxes
+	glm::mat4	m_bounds_proj = glm::mat4(0.0f);
+	float		m_slice_scale = 0.0f;
+	float		m_slice_bias = 0.0f;
+	u32			m_max_cluster_lights = 0;
+
+	// view space cluster boxes and slice depth ranges (positive distances)
+	std::vector<float>	m_min[3];
+	std::vector<float>	m_max[3];
+	float				m_slice_near[s_slices + 1];
+
+	// view space light spheres, padded to a multiple of 4 with lights that never overlap
+	std::vector<float>	m_light_x, m_light_y, m_light_z, m_light_radius;
+	std::vector<std::vector<u32>>	m_slice_indices;
+
+	gl_handle	m_light_buffer = 0;
+	gl_handle	m_cluster_buffer = 0;
+	gl_handle	m_index_buffer = 0;
+};
@@ -4,10 +4,17 @@
 
 struct dir_light
 {
+    static constexpr u32 s_max_cascades = 4;
+
     glm::vec3   direction;
     glm::vec3   colour;
     glm::mat4   light_space_matrix;
     float       intensity = 1.0f;
+
+    // written by tech::shadow, cascade i covers view depths up to cascade_splits[i]
+    glm::mat4   cascade_matrices[s_max_cascades] = {};
+    glm::vec4   cascade_splits = glm::vec4(0.0f);
+    u32         cascade_count = 0;
 };
 
 struct point_light
@@ -16,4 +23,8 @@ struct point_light
     glm::vec3   colour;
     float       radius;
     float       intensity = 1.0f;
+    bool        cast_shadows = false;
+
+    // written by tech::point_shadow, index into its shadow blocks or -1 when unshadowed this frame
+    i32         shadow_index = -1;
 };
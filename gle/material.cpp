@@ -1,103 +1,287 @@
 #include "material.h"
 #include "scene.h"
+#include "utils.h"
 
-material::material(shader& program) : m_prog(program)
+const material_layout& material_layout::get(const shader& program)
 {
-    int uniform_count;
-    GLint size; // size of the variable
-    GLenum type; // type of the variable (float, vec3 or mat4, etc)
+    auto it = s_layouts.find(program.m_shader_id);
+    if (it != s_layouts.end())
+    {
+        return it->second;
+    }
 
-    const GLsizei bufSize = 16; // maximum name length
-    GLchar name[bufSize]; // variable name in GLSL
-    GLsizei length; // name length
-    glGetProgramiv(m_prog.m_shader_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    material_layout layout{};
+    gl_handle prog_id = program.m_shader_id;
 
+    int uniform_count = 0;
+    int max_name_length = 0;
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(prog_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+
+    std::vector<GLchar> name(max_name_length > 0 ? max_name_length : 1);
     for (int i = 0; i < uniform_count; i++)
     {
-        glGetActiveUniform(m_prog.m_shader_id, (GLuint)i, bufSize, &length, &size, &type, name);
-        std::string uname = std::string(name);
+        GLint size; // size of the variable
+        GLenum type; // type of the variable (float, vec3 or mat4, etc)
+        GLsizei length; // name length
+        glGetActiveUniform(prog_id, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+        std::string uname(name.data(), length);
+        GLint location = glGetUniformLocation(prog_id, uname.c_str());
+        // members of uniform blocks have no location, they are fed by the ring buffer
+        if (location < 0)
+        {
+            continue;
+        }
+
         shader::uniform_type utype = shader::get_type_from_gl(type);
-        m_uniforms.emplace(uname, utype);
+        switch (utype)
+        {
+            case shader::uniform_type::sampler2D:
+            case shader::uniform_type::sampler3D:
+                layout.m_samplers.push_back({ uname, utype, location });
+                break;
+            case shader::uniform_type::UNKNOWN:
+            case shader::uniform_type::image2D:
+            case shader::uniform_type::image3D:
+                break;
+            default:
+            {
+                u32 param_size = get_type_size(utype);
+                layout.m_parameters.push_back({ uname, utype, location, layout.m_block_size, param_size });
+                layout.m_block_size += param_size;
+                break;
+            }
+        }
+    }
+
+    return s_layouts.emplace(prog_id, std::move(layout)).first->second;
+}
+
+u32 material_layout::get_type_size(shader::uniform_type type)
+{
+    switch (type)
+    {
+        case shader::uniform_type::_int:
+            return sizeof(int);
+        case shader::uniform_type::_float:
+            return sizeof(float);
+        case shader::uniform_type::vec2:
+            return sizeof(glm::vec2);
+        case shader::uniform_type::vec3:
+            return sizeof(glm::vec3);
+        case shader::uniform_type::vec4:
+            return sizeof(glm::vec4);
+        case shader::uniform_type::mat3:
+            return sizeof(glm::mat3);
+        case shader::uniform_type::mat4:
+            return sizeof(glm::mat4);
+        default:
+            return 0;
+    }
+}
+
+int material_layout::find_parameter(const std::string& name) const
+{
+    for (int i = 0; i < (int)m_parameters.size(); i++)
+    {
+        if (m_parameters[i].name == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int material_layout::find_sampler(const std::string& name) const
+{
+    for (int i = 0; i < (int)m_samplers.size(); i++)
+    {
+        if (m_samplers[i].name == name)
+        {
+            return i;
+        }
     }
+    return -1;
+}
+
+material::material(shader& program) : m_prog(program), m_layout(&material_layout::get(program))
+{
+    m_values.resize(m_layout->m_block_size);
+    m_parameter_set.resize(m_layout->m_parameters.size(), 0);
+    m_textures.resize(m_layout->m_samplers.size(), sampler_info{ GL_TEXTURE0, GL_TEXTURE_2D, 0 });
+    update_state_hash();
 }
 
 bool material::set_sampler(const std::string& sampler_name, GLenum texture_slot, texture& tex, GLenum texture_target)
 {
+    int index = m_layout->find_sampler(sampler_name);
 #ifdef ENABLE_MATERIAL_UNIFORM_CHECKS
-    if (m_uniforms.find(sampler_name) == m_uniforms.end())
+    if (index < 0)
     {
         return false;
     }
 #endif
 
-    m_uniform_values[sampler_name] = sampler_info{ texture_slot, texture_target, tex.m_handle };
+    m_textures[index] = sampler_info{ texture_slot, texture_target, tex.m_handle };
+    update_state_hash();
 
     return true;
 }
 
+void material::update_state_hash()
+{
+    u64 hash = utils::hash_fnv1a(&m_prog.m_shader_id, sizeof(m_prog.m_shader_id));
+    hash = utils::hash_fnv1a(m_values.data(), m_values.size(), hash);
+    hash = utils::hash_fnv1a(m_parameter_set.data(), m_parameter_set.size(), hash);
+    m_state_hash = utils::hash_fnv1a(m_textures.data(), m_textures.size() * sizeof(sampler_info), hash);
+}
+
 void material::bind_material_uniforms()
 {
     m_prog.use();
-    for (auto& [name, val] : m_uniform_values)
+
+    const u8* values = m_values.data();
+    for (size_t i = 0; i < m_layout->m_parameters.size(); i++)
     {
-#ifdef ENABLE_MATERIAL_UNIFORM_CHECKS
-        if (m_uniforms.find(name) == m_uniforms.end())
+        if (!m_parameter_set[i])
         {
             continue;
         }
-#endif
-        switch (m_uniforms[name])
+
+        const material_layout::parameter& param = m_layout->m_parameters[i];
+        const void* value = values + param.offset;
+        switch (param.type)
         {
-            // TODO: Image attachments for compute shaders....
-            case shader::uniform_type::sampler2D:
-            case shader::uniform_type::sampler3D:
-            {
-                sampler_info info = std::any_cast<sampler_info>(m_uniform_values[name]);
-                int loc = info.sampler_slot - GL_TEXTURE0;
-                m_prog.set_int(name, loc);
-                texture::bind_sampler_handle(info.texture_handle, info.sampler_slot);
-                break;
-            }
             case shader::uniform_type::_int:
-            {
-                int iv = std::any_cast<int>(m_uniform_values[name]);
-                m_prog.set_int(name, iv);
+                glUniform1iv(param.location, 1, static_cast<const GLint*>(value));
                 break;
-            }
-            case shader::uniform_type::_float: {
-                float fv = std::any_cast<float>(m_uniform_values[name]);
-                m_prog.set_float(name, fv);
+            case shader::uniform_type::_float:
+                glUniform1fv(param.location, 1, static_cast<const GLfloat*>(value));
                 break;
-            }
-            case shader::uniform_type::vec2: {
-                glm::vec2 v2 = std::any_cast<glm::vec2>(m_uniform_values[name]);
-                m_prog.set_vec2(name, v2);
+            case shader::uniform_type::vec2:
+                glUniform2fv(param.location, 1, static_cast<const GLfloat*>(value));
                 break;
-            }
             case shader::uniform_type::vec3:
-            {
-                glm::vec3 v3 = std::any_cast<glm::vec3>(m_uniform_values[name]);
-                m_prog.set_vec3(name, v3);
+                glUniform3fv(param.location, 1, static_cast<const GLfloat*>(value));
                 break;
-            }
             case shader::uniform_type::vec4:
-            {
-                glm::vec4 v4 = std::any_cast<glm::vec4>(m_uniform_values[name]);
-                m_prog.set_vec4(name, v4);
+                glUniform4fv(param.location, 1, static_cast<const GLfloat*>(value));
                 break;
-            }
             case shader::uniform_type::mat3:
-            {
-                glm::mat3 m3 = std::any_cast<glm::mat3>(m_uniform_values[name]);
-                m_prog.set_mat3(name, m3);
+                glUniformMatrix3fv(param.location, 1, GL_FALSE, static_cast<const GLfloat*>(value));
                 break;
-            }
             case shader::uniform_type::mat4:
-            {
-                glm::mat4 m4 = std::any_cast<glm::mat4>(m_uniform_values[name]);
-                m_prog.set_mat4(name, m4);
+                glUniformMatrix4fv(param.location, 1, GL_FALSE, static_cast<const GLfloat*>(value));
                 break;
-            }
+            default:
+                break;
+        }
+    }
+
+    // TODO: Image attachments for compute shaders....
+    for (size_t i = 0; i < m_textures.size(); i++)
+    {
+        const sampler_info& info = m_textures[i];
+        if (info.texture_handle == 0)
+        {
+            continue;
+        }
+        glUniform1i(m_layout->m_samplers[i].location, info.sampler_slot - GL_TEXTURE0);
+        texture::bind_sampler_handle(info.texture_handle, info.sampler_slot, info.texture_target);
+    }
+}
+
+u32 material_registry::allocate(std::unique_ptr<material> mat)
+{
+    if (!s_free_slots.empty())
+    {
+        u32 index = s_free_slots.back();
+        s_free_slots.pop_back();
+        s_materials[index] = std::move(mat);
+        s_ref_counts[index] = 1;
+        return index;
+    }
+
+    s_materials.push_back(std::move(mat));
+    s_ref_counts.push_back(1);
+    return (u32)s_materials.size() - 1;
+}
+
+material_handle material_registry::create(shader& program)
+{
+    return { allocate(std::make_unique<material>(program)) };
+}
+
+material_handle material_registry::get_or_create(u64 key, shader& program, bool& created)
+{
+    auto it = s_shared.find(key);
+    if (it != s_shared.end() && s_materials[it->second])
+    {
+        created = false;
+        return share({ it->second });
+    }
+
+    created = true;
+    u32 index = allocate(std::make_unique<material>(program));
+    s_shared[key] = index;
+    return { index };
+}
+
+material_handle material_registry::share(material_handle handle)
+{
+    s_ref_counts[handle.m_index]++;
+    return handle;
+}
+
+void material_registry::release(material_handle& handle)
+{
+    if (!handle.valid())
+    {
+        return;
+    }
+
+    u32 index = handle.m_index;
+    handle.m_index = material_handle::s_invalid;
+    if (--s_ref_counts[index] > 0)
+    {
+        return;
+    }
+
+    for (auto it = s_shared.begin(); it != s_shared.end(); ++it)
+    {
+        if (it->second == index)
+        {
+            s_shared.erase(it);
+            break;
         }
     }
+    s_materials[index].reset();
+    s_free_slots.push_back(index);
+}
+
+material& material_registry::get(material_handle handle)
+{
+    return *s_materials[handle.m_index];
+}
+
+material& material_registry::edit(material_handle& handle)
+{
+    if (s_ref_counts[handle.m_index] > 1)
+    {
+        // the copy is private, it never becomes the shared material for the original key
+        s_ref_counts[handle.m_index]--;
+        handle.m_index = allocate(std::make_unique<material>(*s_materials[handle.m_index]));
+    }
+    return *s_materials[handle.m_index];
+}
+
+u32 material_registry::get_ref_count(material_handle handle)
+{
+    return s_ref_counts[handle.m_index];
+}
+
+u32 material_registry::get_material_count()
+{
+    return (u32)(s_materials.size() - s_free_slots.size());
 }
@@ -1,7 +1,9 @@
 #pragma once
 #include <string>
-#include <any>
-#include <map>
+#include <vector>
+#include <cstring>
+#include <unordered_map>
+#include <memory>
 #include "shader.h"
 #include "texture.h"
 
@@ -9,24 +11,60 @@
 
 class scene;
 
+// reflected once per program : where each non-sampler uniform lives in a material's value block,
+// its pre-resolved location, and the sampler uniforms a material can bind textures to
+class material_layout
+{
+public:
+	struct parameter
+	{
+		std::string				name;
+		shader::uniform_type	type;
+		GLint					location;
+		u32						offset;
+		u32						size;
+	};
+
+	struct sampler
+	{
+		std::string				name;
+		shader::uniform_type	type;
+		GLint					location;
+	};
+
+	std::vector<parameter>	m_parameters;
+	std::vector<sampler>	m_samplers;
+	u32						m_block_size = 0;
+
+	int		find_parameter(const std::string& name) const;
+	int		find_sampler(const std::string& name) const;
+
+	static const material_layout&	get(const shader& program);
+	static u32						get_type_size(shader::uniform_type type);
+
+private:
+	inline static std::unordered_map<gl_handle, material_layout> s_layouts;
+};
+
 class material
 {
 public:
 	material(shader& shader_program);
 
-	std::map<std::string, shader::uniform_type>	m_uniforms;
-	std::map<std::string, std::any>				m_uniform_values;
-
 	template<typename _Ty>
 	bool	set_uniform_value(const std::string& name, const _Ty& val)
 	{
+		int index = m_layout->find_parameter(name);
 #ifdef ENABLE_MATERIAL_UNIFORM_CHECKS
-		if (m_uniforms.find(name) == m_uniforms.end())
+		if (index < 0 || m_layout->m_parameters[index].size != sizeof(_Ty))
 		{
 			return false;
 		}
 #endif
-		m_uniform_values[name] = val;
+		const material_layout::parameter& param = m_layout->m_parameters[index];
+		std::memcpy(m_values.data() + param.offset, &val, sizeof(_Ty));
+		m_parameter_set[index] = 1;
+		update_state_hash();
 		return true;
 	}
 
@@ -34,6 +72,58 @@ public:
 
 	void	bind_material_uniforms();
 
-	shader& m_prog;
+	shader&					m_prog;
+	const material_layout*	m_layout;
+
+	// packed values laid out by m_layout, only parameters that were set get uploaded
+	std::vector<u8>			m_values;
+	std::vector<u8>			m_parameter_set;
+	// one entry per layout sampler, texture_handle 0 means unset
+	std::vector<sampler_info>	m_textures;
+	// program + values + textures, materials with equal hashes bind identical state
+	u64						m_state_hash = 0;
+
+private:
+	void	update_state_hash();
+};
+
+// component entities hold instead of a material, several entities can point at the same shared material
+struct material_handle
+{
+	static constexpr u32 s_invalid = 0xFFFFFFFF;
+
+	u32		m_index = s_invalid;
+
+	bool	valid() const { return m_index != s_invalid; }
+};
+
+// owns every material, entities reference them through material_handle.
+// materials built from the same (program, model material) pair are created once and shared,
+// edit() gives a handle its own copy the first time a shared material is modified through it
+class material_registry
+{
+public:
+	// new material only this handle references
+	static material_handle	create(shader& program);
+	// shared material for key, created on first use
+	static material_handle	get_or_create(u64 key, shader& program, bool& created);
+	// adds a reference to an existing material
+	static material_handle	share(material_handle handle);
+	// drops handle's reference, scene calls it when a material_handle component is destroyed
+	static void				release(material_handle& handle);
+
+	static material&		get(material_handle handle);
+	// copy on write : if other handles share the material, handle is repointed at a private copy first
+	static material&		edit(material_handle& handle);
+
+	static u32				get_ref_count(material_handle handle);
+	static u32				get_material_count();
+
+private:
+	static u32				allocate(std::unique_ptr<material> mat);
 
-};
\ No newline at end of file
+	inline static std::vector<std::unique_ptr<material>>	s_materials;
+	inline static std::vector<u32>							s_ref_counts;
+	inline static std::vector<u32>							s_free_slots;
+	inline static std::unordered_map<u64, u32>				s_shared;
+};
@@ -1,7 +1,20 @@
 #pragma once
 
+#include <memory>
 #include "vertex.h"
 #include "shape.h"
+#include "triangle_bvh.h"
+
+// cpu copy of a mesh's geometry in its local space, only kept when the model was loaded with
+// model_load_options::keep_cpu_geometry
+struct mesh_geometry
+{
+	std::vector<glm::vec3>	m_positions;
+	// triangle list, relative to m_positions
+	std::vector<uint32_t>	m_indices;
+	// empty unless model_load_options::build_triangle_bvh
+	triangle_bvh			m_bvh;
+};
 
 
 struct mesh
@@ -11,10 +24,15 @@ struct mesh
 	aabb			m_original_aabb;
 	aabb			m_transformed_aabb;
 	uint32_t		m_material_index;
+	// range inside m_vao's buffers, meshes loaded from the same model share one vao
+	uint32_t		m_first_index = 0;
+	int32_t			m_base_vertex = 0;
+	// shared by every copy of the mesh (entities copy it out of the model), null if not kept
+	std::shared_ptr<mesh_geometry>	m_geometry;
 
 	void draw()
 	{
 		m_vao.use();
-		glDrawElements(GL_TRIANGLES, m_index_count, GL_UNSIGNED_INT, 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, m_index_count, GL_UNSIGNED_INT, (void*)(sizeof(uint32_t) * m_first_index), m_base_vertex);
 	}
 };
@@ -5,7 +5,10 @@
 #include "assimp/cimport.h"
 #include "assimp/mesh.h"
 #include "assimp/scene.h"
+#include "job_system.h"
+#include "utils.h"
 #include <iostream>
+#include <fstream>
 
 static glm::vec3 AssimpToGLM(aiVector3D aiVec) {
     return glm::vec3(aiVec.x, aiVec.y, aiVec.z);
@@ -17,74 +20,80 @@ static glm::vec2 AssimpToGLM(aiVector2D aiVec) {
 
 
 
-void ProcessMesh(model& model, aiMesh* m, aiNode* node, const aiScene* scene) {
+// every mesh of a model is appended to one vertex / index buffer pair so they can share a vao,
+// meshes keep their range as first_index + base_vertex
+struct geometry_heap
+{
+    std::vector<float>      verts;
+    std::vector<uint32_t>   indices;
+    uint32_t                vertex_count = 0;
+};
+
+void ProcessMesh(model& model, geometry_heap& heap, aiMesh* m, aiNode* node, const model_load_options& options) {
     bool hasPositions = m->HasPositions();
     bool hasUVs = m->HasTextureCoords(0);
     bool hasNormals = m->HasNormals();
     bool hasIndices = m->HasFaces();
 
-    std::vector<aiMaterialProperty*> properties;
-    aiMaterial* mMaterial = scene->mMaterials[m->mMaterialIndex];
-
-    for (int i = 0; i < mMaterial->mNumProperties; i++)
-    {
-        aiMaterialProperty* prop = mMaterial->mProperties[i];
-        properties.push_back(prop);
-    }
-    std::vector<float> verts;
-    vao_builder mesh_builder{};
-    mesh_builder.begin();
-
-    if (hasPositions && hasUVs && hasNormals) {
-        for (unsigned int i = 0; i < m->mNumVertices; i++) {
-            verts.push_back(m->mVertices[i].x);
-            verts.push_back(m->mVertices[i].y);
-            verts.push_back(m->mVertices[i].z);
-            verts.push_back(m->mNormals[i].x);
-            verts.push_back(m->mNormals[i].y);
-            verts.push_back(m->mNormals[i].z);
-            verts.push_back(m->mTextureCoords[0][i].x);
-            verts.push_back(m->mTextureCoords[0][i].y);            
-        }
-        mesh_builder.add_vertex_buffer(verts);
-        mesh_builder.add_vertex_attribute(0, 8 * sizeof(float), 3);
-        mesh_builder.add_vertex_attribute(1, 8 * sizeof(float), 3);
-        mesh_builder.add_vertex_attribute(2, 8 * sizeof(float), 2);
+    if (!hasPositions || !hasIndices) {
+        std::cerr << "Attempting to import a mesh without positions or faces, skipping it." << std::endl;
+        return;
     }
 
     std::vector<uint32_t> indices;
-    if (hasIndices) {
-        for (unsigned int i = 0; i < m->mNumFaces; i++) {
-            aiFace currentFace = m->mFaces[i];
-            if (currentFace.mNumIndices != 3) {
-                std::cerr << "Attempting to import a m with non triangular face structure! cannot load this m." << std::endl;
-                return;
-            }
-            for (unsigned int index = 0; index < m->mFaces[i].mNumIndices; index++) {
-                indices.push_back(static_cast<uint32_t>(m->mFaces[i].mIndices[index]));
-            }
+    for (unsigned int i = 0; i < m->mNumFaces; i++) {
+        aiFace currentFace = m->mFaces[i];
+        if (currentFace.mNumIndices != 3) {
+            std::cerr << "Attempting to import a m with non triangular face structure! cannot load this m." << std::endl;
+            return;
+        }
+        for (unsigned int index = 0; index < m->mFaces[i].mNumIndices; index++) {
+            indices.push_back(static_cast<uint32_t>(m->mFaces[i].mIndices[index]));
         }
-        mesh_builder.add_index_buffer(indices);
     }
-    aabb bb= { {m->mAABB.mMin.x, m->mAABB.mMin.y, m->mAABB.mMin.z},
-                {m->mAABB.mMax.x, m->mAABB.mMax.y, m->mAABB.mMax.z} };
 
     mesh new_mesh{};
-    new_mesh.m_vao = mesh_builder.build();
+    new_mesh.m_first_index = heap.indices.size();
+    new_mesh.m_base_vertex = heap.vertex_count;
     new_mesh.m_index_count = indices.size();
-    new_mesh.m_original_aabb = bb;
+    new_mesh.m_original_aabb = { {m->mAABB.mMin.x, m->mAABB.mMin.y, m->mAABB.mMin.z},
+                                 {m->mAABB.mMax.x, m->mAABB.mMax.y, m->mAABB.mMax.z} };
     new_mesh.m_material_index = m->mMaterialIndex;
 
+    // missing normals / uvs are zero filled, the heap layout is the same for every mesh
+    for (unsigned int i = 0; i < m->mNumVertices; i++) {
+        heap.verts.push_back(m->mVertices[i].x);
+        heap.verts.push_back(m->mVertices[i].y);
+        heap.verts.push_back(m->mVertices[i].z);
+        heap.verts.push_back(hasNormals ? m->mNormals[i].x : 0.0f);
+        heap.verts.push_back(hasNormals ? m->mNormals[i].y : 0.0f);
+        heap.verts.push_back(hasNormals ? m->mNormals[i].z : 0.0f);
+        heap.verts.push_back(hasUVs ? m->mTextureCoords[0][i].x : 0.0f);
+        heap.verts.push_back(hasUVs ? m->mTextureCoords[0][i].y : 0.0f);
+    }
+    heap.vertex_count += m->mNumVertices;
+    heap.indices.insert(heap.indices.end(), indices.begin(), indices.end());
+
+    if (options.keep_cpu_geometry || options.build_triangle_bvh) {
+        auto geometry = std::make_shared<mesh_geometry>();
+        geometry->m_positions.reserve(m->mNumVertices);
+        for (unsigned int i = 0; i < m->mNumVertices; i++) {
+            geometry->m_positions.push_back(AssimpToGLM(m->mVertices[i]));
+        }
+        geometry->m_indices = std::move(indices);
+        new_mesh.m_geometry = geometry;
+    }
+
     model.m_meshes.push_back(new_mesh);
 }
 
-void ProcessNode(model& model, aiNode* node, const aiScene* scene) {
+void ProcessNode(model& model, geometry_heap& heap, aiNode* node, const aiScene* scene, const model_load_options& options) {
 
     if (node->mNumMeshes > 0) {
         for (unsigned int i = 0; i < node->mNumMeshes; i++) {
             unsigned int sceneIndex = node->mMeshes[i];
             aiMesh* mesh = scene->mMeshes[sceneIndex];
-            ProcessMesh(model, mesh, node, scene);
+            ProcessMesh(model, heap, mesh, node, options);
         }
     }
 
@@ -93,10 +102,87 @@ void ProcessNode(model& model, aiNode* node, const aiScene* scene) {
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        ProcessNode(model, node->mChildren[i], scene);
+        ProcessNode(model, heap, node->mChildren[i], scene, options);
     }
 }
 
+// cooked bvh file : magic, version, mesh count, then per mesh its triangle count and a hash of its positions
+// and indices followed by the bvh. any mismatch with the loaded meshes (the source changed) means rebuilding
+// and rewriting it
+static constexpr uint32_t s_cooked_bvh_magic = 0x4856424D; // "MBVH"
+static constexpr uint32_t s_cooked_bvh_version = 2;
+
+static uint64_t hash_geometry(const mesh_geometry& geometry)
+{
+    uint64_t hash = utils::hash_fnv1a(geometry.m_positions.data(), geometry.m_positions.size() * sizeof(glm::vec3));
+    return utils::hash_fnv1a(geometry.m_indices.data(), geometry.m_indices.size() * sizeof(uint32_t), hash);
+}
+
+static bool load_cooked_bvhs(const std::string& path, std::vector<mesh_geometry*>& geometries)
+{
+    std::ifstream in(path, std::ios::binary);
+    uint32_t header[3] = {};
+    if (!in || !in.read((char*)header, sizeof(header)) || header[0] != s_cooked_bvh_magic || header[1] != s_cooked_bvh_version || header[2] != geometries.size()) {
+        return false;
+    }
+
+    for (mesh_geometry* geometry : geometries) {
+        uint32_t triangle_count = 0;
+        uint64_t source_hash = 0;
+        if (!in.read((char*)&triangle_count, sizeof(triangle_count)) || triangle_count != geometry->m_indices.size() / 3) {
+            return false;
+        }
+        if (!in.read((char*)&source_hash, sizeof(source_hash)) || source_hash != hash_geometry(*geometry)) {
+            return false;
+        }
+        if (!geometry->m_bvh.load(in) || geometry->m_bvh.get_triangle_count() != triangle_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void save_cooked_bvhs(const std::string& path, const std::vector<mesh_geometry*>& geometries)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Unable to write cooked bvh file " << path << std::endl;
+        return;
+    }
+
+    uint32_t header[3] = { s_cooked_bvh_magic, s_cooked_bvh_version, (uint32_t)geometries.size() };
+    out.write((const char*)header, sizeof(header));
+    for (const mesh_geometry* geometry : geometries) {
+        uint32_t triangle_count = (uint32_t)(geometry->m_indices.size() / 3);
+        uint64_t source_hash = hash_geometry(*geometry);
+        out.write((const char*)&triangle_count, sizeof(triangle_count));
+        out.write((const char*)&source_hash, sizeof(source_hash));
+        geometry->m_bvh.save(out);
+    }
+}
+
+static void build_triangle_bvhs(model& m, const std::string& path)
+{
+    std::vector<mesh_geometry*> geometries;
+    for (auto& mesh : m.m_meshes) {
+        geometries.push_back(mesh.m_geometry.get());
+    }
+
+    std::string cooked_path = path + ".bvh";
+    if (load_cooked_bvhs(cooked_path, geometries)) {
+        return;
+    }
+
+    // one job per mesh, big meshes split their own build further
+    job_system::parallel_for(0, (uint32_t)geometries.size(), 1, [&](uint32_t first, uint32_t last) {
+        for (uint32_t i = first; i < last; i++) {
+            mesh_geometry& geometry = *geometries[i];
+            geometry.m_bvh.build(geometry.m_positions.data(), geometry.m_indices.data(), (uint32_t)(geometry.m_indices.size() / 3));
+        }
+    });
+    save_cooked_bvhs(cooked_path, geometries);
+}
+
 void get_material_texture(const std::string& directory, aiMaterial* material, model::material_entry& mat, aiTextureType ass_texture_type, texture_map_type gl_texture_type)
 {
     uint32_t tex_count = aiGetMaterialTextureCount(material, ass_texture_type);
@@ -113,7 +199,7 @@ void get_material_texture(const std::string& directory, aiMaterial* material, mo
 
 }
 
-model model::load_model_from_path(const std::string& path)
+model model::load_model_from_path(const std::string& path, const model_load_options& options)
 {
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path.c_str(),
@@ -132,8 +218,29 @@ model model::load_model_from_path(const std::string& path)
     }
 
     model m{};
+    m.m_id = s_next_id.fetch_add(1, std::memory_order_relaxed);
     aabb  model_aabb{};
-    ProcessNode(m, scene->mRootNode, scene);
+    geometry_heap heap{};
+    ProcessNode(m, heap, scene->mRootNode, scene, options);
+    if (options.build_triangle_bvh) {
+        build_triangle_bvhs(m, path);
+    }
+
+    if (!heap.indices.empty())
+    {
+        vao_builder heap_builder{};
+        heap_builder.begin();
+        heap_builder.add_vertex_buffer(heap.verts);
+        heap_builder.add_vertex_attribute(0, 8 * sizeof(float), 3);
+        heap_builder.add_vertex_attribute(1, 8 * sizeof(float), 3);
+        heap_builder.add_vertex_attribute(2, 8 * sizeof(float), 2);
+        heap_builder.add_index_buffer(heap.indices);
+        VAO heap_vao = heap_builder.build();
+        for (auto& mesh : m.m_meshes)
+        {
+            mesh.m_vao = heap_vao;
+        }
+    }
 
     for (auto& mesh : m.m_meshes)
     {
@@ -1,10 +1,20 @@
 #pragma once
 #include <string>
+#include <atomic>
 #include <unordered_map>
 #include "mesh.h"
 #include "texture.h"
 
 
+struct model_load_options
+{
+	// positions + indices of every mesh stay on the cpu (mesh::m_geometry) after upload
+	bool	keep_cpu_geometry = false;
+	// per mesh triangle bvh for ray queries, implies keep_cpu_geometry. cooked into <path>.bvh on first load
+	// and read back from there while the mesh layout still matches
+	bool	build_triangle_bvh = false;
+};
+
 class model
 {
 public:
@@ -16,6 +26,11 @@ public:
 	std::vector<mesh>				m_meshes;
 	std::vector<material_entry>		m_materials;
 	aabb							m_aabb;
+	// unique per load and kept through moves, scene keys the materials it shares between entities on it
+	u32								m_id = 0;
+
+	static model load_model_from_path(const std::string& path, const model_load_options& options = {});
 
-	static model load_model_from_path(const std::string& path);
+private:
+	inline static std::atomic<u32>	s_next_id = 1;
 };
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "occlusion_culling.h"
+#include "frustum_culling.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// clip space w below this counts as crossing the near plane
+static constexpr float s_min_w = 1e-4f;
+
+void occlusion_culler::init(u32 width, u32 height)
+{
+	m_tiles_x = (width + s_tile_width - 1) / s_tile_width;
+	m_tiles_y = (height + s_tile_height - 1) / s_tile_height;
+	m_width = m_tiles_x * s_tile_width;
+	m_height = m_tiles_y * s_tile_height;
+	m_depth.assign(m_width * m_height, 1.0f);
+	m_block_max.assign((m_width / s_block_size) * (m_height / s_block_size), 1.0f);
+	m_bins.assign(m_tiles_x * m_tiles_y, {});
+}
+
+void occlusion_culler::begin_frame(const glm::mat4& view_proj)
+{
+	if (m_width == 0)
+	{
+		init();
+	}
+	m_view_proj = view_proj;
+	m_occluders.clear();
+	m_triangles.clear();
+	for (std::vector<u32>& bin : m_bins)
+	{
+		bin.clear();
+	}
+}
+
+void occlusion_culler::add_occluder(const glm::vec3* positions, const u32* indices, u32 triangle_count, const glm::mat4& model)
+{
+	m_occluders.push_back({ positions, indices, triangle_count, model });
+}
+
+void occlusion_culler::setup_occluder(const occluder& source, std::vector<screen_triangle>& out) const
+{
+	const glm::mat4 model_view_proj = m_view_proj * source.model;
+	const glm::vec2 screen_scale = glm::vec2((float)m_width, (float)m_height) * 0.5f;
+
+	for (u32 t = 0; t < source.triangle_count; t++)
+	{
+		glm::vec3 screen[3];
+		bool clipped = false;
+		for (u32 corner = 0; corner < 3; corner++)
+		{
+			glm::vec4 clip = model_view_proj * glm::vec4(source.positions[source.indices[t * 3 + corner]], 1.0f);
+			// occluders are optional, dropping a triangle that crosses the near plane is always safe
+			if (clip.w < s_min_w)
+			{
+				clipped = true;
+				break;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			screen[corner] = glm::vec3((ndc.x + 1.0f) * screen_scale.x, (ndc.y + 1.0f) * screen_scale.y, ndc.z * 0.5f + 0.5f);
+		}
+		if (clipped)
+		{
+			continue;
+		}
+
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+		if (std::abs(area) < 1e-6f)
+		{
+			continue;
+		}
+		// occluders are tested double sided, flip clockwise triangles so every edge function is positive inside
+		if (area < 0.0f)
+		{
+			std::swap(screen[1], screen[2]);
+			area = -area;
+		}
+
+		screen_triangle tri;
+		tri.min_x = std::max((i32)std::floor(std::min({ screen[0].x, screen[1].x, screen[2].x })), 0);
+		tri.min_y = std::max((i32)std::floor(std::min({ screen[0].y, screen[1].y, screen[2].y })), 0);
+		tri.max_x = std::min((i32)std::ceil(std::max({ screen[0].x, screen[1].x, screen[2].x })), (i32)m_width - 1);
+		tri.max_y = std::min((i32)std::ceil(std::max({ screen[0].y, screen[1].y, screen[2].y })), (i32)m_height - 1);
+		if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+		{
+			continue;
+		}
+
+		for (u32 i = 0; i < 3; i++)
+		{
+			const glm::vec3& from = screen[i];
+			const glm::vec3& to = screen[(i + 1) % 3];
+			tri.edge_a[i] = -(to.y - from.y);
+			tri.edge_b[i] = to.x - from.x;
+			tri.edge_c[i] = -tri.edge_a[i] * from.x - tri.edge_b[i] * from.y;
+		}
+
+		glm::vec3 e1 = screen[1] - screen[0];
+		glm::vec3 e2 = screen[2] - screen[0];
+		tri.depth_a = (e1.z * e2.y - e2.z * e1.y) / area;
+		tri.depth_b = (e2.z * e1.x - e1.z * e2.x) / area;
+		tri.depth_c = screen[0].z - tri.depth_a * screen[0].x - tri.depth_b * screen[0].y;
+		out.push_back(tri);
+	}
+}
+
+void occlusion_culler::rasterize()
+{
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+	std::fill(m_block_max.begin(), m_block_max.end(), 1.0f);
+
+	// transform + setup per occluder on the workers, then gathered in occluder order
+	std::vector<std::vector<screen_triangle>> setup(m_occluders.size());
+	job_system::parallel_for(0, (u32)m_occluders.size(), 1, [&](u32 first, u32 last)
+	{
+		for (u32 i = first; i < last; i++)
+		{
+			setup_occluder(m_occluders[i], setup[i]);
+		}
+	});
+	for (std::vector<screen_triangle>& triangles : setup)
+	{
+		m_triangles.insert(m_triangles.end(), triangles.begin(), triangles.end());
+	}
+
+	for (u32 i = 0; i < (u32)m_triangles.size(); i++)
+	{
+		const screen_triangle& tri = m_triangles[i];
+		for (u32 ty = tri.min_y / s_tile_height; ty <= (u32)tri.max_y / s_tile_height; ty++)
+		{
+			for (u32 tx = tri.min_x / s_tile_width; tx <= (u32)tri.max_x / s_tile_width; tx++)
+			{
+				m_bins[ty * m_tiles_x + tx].push_back(i);
+			}
+		}
+	}
+
+	const bool use_avx2 = transform_kernel::get_path() == transform_kernel::path::avx2;
+	job_system::parallel_for(0, m_tiles_x * m_tiles_y, 1, [&](u32 first, u32 last)
+	{
+		for (u32 tile = first; tile < last; tile++)
+		{
+			u32 tile_x = tile % m_tiles_x;
+			u32 tile_y = tile / m_tiles_x;
+#if GLE_TRANSFORM_KERNEL_X86
+			if (use_avx2)
+			{
+				rasterize_tile_avx2(m_triangles.data(), m_bins[tile], m_depth.data(), m_width, tile_x, tile_y);
+			}
+			else
+#endif
+			{
+				rasterize_tile_scalar(m_triangles.data(), m_bins[tile], m_depth.data(), m_width, tile_x, tile_y);
+			}
+			build_hierarchy(tile_x, tile_y);
+		}
+	});
+}
+
+void occlusion_culler::rasterize_tile_scalar(const screen_triangle* triangles, const std::vector<u32>& indices, float* depth, u32 row_pitch, u32 tile_x, u32 tile_y)
+{
+	const i32 tile_min_x = (i32)(tile_x * s_tile_width);
+	const i32 tile_min_y = (i32)(tile_y * s_tile_height);
+	const i32 tile_max_x = tile_min_x + (i32)s_tile_width - 1;
+	const i32 tile_max_y = tile_min_y + (i32)s_tile_height - 1;
+
+	for (u32 index : indices)
+	{
+		const screen_triangle& tri = triangles[index];
+		i32 min_x = std::max(tri.min_x, tile_min_x);
+		i32 max_x = std::min(tri.max_x, tile_max_x);
+		i32 min_y = std::max(tri.min_y, tile_min_y);
+		i32 max_y = std::min(tri.max_y, tile_max_y);
+
+		for (i32 y = min_y; y <= max_y; y++)
+		{
+			float py = (float)y + 0.5f;
+			float* row = depth + (size_t)y * row_pitch;
+			for (i32 x = min_x; x <= max_x; x++)
+			{
+				float px = (float)x + 0.5f;
+				bool inside = true;
+				for (u32 e = 0; e < 3; e++)
+				{
+					inside &= tri.edge_a[e] * px + tri.edge_b[e] * py + tri.edge_c[e] >= 0.0f;
+				}
+				if (inside)
+				{
+					float z = tri.depth_a * px + tri.depth_b * py + tri.depth_c;
+					row[x] = std::min(row[x], z);
+				}
+			}
+		}
+	}
+}
+
+void occlusion_culler::build_hierarchy(u32 tile_x, u32 tile_y)
+{
+	const u32 blocks_x = m_width / s_block_size;
+	for (u32 by = tile_y * s_tile_height / s_block_size; by < (tile_y + 1) * s_tile_height / s_block_size; by++)
+	{
+		for (u32 bx = tile_x * s_tile_width / s_block_size; bx < (tile_x + 1) * s_tile_width / s_block_size; bx++)
+		{
+			float farthest = 0.0f;
+			for (u32 y = by * s_block_size; y < (by + 1) * s_block_size; y++)
+			{
+				const float* row = m_depth.data() + (size_t)y * m_width + bx * s_block_size;
+				for (u32 x = 0; x < s_block_size; x++)
+				{
+					farthest = std::max(farthest, row[x]);
+				}
+			}
+			m_block_max[by * blocks_x + bx] = farthest;
+		}
+	}
+}
+
+bool occlusion_culler::is_visible(const aabb& world_box) const
+{
+	glm::vec2 screen_min = glm::vec2(std::numeric_limits<float>::max());
+	glm::vec2 screen_max = glm::vec2(-std::numeric_limits<float>::max());
+	float nearest = 1.0f;
+	const glm::vec2 screen_scale = glm::vec2((float)m_width, (float)m_height) * 0.5f;
+
+	for (u32 corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 p = glm::vec3(corner & 1 ? world_box.max.x : world_box.min.x, corner & 2 ? world_box.max.y : world_box.min.y, corner & 4 ? world_box.max.z : world_box.min.z);
+		glm::vec4 clip = m_view_proj * glm::vec4(p, 1.0f);
+		// crosses the near plane, the camera may be inside it
+		if (clip.w < s_min_w)
+		{
+			return true;
+		}
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 screen = (glm::vec2(ndc) + 1.0f) * screen_scale;
+		screen_min = glm::min(screen_min, screen);
+		screen_max = glm::max(screen_max, screen);
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	i32 min_x = std::max((i32)std::floor(screen_min.x), 0);
+	i32 min_y = std::max((i32)std::floor(screen_min.y), 0);
+	i32 max_x = std::min((i32)std::ceil(screen_max.x), (i32)m_width - 1);
+	i32 max_y = std::min((i32)std::ceil(screen_max.y), (i32)m_height - 1);
+	if (min_x > max_x || min_y > max_y)
+	{
+		return true;
+	}
+
+	const u32 blocks_x = m_width / s_block_size;
+	for (i32 by = min_y / (i32)s_block_size; by <= max_y / (i32)s_block_size; by++)
+	{
+		for (i32 bx = min_x / (i32)s_block_size; bx <= max_x / (i32)s_block_size; bx++)
+		{
+			// everything rasterised in the block is nearer than the box
+			if (m_block_max[by * blocks_x + bx] < nearest)
+			{
+				continue;
+			}
+
+			i32 x0 = std::max(min_x, bx * (i32)s_block_size);
+			i32 x1 = std::min(max_x, (bx + 1) * (i32)s_block_size - 1);
+			i32 y0 = std::max(min_y, by * (i32)s_block_size);
+			i32 y1 = std::min(max_y, (by + 1) * (i32)s_block_size - 1);
+			for (i32 y = y0; y <= y1; y++)
+			{
+				const float* row = m_depth.data() + (size_t)y * m_width;
+				for (i32 x = x0; x <= x1; x++)
+				{
+					if (row[x] >= nearest)
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+u32 occlusion_culler::filter(const aabb_soa& boxes, std::vector<u32>& visible) const
+{
+	std::vector<u8> keep(visible.size(), 1);
+	job_system::parallel_for(0, (u32)visible.size(), 64, [&](u32 first, u32 last)
+	{
+		for (u32 i = first; i < last; i++)
+		{
+			u32 index = visible[i];
+			glm::vec3 center = glm::vec3(boxes.m_center[0][index], boxes.m_center[1][index], boxes.m_center[2][index]);
+			glm::vec3 extent = glm::vec3(boxes.m_extent[0][index], boxes.m_extent[1][index], boxes.m_extent[2][index]);
+			keep[i] = is_visible(aabb{ center - extent, center + extent }) ? 1 : 0;
+		}
+	});
+
+	u32 kept = 0;
+	for (u32 i = 0; i < (u32)visible.size(); i++)
+	{
+		if (keep[i])
+		{
+			visible[kept++] = visible[i];
+		}
+	}
+	u32 removed = (u32)visible.size() - kept;
+	visible.resize(kept);
+	return removed;
+}
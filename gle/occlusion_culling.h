@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include "glm.hpp"
+#include "shape.h"
+#include "alias.h"
+#include "transform_kernel.h"
+
+struct aabb_soa;
+
+// cpu occlusion culling : a few big occluders are rasterised into a small depth buffer, then candidate boxes are
+// tested against it before any draw is recorded. no gpu readback, so the result is ready the same frame.
+// the screen is cut into tiles, triangles are binned per tile and every tile is rasterised by its own job
+// (8 pixels per avx2 instruction when available). each tile also keeps the farthest depth of its 8x8 blocks,
+// which rejects most boxes without touching pixels
+class occlusion_culler
+{
+public:
+	static constexpr u32 s_tile_width = 64;
+	static constexpr u32 s_tile_height = 32;
+	static constexpr u32 s_block_size = 8;
+
+	struct screen_triangle
+	{
+		// edge functions a * x + b * y + c, positive inside
+		float	edge_a[3];
+		float	edge_b[3];
+		float	edge_c[3];
+		// depth plane
+		float	depth_a, depth_b, depth_c;
+		i32		min_x, min_y, max_x, max_y;
+	};
+
+	// width / height are rounded up to whole tiles
+	void	init(u32 width = 320, u32 height = 192);
+	// clears the depth buffer and forgets last frame's occluders
+	void	begin_frame(const glm::mat4& view_proj);
+	// positions / indices are in model space and must stay alive until rasterize returns
+	void	add_occluder(const glm::vec3* positions, const u32* indices, u32 triangle_count, const glm::mat4& model);
+	void	rasterize();
+
+	// false only if the box is certainly hidden behind the occluders
+	bool	is_visible(const aabb& world_box) const;
+	// drops the indices of hidden boxes from visible (order kept), returns how many were dropped
+	u32		filter(const aabb_soa& boxes, std::vector<u32>& visible) const;
+
+	u32		get_width() const { return m_width; }
+	u32		get_height() const { return m_height; }
+	u32		get_triangle_count() const { return (u32)m_triangles.size(); }
+	const std::vector<float>&	get_depth() const { return m_depth; }
+
+	// rasterises triangles[indices] into the tile at (tile_x, tile_y) of depth, row_pitch floats per row
+	static void	rasterize_tile_scalar(const screen_triangle* triangles, const std::vector<u32>& indices, float* depth, u32 row_pitch, u32 tile_x, u32 tile_y);
+#if GLE_TRANSFORM_KERNEL_X86
+	static void	rasterize_tile_avx2(const screen_triangle* triangles, const std::vector<u32>& indices, float* depth, u32 row_pitch, u32 tile_x, u32 tile_y);
+#endif
+
+private:
+	struct occluder
+	{
+		const glm::vec3*	positions;
+		const u32*			indices;
+		u32					triangle_count;
+		glm::mat4			model;
+	};
+
+	void	setup_occluder(const occluder& source, std::vector<screen_triangle>& out) const;
+	void	build_hierarchy(u32 tile_x, u32 tile_y);
+
+	u32								m_width = 0;
+	u32								m_height = 0;
+	u32								m_tiles_x = 0;
+	u32								m_tiles_y = 0;
+	glm::mat4						m_view_proj = glm::mat4(1.0f);
+
+	// 0 = near plane, 1 = far plane
+	std::vector<float>				m_depth;
+	// farthest depth of every s_block_size square
+	std::vector<float>				m_block_max;
+	std::vector<occluder>			m_occluders;
+	std::vector<screen_triangle>	m_triangles;
+	std::vector<std::vector<u32>>	m_bins;
+};
@@ -0,0 +1,68 @@
+// compiled for avx2 + fma (GLE_TARGET_AVX2), only called when the cpu reports support for both
+#include "occlusion_culling.h"
+#include <algorithm>
+
+#if GLE_TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+
+GLE_TARGET_AVX2 void occlusion_culler::rasterize_tile_avx2(const screen_triangle* triangles, const std::vector<u32>& indices, float* depth, u32 row_pitch, u32 tile_x, u32 tile_y)
+{
+	const i32 tile_min_x = (i32)(tile_x * s_tile_width);
+	const i32 tile_min_y = (i32)(tile_y * s_tile_height);
+	const i32 tile_max_x = tile_min_x + (i32)s_tile_width - 1;
+	const i32 tile_max_y = tile_min_y + (i32)s_tile_height - 1;
+	const __m256 lane_offset = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (u32 index : indices)
+	{
+		const screen_triangle& tri = triangles[index];
+		// tiles are a multiple of 8 wide, so aligning down never leaves the tile
+		i32 min_x = std::max(tri.min_x, tile_min_x) & ~7;
+		i32 max_x = std::min(tri.max_x, tile_max_x);
+		i32 min_y = std::max(tri.min_y, tile_min_y);
+		i32 max_y = std::min(tri.max_y, tile_max_y);
+
+		__m256 edge_a[3];
+		__m256 edge_b[3];
+		__m256 edge_c[3];
+		for (u32 e = 0; e < 3; e++)
+		{
+			edge_a[e] = _mm256_set1_ps(tri.edge_a[e]);
+			edge_b[e] = _mm256_set1_ps(tri.edge_b[e]);
+			edge_c[e] = _mm256_set1_ps(tri.edge_c[e]);
+		}
+		const __m256 depth_a = _mm256_set1_ps(tri.depth_a);
+		const __m256 depth_b = _mm256_set1_ps(tri.depth_b);
+		const __m256 depth_c = _mm256_set1_ps(tri.depth_c);
+
+		for (i32 y = min_y; y <= max_y; y++)
+		{
+			__m256 py = _mm256_set1_ps((float)y + 0.5f);
+			__m256 row_edge[3];
+			for (u32 e = 0; e < 3; e++)
+			{
+				row_edge[e] = _mm256_fmadd_ps(edge_b[e], py, edge_c[e]);
+			}
+			__m256 row_depth = _mm256_fmadd_ps(depth_b, py, depth_c);
+			float* row = depth + (size_t)y * row_pitch;
+
+			for (i32 x = min_x; x <= max_x; x += 8)
+			{
+				__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lane_offset);
+				__m256 inside = _mm256_cmp_ps(_mm256_fmadd_ps(edge_a[0], px, row_edge[0]), zero, _CMP_GE_OQ);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edge_a[1], px, row_edge[1]), zero, _CMP_GE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_fmadd_ps(edge_a[2], px, row_edge[2]), zero, _CMP_GE_OQ));
+				if (_mm256_testz_ps(inside, inside))
+				{
+					continue;
+				}
+				__m256 z = _mm256_fmadd_ps(depth_a, px, row_depth);
+				__m256 current = _mm256_loadu_ps(row + x);
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, _mm256_min_ps(current, z), inside));
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "render_queue.h"
+#include <algorithm>
+
+u64 render_queue::make_key(pass draw_pass, gl_handle program, u64 material_id, u32 geometry_id, float depth)
+{
+	u64 depth_bits = (u64)(std::clamp(depth, 0.0f, 1.0f) * 65535.0f);
+	return ((u64)(draw_pass & 0xF) << 60)
+		| ((u64)(program & 0xFFF) << 48)
+		| ((material_id & 0xFFFF) << 32)
+		| ((u64)(geometry_id & 0xFFFF) << 16)
+		| depth_bits;
+}
+
+u32 render_queue::make_geometry_id(gl_handle vao, u32 first_index)
+{
+	// fibonacci hash of the first index, top 10 bits
+	u32 range_bits = (first_index * 2654435769u) >> 22;
+	return ((vao & 0x3F) << 10) | range_bits;
+}
+
+void render_queue::clear()
+{
+	m_packets.clear();
+}
+
+void render_queue::push(u64 key, material* mat, mesh* geometry, transform* trans, u32 material_index)
+{
+	m_packets.push_back({ key, mat, geometry, trans, material_index });
+}
+
+void render_queue::sort()
+{
+	const size_t count = m_packets.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	m_scratch.resize(count);
+	draw_packet* src = m_packets.data();
+	draw_packet* dst = m_scratch.data();
+
+	for (u32 shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			histogram[(src[i].key >> shift) & 0xFF]++;
+		}
+
+		// every key has the same digit, this pass would be a plain copy
+		if (histogram[(src[0].key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t& bucket : histogram)
+		{
+			size_t bucket_count = bucket;
+			bucket = offset;
+			offset += bucket_count;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	if (src != m_packets.data())
+	{
+		m_packets.swap(m_scratch);
+	}
+}
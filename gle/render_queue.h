@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "alias.h"
+
+class material;
+struct mesh;
+struct transform;
+
+struct draw_packet
+{
+	u64			key;
+	material*	mat;
+	mesh*		geometry;
+	transform*	trans;
+	// material_registry index, forwarded to the gpu as draw_data.material_index
+	u32			material_index;
+};
+
+// collects the draws of a pass, sorts them by a packed 64 bit key and hands them back in state order
+// key layout (msb -> lsb) : [ pass : 4 ][ program : 12 ][ material : 16 ][ geometry : 16 ][ depth : 16 ]
+// material is the material_registry index, so draws of one shared material end up next to each other
+class render_queue
+{
+public:
+	enum pass : u32
+	{
+		gbuffer	= 0,
+		shadow	= 1
+	};
+
+	// depth is a normalised (0 = near) view distance, so draws in the same state bucket go front to back
+	static u64	make_key(pass draw_pass, gl_handle program, u64 material_id, u32 geometry_id, float depth);
+	// 16 bit id of a mesh range : the vao keeps meshes of one geometry heap together, the first index tells them apart
+	static u32	make_geometry_id(gl_handle vao, u32 first_index);
+
+	void		clear();
+	void		push(u64 key, material* mat, mesh* geometry, transform* trans, u32 material_index = 0);
+	// lsd radix sort, 8 bits per pass, digits every key shares are skipped
+	void		sort();
+
+	std::vector<draw_packet>	m_packets;
+
+private:
+	std::vector<draw_packet>	m_scratch;
+};
@@ -2,12 +2,28 @@
 #include "model.h"
 #include "shader.h"
 #include "transform.h"
+#include "transform_buffer.h"
 #include "material.h"
+#include "mesh.h"
+#include "shader_library.h"
+#include "shader_batch.h"
+#include "utils.h"
+#include <algorithm>
 #include <sstream>
 
 
 scene::scene(const std::string& scene_name) : m_name(scene_name)
 {
+	m_systems.add("transforms", [](scene& current_scene) { transform::update_transforms(current_scene); })
+		.writes<transform, mesh>();
+	m_systems.add("spatial index", [](scene& current_scene) { current_scene.update_spatial_index(); })
+		.reads<transform, mesh>()
+		.writes<aabb_tree>();
+
+	m_registry.on_construct<mesh>().connect<&scene::on_mesh_created>(*this);
+	m_registry.on_destroy<mesh>().connect<&scene::on_mesh_destroyed>(*this);
+	m_registry.on_destroy<transform>().connect<&scene::on_transform_destroyed>(*this);
+	m_registry.on_destroy<material_handle>().connect<&scene::on_material_handle_destroyed>(*this);
 }
 
 entity scene::create_entity(const std::string& name)
@@ -21,44 +37,254 @@ entity scene::create_entity(const std::string& name)
 std::vector<entity> scene::create_entity_from_model(model& model_to_load, shader& material_shader, glm::vec3 scale, std::map<std::string, texture_map_type> known_maps)
 {
 	std::vector<entity> entities{};
-	std::stringstream entity_name;
 
-	for (auto& entry : model_to_load.m_meshes)
+	for (u32 i = 0; i < model_to_load.m_meshes.size(); i++)
 	{
-		entity_name << "Entity " << p_created_entity_count;
-		entity e = create_entity(entity_name.str());
-		entity_name.clear();
+		entities.push_back(create_entity_from_mesh(model_to_load, i, material_shader, scale, known_maps));
+	}
 
-		transform& trans = e.add_component<transform>();
-		trans.m_scale = scale;
+	return entities;
+}
 
-		e.add_component<mesh>(entry);
-		material& current_mat = e.add_component<material>(material_shader);
+std::vector<entity> scene::create_entity_from_model(model& model_to_load, const shader_desc& material_shader, glm::vec3 scale, std::map<std::string, texture_map_type> known_maps)
+{
+	// every permutation is submitted before any material reflects its program, so they compile in parallel
+	shader_batch batch;
+	std::vector<shader*> material_shaders(model_to_load.m_materials.size(), nullptr);
 
-		GLenum texture_slot = GL_TEXTURE0;
-		// go through each known map type
+	for (size_t i = 0; i < model_to_load.m_materials.size(); i++)
+	{
+		shader_desc desc = material_shader;
+		model::material_entry& material_entry = model_to_load.m_materials[i];
 		for (auto& [uniform_name, map_type] : known_maps)
 		{
-			// check if material (instance of shader) has slot for this map type
-			
-			// check if material has desired map type
-			model::material_entry& material_entry = model_to_load.m_materials[entry.m_material_index];
 			if (material_entry.m_material_maps.find(map_type) != material_entry.m_material_maps.end())
 			{
-				current_mat.set_sampler(uniform_name, texture_slot, material_entry.m_material_maps[map_type], GL_TEXTURE_2D);
-				texture_slot++;
+				std::string define_name = uniform_name.rfind("u_", 0) == 0 ? uniform_name.substr(2) : uniform_name;
+				std::transform(define_name.begin(), define_name.end(), define_name.begin(), ::toupper);
+				desc.defines["HAS_" + define_name] = "1";
 			}
 		}
+		material_shaders[i] = &shader_library::get(desc, batch);
+	}
+	batch.wait();
+
+	std::vector<entity> entities{};
 
-		entities.push_back(e);
+	for (u32 i = 0; i < model_to_load.m_meshes.size(); i++)
+	{
+		shader& mesh_shader = *material_shaders[model_to_load.m_meshes[i].m_material_index];
+		entities.push_back(create_entity_from_mesh(model_to_load, i, mesh_shader, scale, known_maps));
 	}
 
 	return entities;
 }
 
+entity scene::create_entity_from_mesh(model& model_to_load, u32 mesh_index, shader& material_shader, glm::vec3 scale, const std::map<std::string, texture_map_type>& known_maps)
+{
+	mesh& entry = model_to_load.m_meshes[mesh_index];
+	std::stringstream entity_name;
+	entity_name << "Entity " << p_created_entity_count;
+	entity e = create_entity(entity_name.str());
+
+	transform& trans = e.add_component<transform>();
+	trans.set_scale(scale);
+
+	e.add_component<mesh>(entry);
+
+	// every mesh using the same model material through the same program shares one material. keyed on ids
+	// rather than addresses, the model can move and a freed one's address can be reused by the next load
+	model::material_entry& material_entry = model_to_load.m_materials[entry.m_material_index];
+	u64 key = utils::hash_fnv1a(&material_shader.m_shader_id, sizeof(material_shader.m_shader_id));
+	key = utils::hash_fnv1a(&model_to_load.m_id, sizeof(model_to_load.m_id), key);
+	key = utils::hash_fnv1a(&entry.m_material_index, sizeof(entry.m_material_index), key);
+
+	bool created = false;
+	material_handle handle = material_registry::get_or_create(key, material_shader, created);
+	e.add_component<material_handle>(handle);
+	if (!created)
+	{
+		return e;
+	}
+
+	material& current_mat = material_registry::get(handle);
+	GLenum texture_slot = GL_TEXTURE0;
+	// go through each known map type
+	for (auto& [uniform_name, map_type] : known_maps)
+	{
+		// check if material has desired map type
+		if (material_entry.m_material_maps.find(map_type) != material_entry.m_material_maps.end())
+		{
+			current_mat.set_sampler(uniform_name, texture_slot, material_entry.m_material_maps[map_type], GL_TEXTURE_2D);
+			texture_slot++;
+		}
+	}
+
+	return e;
+}
+
 void scene::on_update()
 {
-	transform::update_transforms(*this);
+	m_systems.run(*this);
+}
+
+void scene::on_mesh_created(entt::entity e)
+{
+	m_renderables_version++;
+	// the transform update only refreshes bounds of transforms that moved, a mesh added to one that's at rest
+	// would keep its local space bounds. a dirty transform moves on the next update and recomputes them anyway
+	if (const transform* trans = m_registry.try_get<transform>(e))
+	{
+		mesh& emesh = m_registry.get<mesh>(e);
+		emesh.m_transformed_aabb = utils::transform_aabb_arvo(emesh.m_original_aabb, trans->m_model);
+	}
+	// joins the index after the transform system ran, the transform may still be dirty
+	p_spatial_pending.push_back(e);
+}
+
+void scene::on_transform_destroyed(entt::entity e)
+{
+	const transform& trans = m_registry.get<transform>(e);
+	if (trans.m_gpu_index != transform::s_no_gpu_index)
+	{
+		transform_buffer::release(trans.m_gpu_index);
+	}
+	// children still point at e, the re-sort on the next update detaches them
+	m_hierarchy_dirty = true;
+	m_renderables_version++;
+}
+
+void scene::on_material_handle_destroyed(entt::entity e)
+{
+	material_registry::release(m_registry.get<material_handle>(e));
+}
+
+void scene::on_mesh_destroyed(entt::entity e)
+{
+	m_renderables_version++;
+	auto proxy = p_spatial_proxies.find(e);
+	if (proxy != p_spatial_proxies.end())
+	{
+		m_spatial_index.destroy_proxy(proxy->second);
+		p_spatial_proxies.erase(proxy);
+		return;
+	}
+	p_spatial_pending.erase(std::remove(p_spatial_pending.begin(), p_spatial_pending.end(), e), p_spatial_pending.end());
+}
+
+void scene::update_spatial_index()
+{
+	// a big batch (e.g. a model load) is cheaper and better as one sah build than as single inserts
+	bool batch = p_spatial_pending.size() > 64 && p_spatial_pending.size() > m_spatial_index.get_proxy_count() / 4;
+	for (entt::entity e : p_spatial_pending)
+	{
+		const mesh& emesh = m_registry.get<mesh>(e);
+		p_spatial_proxies[e] = m_spatial_index.create_proxy(emesh.m_transformed_aabb, (u32)entt::to_integral(e), batch);
+	}
+	p_spatial_pending.clear();
+	if (batch)
+	{
+		m_spatial_index.rebuild();
+	}
+
+	// only proxies whose mesh left its fat box touch the tree
+	for (auto [e, trans, emesh] : m_registry.view<transform, mesh>().each())
+	{
+		if (trans.m_changed)
+		{
+			auto proxy = p_spatial_proxies.find(e);
+			if (proxy != p_spatial_proxies.end())
+			{
+				m_spatial_index.move_proxy(proxy->second, emesh.m_transformed_aabb);
+			}
+		}
+	}
+}
+
+void scene::query_aabb(const aabb& box, std::vector<entt::entity>& out) const
+{
+	static thread_local std::vector<u32> hits;
+	hits.clear();
+	m_spatial_index.query_aabb(box, hits);
+	for (u32 hit : hits)
+	{
+		out.push_back((entt::entity)hit);
+	}
+}
+
+void scene::query_sphere(glm::vec3 center, float radius, std::vector<entt::entity>& out) const
+{
+	static thread_local std::vector<u32> hits;
+	hits.clear();
+	m_spatial_index.query_sphere(center, radius, hits);
+	for (u32 hit : hits)
+	{
+		out.push_back((entt::entity)hit);
+	}
+}
+
+void scene::query_frustum(const frustum& view_frustum, std::vector<entt::entity>& out) const
+{
+	static thread_local std::vector<u32> hits;
+	hits.clear();
+	m_spatial_index.query_frustum(view_frustum, hits);
+	for (u32 hit : hits)
+	{
+		out.push_back((entt::entity)hit);
+	}
+}
+
+entt::entity scene::raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, float& distance, u32* triangle)
+{
+	entt::entity closest = entt::null;
+	u32 closest_triangle = 0xFFFFFFFF;
+	distance = max_distance;
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	// the tree only knows fat boxes, each candidate is re-tested against its mesh's tight world aabb and then its triangles
+	m_spatial_index.raycast(origin, direction, max_distance, [&](u32 user_data, float)
+	{
+		entt::entity e = (entt::entity)user_data;
+		const mesh& emesh = m_registry.get<mesh>(e);
+		const aabb& box = emesh.m_transformed_aabb;
+		glm::vec3 t0 = (box.min - origin) * inv_direction;
+		glm::vec3 t1 = (box.max - origin) * inv_direction;
+		glm::vec3 near_t = glm::min(t0, t1);
+		glm::vec3 far_t = glm::max(t0, t1);
+		float t_near = std::max(std::max(near_t.x, near_t.y), std::max(near_t.z, 0.0f));
+		float t_far = std::min(std::min(far_t.x, far_t.y), far_t.z);
+		if (t_near > t_far || t_near >= distance)
+		{
+			return distance;
+		}
+
+		if (emesh.m_geometry && !emesh.m_geometry->m_bvh.empty())
+		{
+			// an unnormalised local direction keeps the ray parameter equal to the world one
+			glm::mat4 to_local = glm::inverse(m_registry.get<transform>(e).m_model);
+			glm::vec3 local_origin = glm::vec3(to_local * glm::vec4(origin, 1.0f));
+			glm::vec3 local_direction = glm::vec3(to_local * glm::vec4(direction, 0.0f));
+			triangle_bvh::hit hit;
+			if (emesh.m_geometry->m_bvh.intersect_closest(local_origin, local_direction, distance, hit))
+			{
+				distance = hit.distance;
+				closest = e;
+				closest_triangle = hit.triangle;
+			}
+			return distance;
+		}
+
+		distance = t_near;
+		closest = e;
+		closest_triangle = 0xFFFFFFFF;
+		return distance;
+	});
+
+	if (triangle)
+	{
+		*triangle = closest_triangle;
+	}
+	return closest;
 }
 
 entity::entity(scene* escene, entt::entity e) : m_scene(escene), m_handle(e)
@@ -4,28 +4,70 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include "alias.h"
 #include "texture.h"
 #include "entt.hpp"
+#include "system_scheduler.h"
+#include "aabb_tree.h"
 class entity;
 class model;
 class shader;
+struct shader_desc;
 
 class scene
 {
 public:
 
     scene(const std::string& scene_name);
+	// registry observers point back at the scene
+	scene(const scene&) = delete;
+	scene&					operator=(const scene&) = delete;
 
     entity					create_entity(const std::string& name);
 	std::vector<entity>		create_entity_from_model(model& model_to_load, shader& material_shader, glm::vec3 scale = glm::vec3(1.0f), std::map<std::string, texture_map_type> known_maps = {});
+	// compiles one permutation of material_shader per model material, defining HAS_<MAP> (e.g. u_normal_map -> HAS_NORMAL_MAP) for every known map it has
+	std::vector<entity>		create_entity_from_model(model& model_to_load, const shader_desc& material_shader, glm::vec3 scale = glm::vec3(1.0f), std::map<std::string, texture_map_type> known_maps = {});
 
+	// runs every registered system, see m_systems
 	void					on_update();
 
+	// spatial queries over mesh entities, answered from m_spatial_index. results are appended to out
+	void					query_aabb(const aabb& box, std::vector<entt::entity>& out) const;
+	void					query_sphere(glm::vec3 center, float radius, std::vector<entt::entity>& out) const;
+	void					query_frustum(const frustum& view_frustum, std::vector<entt::entity>& out) const;
+	// closest mesh the ray hits, entt::null if none. meshes with a triangle bvh (model_load_options::build_triangle_bvh)
+	// are hit tested per triangle and report it through triangle, the others only by their world aabb (triangle = ~0)
+	entt::entity			raycast(glm::vec3 origin, glm::vec3 direction, float max_distance, float& distance, u32* triangle = nullptr);
+
     const std::string	m_name;
     entt::registry		m_registry;
+	// set by transform::set_parent and when a transform is destroyed, the transform storage gets re-sorted by depth on the next update
+	bool				m_hierarchy_dirty = false;
+	// bumped whenever a mesh or transform comes or goes, caches over the set of renderables compare it
+	// instead of counting them, so one added and one removed in the same frame still shows up
+	u32					m_renderables_version = 0;
+	// per frame systems, the transform update is registered by the constructor
+	system_scheduler	m_systems;
+	// fat world aabbs of every mesh entity, kept in sync by the "spatial index" system.
+	// user data is the entity, systems querying it should declare reads<aabb_tree>()
+	aabb_tree			m_spatial_index;
 protected:
 	u32					p_created_entity_count;
+
+	entity				create_entity_from_mesh(model& model_to_load, u32 mesh_index, shader& material_shader, glm::vec3 scale, const std::map<std::string, texture_map_type>& known_maps);
+
+	// registry observers, mesh entities join the index on the next update and leave it right away
+	void				on_mesh_created(entt::entity e);
+	void				on_mesh_destroyed(entt::entity e);
+	// gives the transform_buffer slot back and re-sorts, so children of e are detached before they're composed again
+	void				on_transform_destroyed(entt::entity e);
+	// drops the entity's reference, the material is freed with its last handle
+	void				on_material_handle_destroyed(entt::entity e);
+	void				update_spatial_index();
+
+	std::vector<entt::entity>					p_spatial_pending;
+	std::unordered_map<entt::entity, i32>		p_spatial_proxies;
 };
 
 class entity
@@ -1,52 +1,33 @@
 #include "shader.h"
-#include "shader.h"
-#include "shader.h"
-#include "shader.h"
-#include "shader.h"
-#include "shader.h"
-#include "shader.h"
+#include "shader_batch.h"
+#include "gl_state.h"
 #include "gtc/type_ptr.hpp"
 
 #include <iostream>
 
 
-shader::shader(const std::string& comp)
+shader::shader(gl_handle program_id) : m_shader_id(program_id)
 {
-	auto c = compile_shader(comp, GL_COMPUTE_SHADER);
-	m_shader_id = link_shader(c);
+}
 
-	glDeleteShader(c);
+shader::shader(const std::string& comp)
+{
+	m_shader_id = create_program({ {GL_COMPUTE_SHADER, &comp} });
 }
 
 shader::shader(const std::string& vert, const std::string& frag)
 {
-	auto v = compile_shader(vert, GL_VERTEX_SHADER);
-	auto f = compile_shader(frag, GL_FRAGMENT_SHADER);
-
-	m_shader_id = link_shader(v, f);
-
-	glDeleteShader(v);
-	glDeleteShader(f);
-
+	m_shader_id = create_program({ {GL_VERTEX_SHADER, &vert}, {GL_FRAGMENT_SHADER, &frag} });
 }
 
 shader::shader(const std::string& vert, const std::string& geom, const std::string& frag)
 {
-	auto v = compile_shader(vert, GL_VERTEX_SHADER);
-	auto g = compile_shader(geom, GL_GEOMETRY_SHADER);
-	auto f = compile_shader(frag, GL_FRAGMENT_SHADER);
-
-	m_shader_id = link_shader(v, g, f);
-
-	glDeleteShader(v);
-	glDeleteShader(g);
-	glDeleteShader(f);
-
+	m_shader_id = create_program({ {GL_VERTEX_SHADER, &vert}, {GL_GEOMETRY_SHADER, &geom}, {GL_FRAGMENT_SHADER, &frag} });
 }
 
 void shader::use()
 {
-	glUseProgram(m_shader_id);
+	gl_state::use_program(m_shader_id);
 }
 
 void shader::set_bool(const std::string& name, bool value) const
@@ -59,6 +40,11 @@ void shader::set_int(const std::string& name, int value) const
 	glUniform1i(glGetUniformLocation(m_shader_id, name.c_str()), value);
 }
 
+void shader::set_uint(const std::string& name, uint32_t value) const
+{
+	glUniform1ui(glGetUniformLocation(m_shader_id, name.c_str()), value);
+}
+
 void shader::set_float(const std::string& name, float value) const
 {
 	glUniform1f(glGetUniformLocation(m_shader_id, name.c_str()), value);
@@ -117,9 +103,7 @@ gl_handle shader::compile_shader(const std::string& source, GLenum shader_stage)
 
 	if (!success)
 	{
-		char infoLog[512];
-		glGetShaderInfoLog(s, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+		std::cout << "ERROR::SHADER::COMPILATION_FAILED\n" << get_shader_info_log(s) << std::endl;
 	};
 
 	return s;
@@ -128,6 +112,7 @@ gl_handle shader::compile_shader(const std::string& source, GLenum shader_stage)
 int shader::link_shader(gl_handle comp)
 {
 	auto prog_id = glCreateProgram();
+	glProgramParameteri(prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(prog_id, comp);
 	glLinkProgram(prog_id);
 
@@ -136,9 +121,7 @@ int shader::link_shader(gl_handle comp)
 	glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		char infoLog[512];
-		glGetProgramInfoLog(prog_id, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << get_program_info_log(prog_id) << std::endl;
 	}
 
 	return prog_id;
@@ -147,6 +130,7 @@ int shader::link_shader(gl_handle comp)
 int shader::link_shader(gl_handle vert, gl_handle frag)
 {
 	auto prog_id = glCreateProgram();
+	glProgramParameteri(prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(prog_id, vert);
 	glAttachShader(prog_id, frag);
 	glLinkProgram(prog_id);
@@ -156,9 +140,7 @@ int shader::link_shader(gl_handle vert, gl_handle frag)
 	glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		char infoLog[512];
-		glGetProgramInfoLog(prog_id, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << get_program_info_log(prog_id) << std::endl;
 	}
 
 	return prog_id;
@@ -167,6 +149,7 @@ int shader::link_shader(gl_handle vert, gl_handle frag)
 int shader::link_shader(gl_handle vert, gl_handle geom, gl_handle frag)
 {
 	auto prog_id = glCreateProgram();
+	glProgramParameteri(prog_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glAttachShader(prog_id, vert);
 	glAttachShader(prog_id, geom);
 	glAttachShader(prog_id, frag);
@@ -177,9 +160,7 @@ int shader::link_shader(gl_handle vert, gl_handle geom, gl_handle frag)
 	glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		char infoLog[512];
-		glGetProgramInfoLog(prog_id, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << get_program_info_log(prog_id) << std::endl;
 	}
 
 	return prog_id;
@@ -218,3 +199,37 @@ shader::uniform_type shader::get_type_from_gl(GLenum type)
 
 	return uniform_type::UNKNOWN;
 }
+
+std::string shader::get_shader_info_log(gl_handle shader_stage)
+{
+	int log_length = 0;
+	glGetShaderiv(shader_stage, GL_INFO_LOG_LENGTH, &log_length);
+	if (log_length <= 0)
+	{
+		return "";
+	}
+	std::string log(log_length, '\0');
+	glGetShaderInfoLog(shader_stage, log_length, NULL, &log[0]);
+	return log;
+}
+
+std::string shader::get_program_info_log(gl_handle program)
+{
+	int log_length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+	if (log_length <= 0)
+	{
+		return "";
+	}
+	std::string log(log_length, '\0');
+	glGetProgramInfoLog(program, log_length, NULL, &log[0]);
+	return log;
+}
+
+gl_handle shader::create_program(const std::vector<shader_cache::stage_source>& stages, const std::string& defines)
+{
+	shader_batch batch;
+	gl_handle prog_id = batch.add(stages, defines);
+	batch.wait();
+	return prog_id;
+}
@@ -3,6 +3,7 @@
 #include "GL/glew.h"
 #include "glm.hpp"
 #include "alias.h"
+#include "shader_cache.h"
 
 class shader
 {
@@ -26,6 +27,7 @@ public:
 
 	unsigned int m_shader_id;
 
+    explicit shader(gl_handle program_id);
     shader(const std::string& comp);
 	shader(const std::string& vert, const std::string& frag);
     shader(const std::string& vert, const std::string& geom, const std::string& frag);
@@ -34,6 +36,7 @@ public:
     
     void set_bool(const std::string& name, bool value) const;
     void set_int(const std::string& name, int value) const;
+    void set_uint(const std::string& name, uint32_t value) const;
     void set_float(const std::string& name, float value) const;
     void set_vec2(const std::string& name, glm::vec2 value) const;
     void set_vec3(const std::string& name, glm::vec3 value) const;
@@ -51,4 +54,9 @@ public:
     static int link_shader(gl_handle vert, gl_handle geom, gl_handle frag);
 
     static uniform_type get_type_from_gl(GLenum type);
+    static std::string  get_shader_info_log(gl_handle shader_stage);
+    static std::string  get_program_info_log(gl_handle program);
+
+    // compiles + links the given stages, or loads the program straight from the binary cache
+    static gl_handle create_program(const std::vector<shader_cache::stage_source>& stages, const std::string& defines = "");
 };
@@ -0,0 +1,156 @@
+#include "shader_batch.h"
+#include <iostream>
+#include <thread>
+
+shader_batch::shader_batch()
+{
+	static bool initialised = false;
+	if (!initialised)
+	{
+		initialised = true;
+		s_parallel_compile_supported = GLEW_KHR_parallel_shader_compile;
+		if (s_parallel_compile_supported)
+		{
+			// let the driver pick as many compiler threads as it wants
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		}
+	}
+}
+
+gl_handle shader_batch::add(const std::vector<shader_cache::stage_source>& stages, const std::string& defines, const std::string& name)
+{
+	pending_program p{};
+	p.name = name;
+	p.cache_key = shader_cache::get_program_key(stages, defines);
+
+	if (shader_cache::try_load_program(p.cache_key, p.program))
+	{
+		p.from_cache = true;
+		m_pending.push_back(p);
+		return p.program;
+	}
+
+	// no status queries here, they would force the driver to finish the compile
+	for (auto& s : stages)
+	{
+		const char* src = s.source->c_str();
+		gl_handle stage = glCreateShader(s.stage);
+		glShaderSource(stage, 1, &src, NULL);
+		glCompileShader(stage);
+		p.stages.push_back(stage);
+		p.stage_types.push_back(s.stage);
+	}
+
+	p.program = glCreateProgram();
+	glProgramParameteri(p.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (auto stage : p.stages)
+	{
+		glAttachShader(p.program, stage);
+	}
+	glLinkProgram(p.program);
+
+	m_pending.push_back(p);
+	return p.program;
+}
+
+shader shader_batch::add(const std::string& name, const std::string& comp)
+{
+	return shader(add({ {GL_COMPUTE_SHADER, &comp} }, "", name));
+}
+
+shader shader_batch::add(const std::string& name, const std::string& vert, const std::string& frag)
+{
+	return shader(add({ {GL_VERTEX_SHADER, &vert}, {GL_FRAGMENT_SHADER, &frag} }, "", name));
+}
+
+shader shader_batch::add(const std::string& name, const std::string& vert, const std::string& geom, const std::string& frag)
+{
+	return shader(add({ {GL_VERTEX_SHADER, &vert}, {GL_GEOMETRY_SHADER, &geom}, {GL_FRAGMENT_SHADER, &frag} }, "", name));
+}
+
+bool shader_batch::wait()
+{
+	if (s_parallel_compile_supported)
+	{
+		bool all_complete = false;
+		while (!all_complete)
+		{
+			all_complete = true;
+			for (auto& p : m_pending)
+			{
+				if (p.from_cache)
+				{
+					continue;
+				}
+				int complete = 0;
+				glGetProgramiv(p.program, GL_COMPLETION_STATUS_KHR, &complete);
+				if (!complete)
+				{
+					all_complete = false;
+					break;
+				}
+			}
+			if (!all_complete)
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	bool success = true;
+	for (auto& p : m_pending)
+	{
+		if (p.from_cache)
+		{
+			continue;
+		}
+
+		int linked = 0;
+		glGetProgramiv(p.program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			success = false;
+			for (size_t i = 0; i < p.stages.size(); i++)
+			{
+				int compiled = 0;
+				glGetShaderiv(p.stages[i], GL_COMPILE_STATUS, &compiled);
+				if (!compiled)
+				{
+					std::cout << "ERROR::SHADER::COMPILATION_FAILED (" << p.name << " : " << get_stage_name(p.stage_types[i]) << ")\n"
+						<< shader::get_shader_info_log(p.stages[i]) << std::endl;
+				}
+			}
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED (" << p.name << ")\n" << shader::get_program_info_log(p.program) << std::endl;
+		}
+		else
+		{
+			shader_cache::store_program(p.cache_key, p.program);
+		}
+
+		for (auto stage : p.stages)
+		{
+			glDetachShader(p.program, stage);
+			glDeleteShader(stage);
+		}
+	}
+
+	m_pending.clear();
+	return success;
+}
+
+const char* shader_batch::get_stage_name(GLenum stage)
+{
+	switch (stage)
+	{
+		case GL_VERTEX_SHADER:
+			return "vertex";
+		case GL_GEOMETRY_SHADER:
+			return "geometry";
+		case GL_FRAGMENT_SHADER:
+			return "fragment";
+		case GL_COMPUTE_SHADER:
+			return "compute";
+		default:
+			return "unknown";
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "shader.h"
+
+// submits every stage compile + program link up front and only queries status once all
+// programs are done, so the driver can fan the work out over its compiler threads
+// (GL_KHR_parallel_shader_compile) instead of finishing each program serially
+class shader_batch
+{
+public:
+	shader_batch();
+
+	gl_handle	add(const std::vector<shader_cache::stage_source>& stages, const std::string& defines = "", const std::string& name = "");
+	shader		add(const std::string& name, const std::string& comp);
+	shader		add(const std::string& name, const std::string& vert, const std::string& frag);
+	shader		add(const std::string& name, const std::string& vert, const std::string& geom, const std::string& frag);
+
+	// blocks until every submitted program has finished, prints all errors, returns false if any failed
+	bool		wait();
+
+	inline static bool s_parallel_compile_supported = false;
+
+private:
+	struct pending_program
+	{
+		std::string					name;
+		u64							cache_key;
+		gl_handle					program;
+		std::vector<gl_handle>		stages;
+		std::vector<GLenum>			stage_types;
+		bool						from_cache;
+	};
+
+	std::vector<pending_program>	m_pending;
+
+	static const char*				get_stage_name(GLenum stage);
+};
@@ -0,0 +1,174 @@
+#include "shader_cache.h"
+#include "utils.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+static constexpr u32 k_cache_magic		= 0x42504C47; // "GLPB"
+static constexpr u32 k_cache_version	= 1;
+
+struct program_binary_header
+{
+	u32 magic;
+	u32 version;
+	u64 key;
+	u32 binary_format;
+	u32 binary_size;
+};
+
+u64 shader_cache::get_program_key(const std::vector<stage_source>& stages, const std::string& defines)
+{
+	const std::string& driver = get_driver_string();
+	u64 hash = utils::hash_fnv1a(driver.data(), driver.size());
+	hash = utils::hash_fnv1a(defines.data(), defines.size(), hash);
+
+	for (auto& s : stages)
+	{
+		// stage and length are folded in so identical text in different stages can't collide
+		u64 len = s.source->size();
+		hash = utils::hash_fnv1a(&s.stage, sizeof(GLenum), hash);
+		hash = utils::hash_fnv1a(&len, sizeof(u64), hash);
+		hash = utils::hash_fnv1a(s.source->data(), s.source->size(), hash);
+	}
+	return hash;
+}
+
+bool shader_cache::try_load_program(u64 key, gl_handle& out_program)
+{
+	if (!s_enabled || !is_supported())
+	{
+		return false;
+	}
+
+	const std::filesystem::path path = get_path(key);
+	std::ifstream in(path, std::ios::binary);
+	if (!in.is_open())
+	{
+		s_misses++;
+		return false;
+	}
+
+	program_binary_header header{};
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!in || header.magic != k_cache_magic || header.version != k_cache_version || header.key != key)
+	{
+		s_misses++;
+		return false;
+	}
+
+	// the binary is the rest of the file, a size that disagrees means a truncated or corrupt entry
+	std::error_code ec;
+	const std::uintmax_t file_size = std::filesystem::file_size(path, ec);
+	if (ec || file_size != sizeof(header) + (std::uintmax_t)header.binary_size)
+	{
+		in.close();
+		std::filesystem::remove(path, ec);
+		s_misses++;
+		return false;
+	}
+
+	std::vector<u8> binary(header.binary_size);
+	in.read(reinterpret_cast<char*>(binary.data()), binary.size());
+	if (!in)
+	{
+		s_misses++;
+		return false;
+	}
+
+	gl_handle prog_id = glCreateProgram();
+	glProgramBinary(prog_id, header.binary_format, binary.data(), (GLsizei)binary.size());
+
+	// drivers are free to reject binaries at any time (e.g. after an update that kept the version string)
+	int success = 0;
+	glGetProgramiv(prog_id, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(prog_id);
+		in.close();
+		std::filesystem::remove(path, ec);
+		s_misses++;
+		return false;
+	}
+
+	out_program = prog_id;
+	s_hits++;
+	return true;
+}
+
+void shader_cache::store_program(u64 key, gl_handle program)
+{
+	if (!s_enabled || !is_supported())
+	{
+		return;
+	}
+
+	int linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		return;
+	}
+
+	int binary_length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+	if (binary_length <= 0)
+	{
+		return;
+	}
+
+	std::vector<u8> binary(binary_length);
+	GLenum binary_format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, binary_length, &written, &binary_format, binary.data());
+	if (written <= 0)
+	{
+		return;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(s_cache_directory, ec);
+
+	std::ofstream out(get_path(key), std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		std::cerr << "Failed to write program binary cache entry : " << get_path(key) << std::endl;
+		return;
+	}
+
+	program_binary_header header{ k_cache_magic, k_cache_version, key, binary_format, (u32)written };
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(binary.data()), written);
+}
+
+bool shader_cache::is_supported()
+{
+	static int num_formats = -1;
+	if (num_formats < 0)
+	{
+		num_formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	}
+	return num_formats > 0;
+}
+
+const std::string& shader_cache::get_driver_string()
+{
+	static std::string driver;
+	if (driver.empty())
+	{
+		auto safe_str = [](GLenum name) {
+			const GLubyte* s = glGetString(name);
+			return s ? std::string(reinterpret_cast<const char*>(s)) : std::string();
+		};
+		driver = safe_str(GL_VENDOR) + "|" + safe_str(GL_RENDERER) + "|" + safe_str(GL_VERSION);
+	}
+	return driver;
+}
+
+std::string shader_cache::get_path(u64 key)
+{
+	std::stringstream path;
+	path << s_cache_directory << std::hex << key << ".bin";
+	return path.str();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "alias.h"
+
+// on-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary)
+// entries are keyed by every stage source, the define set and the driver identity
+// so a driver update or shader edit simply misses and falls back to compiling
+class shader_cache
+{
+public:
+	struct stage_source
+	{
+		GLenum				stage;
+		const std::string*	source;
+	};
+
+	static u64		get_program_key(const std::vector<stage_source>& stages, const std::string& defines = "");
+	static bool		try_load_program(u64 key, gl_handle& out_program);
+	static void		store_program(u64 key, gl_handle program);
+	static bool		is_supported();
+
+	inline static std::string	s_cache_directory = "shader_cache/";
+	inline static bool			s_enabled = true;
+
+	inline static u32			s_hits = 0;
+	inline static u32			s_misses = 0;
+
+private:
+	static const std::string&	get_driver_string();
+	static std::string			get_path(u64 key);
+};
@@ -0,0 +1,218 @@
+#include "shader_library.h"
+#include "shader_batch.h"
+#include "utils.h"
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+#include <iostream>
+
+static constexpr int k_max_include_depth = 16;
+
+shader_desc shader_desc::graphics(const std::string& vert, const std::string& frag, const shader_defines& defines)
+{
+	return { vert, "", frag, "", defines };
+}
+
+shader_desc shader_desc::graphics(const std::string& vert, const std::string& geom, const std::string& frag, const shader_defines& defines)
+{
+	return { vert, geom, frag, "", defines };
+}
+
+shader_desc shader_desc::compute(const std::string& comp, const shader_defines& defines)
+{
+	return { "", "", "", comp, defines };
+}
+
+static std::string trim_left(const std::string& line)
+{
+	size_t start = line.find_first_not_of(" \t");
+	return start == std::string::npos ? "" : line.substr(start);
+}
+
+static std::string normalise_path(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+std::string shader_library::preprocess(const std::string& path, const shader_defines& defines)
+{
+	std::string out;
+	std::vector<std::string> include_stack;
+	std::vector<std::string> included;
+	preprocess_file(normalise_path(s_shader_root + path), out, include_stack, included, get_define_string(defines));
+	return out;
+}
+
+std::string shader_library::get_define_string(const shader_defines& defines)
+{
+	std::stringstream block;
+	for (auto& [name, value] : defines)
+	{
+		block << "#define " << name << " " << value << "\n";
+	}
+	return block.str();
+}
+
+bool shader_library::preprocess_file(const std::string& full_path, std::string& out, std::vector<std::string>& include_stack, std::vector<std::string>& included, const std::string& define_block)
+{
+	if (include_stack.size() > k_max_include_depth)
+	{
+		std::cerr << "Shader include depth exceeded at : " << full_path << std::endl;
+		return false;
+	}
+
+	// every file is included once per stage, which doubles as an include guard
+	if (std::find(included.begin(), included.end(), full_path) != included.end())
+	{
+		return true;
+	}
+
+	std::string source = utils::load_string_from_path(full_path);
+	if (source.empty())
+	{
+		std::cerr << "Failed to load shader source at path : " << full_path << std::endl;
+		return false;
+	}
+
+	included.push_back(full_path);
+	include_stack.push_back(full_path);
+
+	const bool is_root = include_stack.size() == 1;
+	const u32 source_index = get_source_index(full_path);
+	const std::string directory = std::filesystem::path(full_path).parent_path().generic_string();
+	bool injected_defines = !is_root;
+
+	std::stringstream in(source);
+	std::string line;
+	int line_number = 0;
+	bool ok = true;
+
+	if (!is_root)
+	{
+		out += "#line 1 " + std::to_string(source_index) + "\n";
+	}
+
+	while (std::getline(in, line))
+	{
+		line_number++;
+		std::string trimmed = trim_left(line);
+
+		if (trimmed.rfind("#version", 0) == 0 && !injected_defines)
+		{
+			out += line + "\n" + define_block;
+			out += "#line " + std::to_string(line_number + 1) + " " + std::to_string(source_index) + "\n";
+			injected_defines = true;
+			continue;
+		}
+
+		if (trimmed.rfind("#include", 0) == 0)
+		{
+			size_t open = trimmed.find('"');
+			size_t close = trimmed.find('"', open + 1);
+			if (open == std::string::npos || close == std::string::npos)
+			{
+				std::cerr << "Malformed #include in " << full_path << " (" << line_number << ")" << std::endl;
+				ok = false;
+				continue;
+			}
+
+			std::string include_name = trimmed.substr(open + 1, close - open - 1);
+			std::string include_path = normalise_path(directory + "/" + include_name);
+			if (!std::filesystem::exists(include_path))
+			{
+				include_path = normalise_path(s_shader_root + include_name);
+			}
+
+			ok &= preprocess_file(include_path, out, include_stack, included, define_block);
+			out += "#line " + std::to_string(line_number + 1) + " " + std::to_string(source_index) + "\n";
+			continue;
+		}
+
+		out += line + "\n";
+	}
+
+	// no #version in the root file, defines still need to be visible
+	if (!injected_defines)
+	{
+		out = define_block + out;
+	}
+
+	include_stack.pop_back();
+	return ok;
+}
+
+shader& shader_library::get(const shader_desc& desc, shader_batch& batch)
+{
+	u64 key = get_permutation_key(desc);
+	auto it = s_permutations.find(key);
+	if (it != s_permutations.end())
+	{
+		return it->second;
+	}
+
+	std::string vert, geom, frag, comp;
+	std::vector<shader_cache::stage_source> stages;
+	std::string name;
+
+	if (!desc.comp_path.empty())
+	{
+		comp = preprocess(desc.comp_path, desc.defines);
+		stages.push_back({ GL_COMPUTE_SHADER, &comp });
+		name = desc.comp_path;
+	}
+	else
+	{
+		vert = preprocess(desc.vert_path, desc.defines);
+		stages.push_back({ GL_VERTEX_SHADER, &vert });
+		if (!desc.geom_path.empty())
+		{
+			geom = preprocess(desc.geom_path, desc.defines);
+			stages.push_back({ GL_GEOMETRY_SHADER, &geom });
+		}
+		frag = preprocess(desc.frag_path, desc.defines);
+		stages.push_back({ GL_FRAGMENT_SHADER, &frag });
+		name = desc.vert_path + " | " + desc.frag_path;
+	}
+
+	std::string define_string = get_define_string(desc.defines);
+	gl_handle program = batch.add(stages, define_string, name);
+	return s_permutations.emplace(key, shader(program)).first->second;
+}
+
+shader& shader_library::get(const shader_desc& desc)
+{
+	shader_batch batch;
+	shader& s = get(desc, batch);
+	batch.wait();
+	return s;
+}
+
+const std::string& shader_library::get_source_path(u32 source_index)
+{
+	static const std::string unknown = "unknown";
+	return source_index < s_source_paths.size() ? s_source_paths[source_index] : unknown;
+}
+
+u64 shader_library::get_permutation_key(const shader_desc& desc)
+{
+	u64 hash = utils::hash_fnv1a(desc.vert_path.data(), desc.vert_path.size());
+	hash = utils::hash_fnv1a("|", 1, hash);
+	hash = utils::hash_fnv1a(desc.geom_path.data(), desc.geom_path.size(), hash);
+	hash = utils::hash_fnv1a("|", 1, hash);
+	hash = utils::hash_fnv1a(desc.frag_path.data(), desc.frag_path.size(), hash);
+	hash = utils::hash_fnv1a("|", 1, hash);
+	hash = utils::hash_fnv1a(desc.comp_path.data(), desc.comp_path.size(), hash);
+	std::string define_string = get_define_string(desc.defines);
+	return utils::hash_fnv1a(define_string.data(), define_string.size(), hash);
+}
+
+u32 shader_library::get_source_index(const std::string& full_path)
+{
+	auto it = std::find(s_source_paths.begin(), s_source_paths.end(), full_path);
+	if (it != s_source_paths.end())
+	{
+		return (u32)(it - s_source_paths.begin());
+	}
+	s_source_paths.push_back(full_path);
+	return (u32)(s_source_paths.size() - 1);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "shader.h"
+
+class shader_batch;
+
+using shader_defines = std::map<std::string, std::string>;
+
+// describes one permutation of a program : stage files (relative to shader_library::s_shader_root) + define set
+struct shader_desc
+{
+	std::string		vert_path;
+	std::string		geom_path;
+	std::string		frag_path;
+	std::string		comp_path;
+	shader_defines	defines;
+
+	static shader_desc	graphics(const std::string& vert, const std::string& frag, const shader_defines& defines = {});
+	static shader_desc	graphics(const std::string& vert, const std::string& geom, const std::string& frag, const shader_defines& defines = {});
+	static shader_desc	compute(const std::string& comp, const shader_defines& defines = {});
+};
+
+class shader_library
+{
+public:
+	// loads a stage file, resolves #include "..." (relative to the including file, then s_shader_root)
+	// and injects the define set directly after #version
+	static std::string			preprocess(const std::string& path, const shader_defines& defines = {});
+	static std::string			get_define_string(const shader_defines& defines);
+
+	// each unique (files, defines) permutation is compiled once, later requests return the cached program
+	static shader&				get(const shader_desc& desc, shader_batch& batch);
+	static shader&				get(const shader_desc& desc);
+
+	// #line directives emitted by the preprocessor use this index as the source string number
+	static const std::string&	get_source_path(u32 source_index);
+
+	inline static std::string	s_shader_root = "assets/shaders/";
+
+private:
+	static u64					get_permutation_key(const shader_desc& desc);
+	static bool					preprocess_file(const std::string& full_path, std::string& out, std::vector<std::string>& include_stack, std::vector<std::string>& included, const std::string& define_block);
+	static u32					get_source_index(const std::string& full_path);
+
+	inline static std::unordered_map<u64, shader>	s_permutations;
+	inline static std::vector<std::string>			s_source_paths;
+};
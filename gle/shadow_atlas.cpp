@@ -0,0 +1,104 @@
+#include "shadow_atlas.h"
+#include <algorithm>
+
+void shadow_atlas::init(u32 size, u32 min_tile_size)
+{
+	m_size = size;
+	m_min_tile_size = std::min(min_tile_size, size);
+	m_used_texels = 0;
+	m_release_count++;
+	m_free.assign(get_level(m_min_tile_size) + 1, {});
+	m_free[0].push_back({ 0, 0, size });
+}
+
+u32 shadow_atlas::get_level(u32 size) const
+{
+	u32 level = 0;
+	for (u32 tile_size = m_size; tile_size / 2 >= size && tile_size > m_min_tile_size; tile_size /= 2)
+	{
+		level++;
+	}
+	return level;
+}
+
+bool shadow_atlas::allocate(u32 size, tile& out)
+{
+	const u32 level = get_level(std::max(size, m_min_tile_size));
+
+	// the smallest free tile that still fits
+	u32 source = level + 1;
+	for (u32 l = level + 1; l-- > 0;)
+	{
+		if (!m_free[l].empty())
+		{
+			source = l;
+			break;
+		}
+	}
+	if (source > level)
+	{
+		return false;
+	}
+
+	tile t = m_free[source].back();
+	m_free[source].pop_back();
+	for (u32 l = source; l < level; l++)
+	{
+		// keep the bottom left child, the other three become free tiles of the next level
+		const u32 half = t.size / 2;
+		m_free[l + 1].push_back({ t.x + half, t.y, half });
+		m_free[l + 1].push_back({ t.x, t.y + half, half });
+		m_free[l + 1].push_back({ t.x + half, t.y + half, half });
+		t.size = half;
+	}
+
+	m_used_texels += (u64)t.size * t.size;
+	out = t;
+	return true;
+}
+
+void shadow_atlas::release(const tile& t)
+{
+	m_used_texels -= (u64)t.size * t.size;
+	m_release_count++;
+	release_node(t, get_level(t.size));
+}
+
+void shadow_atlas::release_node(const tile& t, u32 level)
+{
+	std::vector<tile>& free_tiles = m_free[level];
+	if (level > 0)
+	{
+		const u32 parent_size = t.size * 2;
+		const tile parent = { t.x - t.x % parent_size, t.y - t.y % parent_size, parent_size };
+
+		// the three siblings, merge only once all of them are free
+		tile siblings[3];
+		u32 sibling_count = 0;
+		for (u32 child = 0; child < 4; child++)
+		{
+			u32 x = parent.x + (child & 1) * t.size;
+			u32 y = parent.y + (child >> 1) * t.size;
+			if (x != t.x || y != t.y)
+			{
+				siblings[sibling_count++] = { x, y, t.size };
+			}
+		}
+
+		bool mergeable = true;
+		for (const tile& sibling : siblings)
+		{
+			mergeable &= std::any_of(free_tiles.begin(), free_tiles.end(), [&](const tile& f) { return f.x == sibling.x && f.y == sibling.y; });
+		}
+		if (mergeable)
+		{
+			free_tiles.erase(std::remove_if(free_tiles.begin(), free_tiles.end(), [&](const tile& f)
+			{
+				return f.x >= parent.x && f.x < parent.x + parent_size && f.y >= parent.y && f.y < parent.y + parent_size;
+			}), free_tiles.end());
+			release_node(parent, level - 1);
+			return;
+		}
+	}
+	free_tiles.push_back(t);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include "alias.h"
+
+// quadtree allocator for a square shadow atlas. every node is a power of two tile aligned to its own size, a request
+// takes a free tile of its level or splits the smallest bigger free tile down to it (the other three children stay
+// free). releasing a tile whose three siblings are free merges them back into the parent, so freed space doesn't
+// stay cut into small tiles. only bookkeeping, the texture itself belongs to the user
+class shadow_atlas
+{
+public:
+	struct tile
+	{
+		u32	x = 0;
+		u32	y = 0;
+		u32	size = 0;
+	};
+
+	// both powers of two, min_tile_size <= size
+	void	init(u32 size, u32 min_tile_size);
+	// size is rounded up to a power of two in [min tile, atlas size], false when no tile that big is left
+	bool	allocate(u32 size, tile& out);
+	void	release(const tile& t);
+
+	u32		get_size() const { return m_size; }
+	u64		get_used_texels() const { return m_used_texels; }
+	// bumped by every release, a request that failed only has a chance again once it moved
+	u32		get_release_count() const { return m_release_count; }
+
+private:
+	// level 0 is the whole atlas, every level halves the tile size
+	u32		get_level(u32 size) const;
+	void	release_node(const tile& t, u32 level);
+
+	std::vector<std::vector<tile>>	m_free;
+	u32		m_size = 0;
+	u32		m_min_tile_size = 0;
+	u64		m_used_texels = 0;
+	u32		m_release_count = 0;
+};
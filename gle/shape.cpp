@@ -1,5 +1,42 @@
 #include "shape.h"
 
+void frustum::extract(const glm::mat4& view_proj)
+{
+    // glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 row_x = glm::vec4(view_proj[0][0], view_proj[1][0], view_proj[2][0], view_proj[3][0]);
+    glm::vec4 row_y = glm::vec4(view_proj[0][1], view_proj[1][1], view_proj[2][1], view_proj[3][1]);
+    glm::vec4 row_z = glm::vec4(view_proj[0][2], view_proj[1][2], view_proj[2][2], view_proj[3][2]);
+    glm::vec4 row_w = glm::vec4(view_proj[0][3], view_proj[1][3], view_proj[2][3], view_proj[3][3]);
+
+    m_planes[left] = row_w + row_x;
+    m_planes[right] = row_w - row_x;
+    m_planes[bottom] = row_w + row_y;
+    m_planes[top] = row_w - row_y;
+    m_planes[near_plane] = row_w + row_z;
+    m_planes[far_plane] = row_w - row_z;
+
+    for (glm::vec4& p : m_planes)
+    {
+        p /= glm::length(glm::vec3(p));
+    }
+}
+
+bool frustum::intersects(const aabb& box) const
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    for (const glm::vec4& p : m_planes)
+    {
+        glm::vec3 normal = glm::vec3(p);
+        float radius = glm::dot(glm::abs(normal), extent);
+        if (glm::dot(normal, center) + p.w < -radius)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 VAO shapes::gen_cube_instanced_vao(std::vector<glm::mat4>& matrices, std::vector<glm::vec3>& uvs)
 {
     //  Set up vertex attribute data and attribute pointers
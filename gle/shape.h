@@ -8,6 +8,27 @@ struct aabb
 	glm::vec3 max;
 };
 
+// planes point inwards, xyz = normal, w = distance. a point p is inside a plane when dot(xyz, p) + w >= 0
+struct frustum
+{
+	enum plane : u32
+	{
+		left	= 0,
+		right	= 1,
+		bottom	= 2,
+		top		= 3,
+		// not near / far, windows.h defines both
+		near_plane	= 4,
+		far_plane	= 5
+	};
+
+	glm::vec4 m_planes[6];
+
+	// gribb / hartmann extraction from a gl clip matrix (proj * view gives world space planes)
+	void	extract(const glm::mat4& view_proj);
+	bool	intersects(const aabb& box) const;
+};
+
 class shapes
 {
 public:
@@ -0,0 +1,116 @@
+#include "system_scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static bool shares_component(const std::vector<entt::id_type>& a, const std::vector<entt::id_type>& b)
+{
+	for (entt::id_type id : a)
+	{
+		if (std::find(b.begin(), b.end(), id) != b.end())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+system_scheduler::system_desc& system_scheduler::add(const std::string& name, system_fn fn)
+{
+	system_desc& desc = m_systems.emplace_back();
+	desc.m_name = name;
+	desc.m_fn = std::move(fn);
+	m_graph_dirty = true;
+	return desc;
+}
+
+void system_scheduler::build_graph()
+{
+	const u32 count = (u32)m_systems.size();
+	m_dependents.assign(count, {});
+	m_dependency_counts.assign(count, 0);
+	m_remaining = std::make_unique<std::atomic<u32>[]>(count);
+
+	for (u32 later = 0; later < count; later++)
+	{
+		const system_desc& b = m_systems[later];
+		for (u32 earlier = 0; earlier < later; earlier++)
+		{
+			const system_desc& a = m_systems[earlier];
+			bool conflict = shares_component(a.m_writes, b.m_writes)
+				|| shares_component(a.m_writes, b.m_reads)
+				|| shares_component(a.m_reads, b.m_writes)
+				|| std::find(b.m_after.begin(), b.m_after.end(), a.m_name) != b.m_after.end();
+
+			if (conflict)
+			{
+				m_dependents[earlier].push_back(later);
+				m_dependency_counts[later]++;
+			}
+		}
+	}
+
+	for (u32 i = 0; i < count; i++)
+	{
+		for (const std::string& name : m_systems[i].m_after)
+		{
+			auto it = std::find_if(m_systems.begin(), m_systems.end(), [&](const system_desc& other) { return other.m_name == name; });
+			if (it == m_systems.end() || (u32)(it - m_systems.begin()) >= i)
+			{
+				std::cerr << "system_scheduler : " << m_systems[i].m_name << " runs after " << name << " which isn't registered before it, ignoring it" << std::endl;
+			}
+		}
+	}
+	m_graph_dirty = false;
+}
+
+void system_scheduler::run(scene& current_scene)
+{
+	if (m_graph_dirty)
+	{
+		build_graph();
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	const u32 count = (u32)m_systems.size();
+	for (u32 i = 0; i < count; i++)
+	{
+		m_remaining[i].store(m_dependency_counts[i], std::memory_order_relaxed);
+	}
+
+	job_counter frame;
+	for (u32 i = 0; i < count; i++)
+	{
+		if (m_dependency_counts[i] == 0)
+		{
+			launch(i, current_scene, frame);
+		}
+	}
+	job_system::wait(frame);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	m_last_frame_ms = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void system_scheduler::launch(u32 index, scene& current_scene, job_counter& frame)
+{
+	system_desc& desc = m_systems[index];
+	job_system::run([this, index, &current_scene, &frame]()
+	{
+		system_desc& current = m_systems[index];
+		auto start = std::chrono::high_resolution_clock::now();
+		current.m_fn(current_scene);
+		auto end = std::chrono::high_resolution_clock::now();
+		current.m_last_ms = std::chrono::duration<float, std::milli>(end - start).count();
+
+		// dependents are counted on frame before this job retires, so the wait can't return early
+		for (u32 dependent : m_dependents[index])
+		{
+			if (m_remaining[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				launch(dependent, current_scene, frame);
+			}
+		}
+	}, &frame, desc.m_affinity);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "entt.hpp"
+#include "alias.h"
+#include "job_system.h"
+
+class scene;
+
+// runs the per frame systems of a scene on the job system. every system declares the components it reads
+// and writes, two systems conflict when one writes something the other touches. conflicting systems keep
+// their registration order, everything else runs in parallel
+class system_scheduler
+{
+public:
+	using system_fn = std::function<void(scene&)>;
+
+	class system_desc
+	{
+	public:
+		template<typename... _Ty>
+		system_desc&	reads()
+		{
+			(m_reads.push_back(entt::type_hash<_Ty>::value()), ...);
+			return *this;
+		}
+
+		template<typename... _Ty>
+		system_desc&	writes()
+		{
+			(m_writes.push_back(entt::type_hash<_Ty>::value()), ...);
+			return *this;
+		}
+
+		// the system makes gl calls, it is only ever run by the main thread
+		system_desc&	on_main_thread() { m_affinity = job_affinity::main_thread; return *this; }
+		// ordering for state that isn't a component (e.g. a static buffer both systems fill)
+		system_desc&	after(const std::string& system_name) { m_after.push_back(system_name); return *this; }
+
+		std::string					m_name;
+		system_fn					m_fn;
+		std::vector<entt::id_type>	m_reads;
+		std::vector<entt::id_type>	m_writes;
+		std::vector<std::string>	m_after;
+		job_affinity				m_affinity = job_affinity::any;
+		// cpu time of the last run
+		float						m_last_ms = 0.0f;
+	};
+
+	// the returned desc is only valid until the next add
+	system_desc&	add(const std::string& name, system_fn fn);
+	// runs every system once and returns when all of them finished, call from the main thread
+	void			run(scene& current_scene);
+
+	const std::vector<system_desc>&	get_systems() const { return m_systems; }
+	// wall time of the last run
+	float							get_last_frame_ms() const { return m_last_frame_ms; }
+
+	// splits the entities of view<_Components...> into grain_size chunks and calls fn(entity, components&...)
+	// on the workers. fn must only write to the components it is handed
+	template<typename... _Components, typename _Fn>
+	static void		parallel_each(entt::registry& registry, u32 grain_size, _Fn fn)
+	{
+		auto view = registry.view<_Components...>();
+		const entt::sparse_set* entities = view.handle();
+		if (entities == nullptr)
+		{
+			return;
+		}
+
+		job_system::parallel_for(0, (u32)entities->size(), grain_size, [&](u32 first, u32 last)
+		{
+			const entt::entity* packed = entities->data();
+			for (u32 i = first; i < last; i++)
+			{
+				if (view.contains(packed[i]))
+				{
+					fn(packed[i], view.template get<_Components>(packed[i])...);
+				}
+			}
+		});
+	}
+
+private:
+	// the graph only depends on the declared accesses, it's rebuilt when the set of systems changes
+	void			build_graph();
+	void			launch(u32 index, scene& current_scene, job_counter& frame);
+
+	std::vector<system_desc>					m_systems;
+	std::vector<std::vector<u32>>				m_dependents;
+	std::vector<u32>							m_dependency_counts;
+	std::unique_ptr<std::atomic<u32>[]>			m_remaining;
+	bool										m_graph_dirty = true;
+	float										m_last_frame_ms = 0.0f;
+};
@@ -1,28 +1,19 @@
 #include "tech/gbuffer.h"
-#include "camera.h"
+#include "tech/gpu_culling.h"
 #include "scene.h"
+#include "camera.h"
 #include "transform.h"
 #include "mesh.h"
 #include "material.h"
+#include "gl_state.h"
+#include <algorithm>
 
-void tech::gbuffer::dispatch_gbuffer(u32 frame_index, framebuffer& gbuffer, framebuffer& previous_position_buffer, shader& gbuffer_shader, camera& cam,  scene& current_scene, glm::ivec2 win_res)
+void tech::gbuffer::dispatch_gbuffer(framebuffer& gbuffer, framebuffer& previous_position_buffer, shader& gbuffer_shader, camera& cam, scene& current_scene)
 {
     gbuffer.bind();
-    glm::mat4 current_vp = cam.m_proj * cam.m_view;
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_CULL_FACE);
+    gl_state::enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
-    gbuffer_shader.use();
-    gbuffer_shader.set_vec2("u_resolution", { win_res.x, win_res.y });
-    gbuffer_shader.set_mat4("u_vp", current_vp);
-    gbuffer_shader.set_mat4("u_last_vp", cam.m_last_vp);
-    gbuffer_shader.set_int("u_frame_index", frame_index);
-    gbuffer_shader.set_int("u_diffuse_map", 0);
-    gbuffer_shader.set_int("u_normal_map", 1);
-    gbuffer_shader.set_int("u_metallic_map", 2);
-    gbuffer_shader.set_int("u_roughness_map", 3);
-    gbuffer_shader.set_int("u_ao_map", 4);
-    gbuffer_shader.set_int("u_prev_position_map", 5);
 
     texture::bind_sampler_handle(0, GL_TEXTURE0);
     texture::bind_sampler_handle(0, GL_TEXTURE1);
@@ -32,16 +23,158 @@ void tech::gbuffer::dispatch_gbuffer(u32 frame_index, framebuffer& gbuffer, fram
 
     texture::bind_sampler_handle(previous_position_buffer.m_colour_attachments.front(), GL_TEXTURE5);
 
-    auto renderables = current_scene.m_registry.view<transform, mesh, material>();
+    auto renderables = current_scene.m_registry.view<transform, mesh, material_handle>();
+
+    // world bounds are gathered in view order and culled 4 / 8 at a time, only the visible indices reach the queue
+    s_renderables.clear();
+    s_bounds.clear();
+    for (auto [e, trans, emesh, handle] : renderables.each())
+    {
+        s_renderables.push_back(e);
+        s_bounds.push(emesh.m_transformed_aabb);
+    }
+    s_visible.clear();
+    s_last_renderable_count = (u32)s_renderables.size();
+    s_last_occluded_count = 0;
+    s_last_occluder_triangles = 0;
+    // the gpu path culls every instance itself, so everything is recorded
+    const bool cull_on_gpu = gpu_culling::s_enabled && gpu_culling::is_initialised();
+    if (cull_on_gpu)
+    {
+        for (u32 i = 0; i < s_last_renderable_count; i++)
+        {
+            s_visible.push_back(i);
+        }
+    }
+    else
+    {
+        frustum_culling::cull(cam.m_frustum, s_bounds, s_visible);
+        if (s_occlusion_culling)
+        {
+            occlusion_cull(cam, current_scene);
+        }
+    }
+    s_last_visible_count = (u32)s_visible.size();
+
+    s_queue.clear();
+    for (u32 index : s_visible)
+    {
+        auto [trans, emesh, handle] = renderables.get(s_renderables[index]);
+        material& ematerial = material_registry::get(handle);
+        glm::vec3 center = trans.m_model * glm::vec4((emesh.m_original_aabb.min + emesh.m_original_aabb.max) * 0.5f, 1.0f);
+        float depth = glm::distance(cam.m_pos, center) / cam.m_far;
+        u64 key = render_queue::make_key(render_queue::gbuffer, ematerial.m_prog.m_shader_id, handle.m_index, render_queue::make_geometry_id(emesh.m_vao.m_vao_id, emesh.m_first_index), depth);
+        s_queue.push(key, &ematerial, &emesh, &trans, handle.m_index);
+    }
+    s_queue.sort();
+
+    // repeated mesh + material runs become instanced commands, every range sharing material state and vao
+    // goes out as a single multi draw
+    s_draws.clear();
+    s_draws.record(s_queue.m_packets, true);
+    s_draws.upload();
 
-    for (auto [e, trans, emesh, ematerial] : renderables.each())
+    if (!cull_on_gpu)
     {
-        ematerial.bind_material_uniforms();
-        gbuffer_shader.set_mat4("u_model", trans.m_model);
-        gbuffer_shader.set_mat4("u_last_model", trans.m_last_model);
-        gbuffer_shader.set_mat4("u_normal", trans.m_normal_matrix);
-        emesh.m_vao.use();
-        glDrawElements(GL_TRIANGLES, emesh.m_index_count, GL_UNSIGNED_INT, 0);
+        s_draws.bind();
+        submit_draws(gbuffer_shader);
+        gbuffer.unbind();
+        return;
     }
+
+    // phase 0 redraws last frame's visible set, its depth feeds the hi-z that phase 1 tests everything against
+    gpu_culling::prepare(s_draws, s_queue.m_packets);
+    gpu_culling::cull(0, cam.m_frustum);
+    gpu_culling::bind(0);
+    submit_draws(gbuffer_shader);
+    gbuffer.unbind();
+
+    gpu_culling::build_hiz(gbuffer.m_depth_attachment);
+    gpu_culling::cull(1, cam.m_frustum);
+
+    gbuffer.bind();
+    texture::bind_sampler_handle(previous_position_buffer.m_colour_attachments.front(), GL_TEXTURE5);
+    gpu_culling::bind(1);
+    submit_draws(gbuffer_shader);
     gbuffer.unbind();
+}
+
+void tech::gbuffer::submit_draws(shader& gbuffer_shader)
+{
+    set_pass_uniforms(gbuffer_shader);
+    gl_handle current_program = gbuffer_shader.m_shader_id;
+    for (indirect_draw_buffer::draw_range& range : s_draws.m_ranges)
+    {
+        draw_packet& packet = s_queue.m_packets[range.first_packet];
+        material& mat = *packet.mat;
+
+        // materials can reference different permutations of the gbuffer program
+        if (mat.m_prog.m_shader_id != current_program)
+        {
+            set_pass_uniforms(mat.m_prog);
+            current_program = mat.m_prog.m_shader_id;
+        }
+        mat.bind_material_uniforms();
+        packet.geometry->m_vao.use();
+        s_draws.draw(range.first_command, range.command_count);
+    }
+}
+
+void tech::gbuffer::occlusion_cull(camera& cam, scene& current_scene)
+{
+    // occluder score is the squared box size over squared distance, roughly its solid angle
+    s_occluder_candidates.clear();
+    for (u32 index : s_visible)
+    {
+        const mesh& emesh = current_scene.m_registry.get<mesh>(s_renderables[index]);
+        if (!emesh.m_geometry || emesh.m_geometry->m_indices.empty())
+        {
+            continue;
+        }
+        glm::vec3 size = emesh.m_transformed_aabb.max - emesh.m_transformed_aabb.min;
+        glm::vec3 center = (emesh.m_transformed_aabb.max + emesh.m_transformed_aabb.min) * 0.5f;
+        glm::vec3 to_center = center - cam.m_pos;
+        s_occluder_candidates.push_back({ glm::dot(size, size) / std::max(glm::dot(to_center, to_center), cam.m_near * cam.m_near), index });
+    }
+    if (s_occluder_candidates.empty())
+    {
+        return;
+    }
+    std::sort(s_occluder_candidates.begin(), s_occluder_candidates.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    s_occlusion.begin_frame(cam.m_proj * cam.m_view);
+    u32 occluders = 0;
+    for (auto& [score, index] : s_occluder_candidates)
+    {
+        if (occluders == s_max_occluders)
+        {
+            break;
+        }
+        auto [trans, emesh] = current_scene.m_registry.get<transform, mesh>(s_renderables[index]);
+        u32 triangle_count = (u32)emesh.m_geometry->m_indices.size() / 3;
+        if (s_last_occluder_triangles + triangle_count > s_occluder_triangle_budget)
+        {
+            continue;
+        }
+        s_occlusion.add_occluder(emesh.m_geometry->m_positions.data(), emesh.m_geometry->m_indices.data(), triangle_count, trans.m_model);
+        s_last_occluder_triangles += triangle_count;
+        occluders++;
+    }
+    if (occluders == 0)
+    {
+        return;
+    }
+    s_occlusion.rasterize();
+    s_last_occluded_count = s_occlusion.filter(s_bounds, s_visible);
+}
+
+void tech::gbuffer::set_pass_uniforms(shader& gbuffer_shader)
+{
+    gbuffer_shader.use();
+    gbuffer_shader.set_int("u_diffuse_map", 0);
+    gbuffer_shader.set_int("u_normal_map", 1);
+    gbuffer_shader.set_int("u_metallic_map", 2);
+    gbuffer_shader.set_int("u_roughness_map", 3);
+    gbuffer_shader.set_int("u_ao_map", 4);
+    gbuffer_shader.set_int("u_prev_position_map", 5);
 }
\ No newline at end of file
@@ -1,9 +1,14 @@
 #pragma once
 #include "shader.h"
 #include "framebuffer.h"
+#include "render_queue.h"
+#include "indirect_draw.h"
+#include "frustum_culling.h"
+#include "occlusion_culling.h"
+#include "entt.hpp"
 
-class camera;
 class scene;
+class camera;
 
 namespace tech
 {
@@ -11,6 +16,33 @@ namespace tech
 	{
 	public:
 
-		static void dispatch_gbuffer(u32 frame_index, framebuffer& gbuffer, framebuffer& previous_position_buffer, shader& gbuffer_shader,  camera& cam, scene& current_scene, glm::ivec2 win_res);
+		// camera matrices come from the frame_data block (see tech::utils::upload_frame_data), cam is only used for
+		// frustum / occlusion culling and depth sorting. with tech::gpu_culling initialised the draws are culled
+		// on the gpu instead, in two phases around a hi-z built from this pass' depth
+		static void dispatch_gbuffer(framebuffer& gbuffer, framebuffer& previous_position_buffer, shader& gbuffer_shader, camera& cam, scene& current_scene);
+
+		inline static u32	s_last_renderable_count = 0;
+		inline static u32	s_last_visible_count = 0;
+		inline static u32	s_last_occluded_count = 0;
+		inline static u32	s_last_occluder_triangles = 0;
+
+		// the largest on screen meshes that kept their cpu geometry are rasterised as occluders
+		inline static bool	s_occlusion_culling = true;
+		inline static u32	s_max_occluders = 16;
+		inline static u32	s_occluder_triangle_budget = 64 * 1024;
+
+	private:
+		static void set_pass_uniforms(shader& gbuffer_shader);
+		static void occlusion_cull(camera& cam, scene& current_scene);
+		// draws s_draws' ranges from whichever command / instance buffers are bound
+		static void submit_draws(shader& gbuffer_shader);
+
+		inline static std::vector<entt::entity>	s_renderables;
+		inline static aabb_soa				s_bounds;
+		inline static std::vector<u32>		s_visible;
+		inline static occlusion_culler		s_occlusion;
+		inline static std::vector<std::pair<float, u32>>	s_occluder_candidates;
+		inline static render_queue			s_queue;
+		inline static indirect_draw_buffer	s_draws;
 	};
 }
\ No newline at end of file
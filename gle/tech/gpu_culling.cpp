@@ -0,0 +1,154 @@
+#include "tech/gpu_culling.h"
+#include "gl.h"
+#include "gl_state.h"
+#include "mesh.h"
+#include "texture.h"
+#include "transform_buffer.h"
+#include <algorithm>
+#include <string>
+
+void tech::gpu_culling::init(shader& hiz_build, shader& cull, glm::ivec2 depth_size)
+{
+    s_hiz_shader = &hiz_build;
+    s_cull_shader = &cull;
+
+    // level 0 matches the depth attachment, every level halves (rounding down) until 1x1
+    s_hiz_size = depth_size;
+    s_hiz_levels = 1;
+    for (glm::ivec2 size = depth_size; size.x > 1 || size.y > 1; size = glm::max(size / 2, glm::ivec2(1)))
+    {
+        s_hiz_levels++;
+    }
+    if (s_hiz != 0)
+    {
+        glDeleteTextures(1, &s_hiz);
+    }
+    glGenTextures(1, &s_hiz);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, s_hiz);
+    glTexStorage2D(GL_TEXTURE_2D, s_hiz_levels, GL_R32F, depth_size.x, depth_size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (s_cull_instance_buffer == 0)
+    {
+        glGenBuffers(1, &s_cull_instance_buffer);
+        glGenBuffers(2, s_command_buffers);
+        glGenBuffers(2, s_output_instance_buffers);
+        glGenBuffers(1, &s_visibility_buffer);
+    }
+
+    // nothing was visible before the first frame, so phase 0 draws nothing and phase 1 tests everything
+    std::vector<u32> visibility(transform_buffer::get_max_transforms(), 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_visibility_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(u32) * visibility.size(), visibility.data(), GL_DYNAMIC_DRAW);
+}
+
+void tech::gpu_culling::prepare(const indirect_draw_buffer& draws, const std::vector<draw_packet>& packets)
+{
+    const std::vector<draw_elements_indirect_command>& commands = draws.get_commands();
+    const std::vector<instance_data>& instances = draws.get_instances();
+
+    // instance counts start at 0, the cull shader appends the survivors
+    s_commands.assign(commands.begin(), commands.end());
+    s_instances.resize(instances.size());
+    for (u32 c = 0; c < (u32)s_commands.size(); c++)
+    {
+        draw_elements_indirect_command& command = s_commands[c];
+        for (u32 i = command.base_instance; i < command.base_instance + command.instance_count; i++)
+        {
+            const aabb& bounds = packets[i].geometry->m_original_aabb;
+            s_instances[i] = { bounds.min, c, bounds.max, instances[i].transform_index, instances[i].material_index, {} };
+        }
+        command.instance_count = 0;
+    }
+
+    const u32 command_count = (u32)s_commands.size();
+    const u32 instance_count = (u32)s_instances.size();
+    if (command_count > s_command_capacity)
+    {
+        s_command_capacity = command_count + command_count / 2;
+    }
+    if (instance_count > s_instance_capacity)
+    {
+        s_instance_capacity = instance_count + instance_count / 2;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_cull_instance_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(cull_instance) * s_instance_capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(cull_instance) * instance_count, s_instances.data());
+    for (u32 phase = 0; phase < 2; phase++)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_command_buffers[phase]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(draw_elements_indirect_command) * s_command_capacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(draw_elements_indirect_command) * command_count, s_commands.data());
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_output_instance_buffers[phase]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(instance_data) * s_instance_capacity, nullptr, GL_STREAM_DRAW);
+    }
+}
+
+void tech::gpu_culling::cull(u32 phase, const frustum& view_frustum)
+{
+    const u32 instance_count = (u32)s_instances.size();
+    if (instance_count == 0)
+    {
+        return;
+    }
+
+    s_cull_shader->use();
+    s_cull_shader->set_int("u_phase", (int)phase);
+    s_cull_shader->set_uint("u_instance_count", instance_count);
+    s_cull_shader->set_int("u_hiz_levels", (int)s_hiz_levels);
+    s_cull_shader->set_ivec2("u_hiz_size", s_hiz_size);
+    for (u32 p = 0; p < 6; p++)
+    {
+        s_cull_shader->set_vec4("u_frustum_planes[" + std::to_string(p) + "]", view_frustum.m_planes[p]);
+    }
+    s_cull_shader->set_int("u_hiz", 0);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, s_hiz);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_cull_instance_binding, s_cull_instance_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_command_binding, s_command_buffers[phase]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_output_instance_binding, s_output_instance_buffers[phase]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_visibility_binding, s_visibility_buffer);
+
+    glAssert(glDispatchCompute((instance_count + s_group_size - 1) / s_group_size, 1, 1));
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void tech::gpu_culling::bind(u32 phase)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, s_command_buffers[phase]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, indirect_draw_buffer::s_instance_binding, s_output_instance_buffers[phase]);
+}
+
+void tech::gpu_culling::build_hiz(gl_handle depth_texture)
+{
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    s_hiz_shader->use();
+    s_hiz_shader->set_int("u_depth", 0);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, depth_texture);
+
+    glm::ivec2 source_size = s_hiz_size;
+    for (u32 level = 0; level < s_hiz_levels; level++)
+    {
+        glm::ivec2 size = level == 0 ? s_hiz_size : glm::max(source_size / 2, glm::ivec2(1));
+        // level 0 copies the depth attachment, the others reduce the level above
+        s_hiz_shader->set_bool("u_copy_depth", level == 0);
+        s_hiz_shader->set_ivec2("u_source_size", source_size);
+        s_hiz_shader->set_ivec2("u_destination_size", size);
+        if (level > 0)
+        {
+            glAssert(glBindImageTexture(0, s_hiz, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F));
+        }
+        glAssert(glBindImageTexture(1, s_hiz, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F));
+        glAssert(glDispatchCompute((size.x + 7) / 8, (size.y + 7) / 8, 1));
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        source_size = size;
+    }
+    texture::unbind_image(0);
+    texture::unbind_image(1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
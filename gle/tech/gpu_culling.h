@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include "shader.h"
+#include "shape.h"
+#include "render_queue.h"
+#include "indirect_draw.h"
+
+namespace tech
+{
+	// two phase gpu occlusion culling over the commands of an indirect_draw_buffer. phase 0 draws what was visible
+	// last frame (frustum tested), a hi-z pyramid is built from that depth, then phase 1 tests every instance against
+	// the frustum + hi-z, stores the result for next frame and draws the ones phase 0 missed (disoccluded).
+	// visibility is kept per transform_buffer slot, so it survives the per frame sort. the cpu only uploads the
+	// recorded commands, instance counts are filled by the cull shader and nothing is read back
+	class gpu_culling
+	{
+	public:
+		// std430 mirror of cull_instance in assets/shaders/gpu_cull.comp.glsl
+		struct cull_instance
+		{
+			glm::vec3	local_min;
+			u32			command_index;
+			glm::vec3	local_max;
+			u32			transform_index;
+			u32			material_index;
+			u32			pad[3];
+		};
+
+		inline static constexpr u32 s_cull_instance_binding = 2;
+		inline static constexpr u32 s_command_binding = 3;
+		inline static constexpr u32 s_output_instance_binding = 4;
+		inline static constexpr u32 s_visibility_binding = 5;
+		inline static constexpr u32 s_group_size = 64;
+
+		// hiz_build / cull are hiz_build.comp.glsl and gpu_cull.comp.glsl, depth_size is the depth attachment's
+		static void init(shader& hiz_build, shader& cull, glm::ivec2 depth_size);
+		static bool is_initialised() { return s_cull_shader != nullptr; }
+
+		// uploads cull inputs for draws, recorded from packets (one instance per packet, in order)
+		static void prepare(const indirect_draw_buffer& draws, const std::vector<draw_packet>& packets);
+		// fills the command + instance buffers of phase (0 or 1), phase 1 needs build_hiz first
+		static void cull(u32 phase, const frustum& view_frustum);
+		// binds phase's commands / instances in place of indirect_draw_buffer::bind, draw() offsets stay valid
+		static void bind(u32 phase);
+		static void build_hiz(gl_handle depth_texture);
+
+		inline static bool	s_enabled = true;
+
+	private:
+		inline static shader*		s_hiz_shader = nullptr;
+		inline static shader*		s_cull_shader = nullptr;
+		inline static gl_handle		s_hiz = 0;
+		inline static glm::ivec2	s_hiz_size = glm::ivec2(0);
+		inline static u32			s_hiz_levels = 0;
+
+		inline static std::vector<cull_instance>					s_instances;
+		inline static std::vector<draw_elements_indirect_command>	s_commands;
+		inline static gl_handle		s_cull_instance_buffer = 0;
+		inline static gl_handle		s_command_buffers[2] = {};
+		inline static gl_handle		s_output_instance_buffers[2] = {};
+		inline static gl_handle		s_visibility_buffer = 0;
+		inline static u32			s_command_capacity = 0;
+		inline static u32			s_instance_capacity = 0;
+	};
+}
+
+static_assert(sizeof(tech::gpu_culling::cull_instance) == 48, "cull_instance must match the std430 layout of cull_instance");
@@ -1,11 +1,11 @@
 #include "tech/lighting.h"
-#include <sstream>
 #include "framebuffer.h"
 #include "shape.h"
 #include "texture.h"
 #include "camera.h"
 #include "utils.h"
-void tech::lighting::dispatch_light_pass(shader& lighting_shader, framebuffer& lighting_buffer, framebuffer& gbuffer, framebuffer& dir_light_shadow_buffer, camera& cam, std::vector<point_light>& point_lights, dir_light& sun)
+#include "gl_state.h"
+void tech::lighting::dispatch_light_pass(shader& lighting_shader, framebuffer& lighting_buffer, framebuffer& gbuffer, gl_handle shadow_cascades, gl_handle point_shadow_atlas, camera& cam, std::vector<point_light>& point_lights, dir_light& sun)
 {
     lighting_buffer.bind();
     lighting_shader.use();
@@ -16,41 +16,44 @@ void tech::lighting::dispatch_light_pass(shader& lighting_shader, framebuffer& l
     lighting_shader.set_int("u_normal_map", 2);
     lighting_shader.set_int("u_pbr_map", 3);
     lighting_shader.set_int("u_dir_light_shadow_map", 4);
+    lighting_shader.set_int("u_point_shadow_atlas", 5);
 
-    lighting_shader.set_vec3("u_cam_pos", cam.m_pos);
-
-    lighting_shader.set_vec3("u_dir_light.direction", utils::get_forward(sun.direction));
-    lighting_shader.set_vec3("u_dir_light.colour", sun.colour);
-    lighting_shader.set_mat4("u_dir_light.light_space_matrix", sun.light_space_matrix);
-    lighting_shader.set_float("u_dir_light.intensity", sun.intensity);
-
-    int num_point_lights = std::min((int)point_lights.size(), 16);
-
-    for (int i = 0; i < num_point_lights; i++)
-    {
-        std::stringstream pos_name;
-        pos_name << "u_point_lights[" << i << "].position";
-        std::stringstream col_name;
-        col_name << "u_point_lights[" << i << "].colour";
-        std::stringstream rad_name;
-        rad_name << "u_point_lights[" << i << "].radius";
-        std::stringstream int_name;
-        int_name << "u_point_lights[" << i << "].intensity";
-
-        lighting_shader.set_vec3(pos_name.str(), point_lights[i].position);
-        lighting_shader.set_vec3(col_name.str(), point_lights[i].colour);
-        lighting_shader.set_float(rad_name.str(), point_lights[i].radius);
-        lighting_shader.set_float(int_name.str(), point_lights[i].intensity);
-    }
+    upload_light_data(point_lights, sun, cam);
 
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[0], GL_TEXTURE0);
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[1], GL_TEXTURE1);
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[2], GL_TEXTURE2);
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[3], GL_TEXTURE3);
-    texture::bind_sampler_handle(dir_light_shadow_buffer.m_depth_attachment, GL_TEXTURE4);
+    gl_state::bind_texture(GL_TEXTURE4, GL_TEXTURE_2D_ARRAY, shadow_cascades);
+    gl_state::bind_texture(GL_TEXTURE5, GL_TEXTURE_2D, point_shadow_atlas);
 
     // bind all maps
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
     lighting_buffer.unbind();
 
 }
+
+void tech::lighting::upload_light_data(std::vector<point_light>& point_lights, dir_light& sun, camera& cam)
+{
+    light_block block{};
+    block.dir_light.direction = utils::get_forward(sun.direction);
+    block.dir_light.colour = sun.colour;
+    block.dir_light.intensity = sun.intensity;
+    block.dir_light.light_space_matrix = sun.light_space_matrix;
+    for (u32 c = 0; c < dir_light::s_max_cascades; c++)
+    {
+        block.cascade_matrices[c] = sun.cascade_matrices[c];
+    }
+    block.cascade_splits = sun.cascade_splits;
+    block.cascade_count = (int)sun.cascade_count;
+
+    s_clusters.build(cam.m_view, cam.m_proj, cam.m_near, cam.m_far, point_lights);
+    s_clusters.upload(point_lights);
+
+    block.point_light_count = (int)point_lights.size();
+    block.cluster_slice_scale = s_clusters.get_slice_scale();
+    block.cluster_slice_bias = s_clusters.get_slice_bias();
+    block.cluster_grid = glm::ivec3(light_clusters::s_tiles_x, light_clusters::s_tiles_y, light_clusters::s_slices);
+
+    uniform_ring_buffer::push_and_bind(uniform_ring_buffer::lights, block);
+}
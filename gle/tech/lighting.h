@@ -2,6 +2,8 @@
 #include <vector>
 #include "lights.h"
 #include "shader.h"
+#include "uniform_buffer.h"
+#include "light_clusters.h"
 class framebuffer;
 class camera;
 
@@ -10,7 +12,13 @@ namespace tech
 	class lighting
 	{
 	public:
+		// clusters the point lights against cam, then uploads and binds the light_data block and the light
+		// storage buffers. must run after the shadow pass has set the cascades
+		static void upload_light_data(std::vector<point_light>& point_lights, dir_light& sun, camera& cam);
+		// shadow_cascades is the GL_TEXTURE_2D_ARRAY from tech::shadow::get_cascade_texture, point_shadow_atlas the
+		// tech::point_shadow atlas (shadow indices of point lights must already be set)
+		static void dispatch_light_pass(shader& lighting_shader, framebuffer& lighting_buffer, framebuffer& gbuffer, gl_handle shadow_cascades, gl_handle point_shadow_atlas, camera& cam, std::vector<point_light>& point_lights, dir_light& sun);
 
-		static void dispatch_light_pass(shader& lighting_shader, framebuffer& lighting_buffer, framebuffer& gbuffer, framebuffer& dir_light_shadow_buffer, camera& cam, std::vector<point_light>& point_lights, dir_light& sun);
+		inline static light_clusters	s_clusters;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,361 @@
+#include "tech/point_shadow.h"
+#include "scene.h"
+#include "gtc/matrix_transform.hpp"
+#include "transform.h"
+#include "mesh.h"
+#include "material.h"
+#include "gl_state.h"
+#include "camera.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+
+void tech::point_shadow::dispatch_point_shadow_pass(shader& shadow_shader, std::vector<point_light>& lights, camera& cam, scene& current_scene, glm::ivec2 window_res)
+{
+    ensure_atlas();
+
+    // lights past the end of a shrunk list give their tiles back
+    for (u32 i = (u32)lights.size(); i < (u32)s_lights.size(); i++)
+    {
+        release_tiles(s_lights[i]);
+    }
+    s_lights.resize(lights.size());
+
+    // where the casters that moved this frame were and are : a caster leaving a light's radius has to redraw it
+    // as much as one entering, or its old shadow stays behind
+    s_changed_bounds.clear();
+    auto renderables = current_scene.m_registry.view<transform, mesh, material_handle>();
+    for (auto [e, trans, emesh, handle] : renderables.each())
+    {
+        if (trans.m_changed)
+        {
+            s_changed_bounds.push_back(utils::transform_aabb_arvo(emesh.m_original_aabb, trans.m_last_model));
+            s_changed_bounds.push_back(emesh.m_transformed_aabb);
+        }
+    }
+    // added or removed casters aren't tracked by position, every light redraws
+    const bool casters_changed = &current_scene != s_cached_scene || current_scene.m_renderables_version != s_cached_renderables_version;
+    s_cached_scene = &current_scene;
+    s_cached_renderables_version = current_scene.m_renderables_version;
+
+    // only lights reaching the view need shadows, ranked by how many pixels they cover
+    const float pixels_per_unit = cam.m_proj[1][1] * (float)window_res.y * 0.5f;
+    s_candidates.clear();
+    for (u32 i = 0; i < (u32)lights.size(); i++)
+    {
+        point_light& light = lights[i];
+        light.shadow_index = -1;
+        aabb sphere_bounds = { light.position - glm::vec3(light.radius), light.position + glm::vec3(light.radius) };
+        if (!light.cast_shadows || light.radius <= 0.0f || !cam.m_frustum.intersects(sphere_bounds))
+        {
+            continue;
+        }
+        float distance = glm::distance(light.position, cam.m_pos);
+        float coverage = distance <= light.radius ? (float)window_res.y : light.radius / std::sqrt(distance * distance - light.radius * light.radius) * pixels_per_unit;
+        float importance = coverage * light.intensity * std::max(light.colour.r, std::max(light.colour.g, light.colour.b));
+        s_candidates.push_back({ i, coverage, importance, 0 });
+    }
+    std::sort(s_candidates.begin(), s_candidates.end(), [](const candidate& a, const candidate& b) { return a.importance > b.importance; });
+    if (s_candidates.size() > s_max_shadowed_lights)
+    {
+        s_candidates.resize(s_max_shadowed_lights);
+    }
+
+    s_kept.assign(lights.size(), 0);
+    for (const candidate& c : s_candidates)
+    {
+        s_kept[c.light] = 1;
+    }
+    for (u32 i = 0; i < (u32)s_lights.size(); i++)
+    {
+        if (!s_kept[i])
+        {
+            release_tiles(s_lights[i]);
+        }
+    }
+
+    // shrink first so a shrinking light frees space before anyone allocates. shrinking waits until the light
+    // wants a quarter of its size, a light hovering around a power of two doesn't flip every frame
+    for (candidate& c : s_candidates)
+    {
+        point_shadow_light& state = s_lights[c.light];
+        u32 wanted = s_min_tile_size;
+        while (wanted < s_max_tile_size && (float)wanted < c.coverage * s_resolution_scale)
+        {
+            wanted *= 2;
+        }
+        if (state.m_tile_size != 0 && wanted * 4 <= state.m_tile_size)
+        {
+            release_tiles(state);
+        }
+        c.wanted = wanted;
+    }
+
+    // allocation in importance order, a light that doesn't fit tries smaller tiles before giving up. a light
+    // that wants to grow keeps its tiles until the bigger ones are granted, and once that failed it only tries
+    // again when it wants another size or something was freed, so a full atlas doesn't redraw it every frame
+    for (const candidate& c : s_candidates)
+    {
+        point_shadow_light& state = s_lights[c.light];
+        const bool retry = c.wanted != state.m_wanted_size || s_allocator.get_release_count() != s_attempt_release_count;
+        state.m_wanted_size = c.wanted;
+
+        shadow_atlas::tile tiles[6];
+        u32 size = 0;
+        if (state.m_tile_size == 0)
+        {
+            if (!allocate_tiles(c.wanted, s_min_tile_size, tiles, size))
+            {
+                continue;
+            }
+        }
+        else if (c.wanted <= state.m_tile_size || !retry || !allocate_tiles(c.wanted, state.m_tile_size * 2, tiles, size))
+        {
+            continue;
+        }
+
+        release_tiles(state);
+        std::copy(tiles, tiles + 6, state.m_tiles);
+        state.m_tile_size = size;
+    }
+    s_attempt_release_count = s_allocator.get_release_count();
+
+    // cache : a light only needs a redraw when it moved or a caster inside its radius did
+    for (const candidate& c : s_candidates)
+    {
+        point_shadow_light& state = s_lights[c.light];
+        const point_light& light = lights[c.light];
+        if (state.m_tile_size == 0 || state.m_dirty)
+        {
+            continue;
+        }
+        state.m_dirty = casters_changed || light.position != state.m_rendered_position || light.radius != state.m_rendered_radius;
+        for (u32 b = 0; b < (u32)s_changed_bounds.size() && !state.m_dirty; b++)
+        {
+            glm::vec3 closest = glm::clamp(light.position, s_changed_bounds[b].min, s_changed_bounds[b].max);
+            state.m_dirty = glm::distance(closest, light.position) <= light.radius;
+        }
+    }
+
+    // update budget : lights without any depth yet first, then stale ones, both by importance
+    u32 face_budget = s_max_face_updates;
+    s_last_rendered_faces = 0;
+    s_last_pending_lights = 0;
+    bool state_set = false;
+    for (u32 pass = 0; pass < 2; pass++)
+    {
+        for (const candidate& c : s_candidates)
+        {
+            point_shadow_light& state = s_lights[c.light];
+            if (state.m_tile_size == 0 || !state.m_dirty || state.m_rendered != (pass == 1))
+            {
+                continue;
+            }
+            if (face_budget < 6)
+            {
+                s_last_pending_lights++;
+                continue;
+            }
+            if (!state_set)
+            {
+                gl_state::bind_framebuffer(s_framebuffer);
+                gl_state::enable(GL_CULL_FACE);
+                gl_state::enable(GL_SCISSOR_TEST);
+                glCullFace(GL_FRONT);
+                shadow_shader.use();
+                state_set = true;
+            }
+            render_light(state, lights[c.light], shadow_shader, current_scene);
+            face_budget -= 6;
+            s_last_rendered_faces += 6;
+        }
+    }
+    if (state_set)
+    {
+        gl_state::bind_framebuffer(0);
+        gl_state::disable(GL_SCISSOR_TEST);
+        gl_state::disable(GL_CULL_FACE);
+        gl_state::viewport(0, 0, window_res.x, window_res.y);
+    }
+
+    // every light with depth in the atlas is shadowed, stale ones with the matrices they were drawn with
+    s_blocks.clear();
+    const float texel = 1.0f / (float)s_allocated_size;
+    for (const candidate& c : s_candidates)
+    {
+        point_shadow_light& state = s_lights[c.light];
+        if (!state.m_rendered)
+        {
+            continue;
+        }
+        point_shadow_block block;
+        face_matrices(state.m_rendered_position, state.m_rendered_radius, block.face_matrices);
+        for (u32 f = 0; f < 6; f++)
+        {
+            const shadow_atlas::tile& t = state.m_tiles[f];
+            block.face_tiles[f] = glm::vec4((float)t.x, (float)t.y, (float)t.size, (float)t.size) * texel;
+        }
+        lights[c.light].shadow_index = (i32)s_blocks.size();
+        s_blocks.push_back(block);
+    }
+    s_last_shadowed_lights = (u32)s_blocks.size();
+
+    // re-specifying orphans last frame's copy, an empty list still gets one element so the binding is valid
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_block_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(point_shadow_block) * std::max<size_t>(s_blocks.size(), 1), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(point_shadow_block) * s_blocks.size(), s_blocks.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, s_binding, s_block_buffer);
+}
+
+void tech::point_shadow::render_light(point_shadow_light& state, const point_light& light, shader& shadow_shader, scene& current_scene)
+{
+    glm::mat4 matrices[6];
+    face_matrices(light.position, light.radius, matrices);
+
+    // only casters the spatial index finds inside the light's radius are culled against its faces
+    s_casters.clear();
+    s_bounds.clear();
+    s_nearby.clear();
+    current_scene.query_sphere(light.position, light.radius, s_nearby);
+    for (entt::entity e : s_nearby)
+    {
+        if (current_scene.m_registry.all_of<transform, material_handle>(e))
+        {
+            s_casters.push_back(e);
+            s_bounds.push(current_scene.m_registry.get<mesh>(e).m_transformed_aabb);
+        }
+    }
+
+    for (u32 f = 0; f < 6; f++)
+    {
+        const shadow_atlas::tile& t = state.m_tiles[f];
+        gl_state::viewport((i32)t.x, (i32)t.y, (i32)t.size, (i32)t.size);
+        // the clear has to stay inside the tile
+        glScissor((i32)t.x, (i32)t.y, (i32)t.size, (i32)t.size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        frustum face_frustum;
+        face_frustum.extract(matrices[f]);
+        s_visible.clear();
+        frustum_culling::cull(face_frustum, s_bounds, s_visible);
+        if (s_visible.empty())
+        {
+            continue;
+        }
+
+        // depth only, so material is irrelevant : group by geometry then front to back from the light
+        s_queue.clear();
+        for (u32 index : s_visible)
+        {
+            auto [trans, emesh, handle] = current_scene.m_registry.get<transform, mesh, material_handle>(s_casters[index]);
+            glm::vec3 center = trans.m_model * glm::vec4((emesh.m_original_aabb.min + emesh.m_original_aabb.max) * 0.5f, 1.0f);
+            float depth = glm::clamp(glm::distance(light.position, center) / light.radius, 0.0f, 1.0f);
+            u64 key = render_queue::make_key(render_queue::shadow, shadow_shader.m_shader_id, 0, render_queue::make_geometry_id(emesh.m_vao.m_vao_id, emesh.m_first_index), depth);
+            s_queue.push(key, &material_registry::get(handle), &emesh, &trans, handle.m_index);
+        }
+        s_queue.sort();
+
+        s_draws.clear();
+        s_draws.record(s_queue.m_packets, false);
+        s_draws.upload();
+        s_draws.bind();
+
+        shadow_shader.set_mat4("lightSpaceMatrix", matrices[f]);
+        for (indirect_draw_buffer::draw_range& range : s_draws.m_ranges)
+        {
+            s_queue.m_packets[range.first_packet].geometry->m_vao.use();
+            s_draws.draw(range.first_command, range.command_count);
+        }
+    }
+
+    state.m_rendered_position = light.position;
+    state.m_rendered_radius = light.radius;
+    state.m_rendered = true;
+    state.m_dirty = false;
+}
+
+void tech::point_shadow::face_matrices(glm::vec3 position, float radius, glm::mat4* out)
+{
+    static const glm::vec3 directions[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+    static const glm::vec3 ups[6] = { {0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0} };
+
+    // 90 degrees per face, the far plane is the light's radius
+    glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, s_near_plane, std::max(radius, s_near_plane * 2.0f));
+    for (u32 f = 0; f < 6; f++)
+    {
+        out[f] = proj * glm::lookAt(position, position + directions[f], ups[f]);
+    }
+}
+
+bool tech::point_shadow::allocate_tiles(u32 max_size, u32 min_size, shadow_atlas::tile* tiles, u32& size)
+{
+    for (size = max_size; size >= min_size; size /= 2)
+    {
+        u32 face = 0;
+        while (face < 6 && s_allocator.allocate(size, tiles[face]))
+        {
+            face++;
+        }
+        if (face == 6)
+        {
+            return true;
+        }
+        for (u32 f = 0; f < face; f++)
+        {
+            s_allocator.release(tiles[f]);
+        }
+    }
+    return false;
+}
+
+void tech::point_shadow::release_tiles(point_shadow_light& state)
+{
+    if (state.m_tiles[0].size != 0)
+    {
+        for (shadow_atlas::tile& t : state.m_tiles)
+        {
+            s_allocator.release(t);
+            t = {};
+        }
+    }
+    state.m_tile_size = 0;
+    state.m_rendered = false;
+    state.m_dirty = true;
+}
+
+void tech::point_shadow::ensure_atlas()
+{
+    if (s_atlas != 0 && s_allocated_size == s_atlas_size)
+    {
+        return;
+    }
+
+    if (s_atlas != 0)
+    {
+        glDeleteTextures(1, &s_atlas);
+    }
+    if (s_framebuffer == 0)
+    {
+        glGenFramebuffers(1, &s_framebuffer);
+        glGenBuffers(1, &s_block_buffer);
+    }
+
+    glGenTextures(1, &s_atlas);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, s_atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, s_atlas_size, s_atlas_size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    gl_state::bind_framebuffer(s_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, s_atlas, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    gl_state::bind_framebuffer(0);
+
+    // every tile points into the old atlas
+    s_allocator.init(s_atlas_size, s_min_tile_size);
+    s_allocated_size = s_atlas_size;
+    s_lights.clear();
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include "shader.h"
+#include "lights.h"
+#include "shape.h"
+#include "render_queue.h"
+#include "indirect_draw.h"
+#include "frustum_culling.h"
+#include "shadow_atlas.h"
+#include "entt.hpp"
+class scene;
+struct camera;
+
+namespace tech
+{
+	// per light state of tech::point_shadow, indexed like the light list
+	struct point_shadow_light
+	{
+		// m_tile_size == 0 : no tiles. m_wanted_size is what the light asked for last frame, m_tile_size is
+		// smaller when the atlas was too full to grant it
+		shadow_atlas::tile	m_tiles[6];
+		u32					m_tile_size = 0;
+		u32					m_wanted_size = 0;
+		// the tiles hold depth rendered from here, used for lookups until the next render even if the light moved
+		glm::vec3			m_rendered_position = glm::vec3(0.0f);
+		float				m_rendered_radius = 0.0f;
+		bool				m_rendered = false;
+		bool				m_dirty = true;
+	};
+
+	// point light shadows in one depth atlas. every shadowed light gets six cube face tiles sized by its screen
+	// coverage, cut from the atlas by a quadtree allocator, so memory is the atlas no matter how many lights cast
+	// shadows. faces are only redrawn when the light or a caster inside its radius changed, and at most
+	// s_max_face_updates faces are drawn per frame (lights waiting for their first render go first)
+	class point_shadow
+	{
+	public:
+		// std430 mirror of PointShadow in assets/shaders/common/light_data.glsl
+		struct point_shadow_block
+		{
+			// world -> face clip space, faces are +x -x +y -y +z -z
+			glm::mat4	face_matrices[6];
+			// xy = atlas uv of the tile's corner, zw = its uv size
+			glm::vec4	face_tiles[6];
+		};
+
+		inline static constexpr u32 s_binding = 9;
+
+		// sets shadow_index on every light (-1 when unshadowed), run before the lighting pass uploads the lights
+		static void dispatch_point_shadow_pass(shader& shadow_shader, std::vector<point_light>& lights, camera& cam, scene& current_scene, glm::ivec2 window_res);
+		// GL_TEXTURE_2D depth atlas
+		static gl_handle get_atlas_texture() { return s_atlas; }
+
+		// settings, atlas size changes reallocate and redraw everything
+		inline static u32	s_atlas_size = 4096;
+		inline static u32	s_min_tile_size = 64;
+		inline static u32	s_max_tile_size = 512;
+		// face size = projected light radius in pixels * s_resolution_scale, rounded up to a power of two
+		inline static float	s_resolution_scale = 0.5f;
+		inline static u32	s_max_shadowed_lights = 32;
+		inline static u32	s_max_face_updates = 24;
+		inline static float	s_near_plane = 0.05f;
+
+		inline static u32	s_last_shadowed_lights = 0;
+		inline static u32	s_last_rendered_faces = 0;
+		inline static u32	s_last_pending_lights = 0;
+
+		static u64 get_used_texels() { return s_allocator.get_used_texels(); }
+
+	private:
+		struct candidate
+		{
+			u32		light;
+			float	coverage;
+			float	importance;
+			// tile size from coverage, power of two in [s_min_tile_size, s_max_tile_size]
+			u32		wanted;
+		};
+
+		static void ensure_atlas();
+		static void release_tiles(point_shadow_light& state);
+		// six tiles of the biggest size in [min_size, max_size] that fits, false leaves tiles untouched
+		static bool allocate_tiles(u32 max_size, u32 min_size, shadow_atlas::tile* tiles, u32& size);
+		static void face_matrices(glm::vec3 position, float radius, glm::mat4* out);
+		static void render_light(point_shadow_light& state, const point_light& light, shader& shadow_shader, scene& current_scene);
+
+		inline static shadow_atlas			s_allocator;
+		inline static render_queue			s_queue;
+		inline static indirect_draw_buffer	s_draws;
+
+		inline static std::vector<point_shadow_light>	s_lights;
+		inline static std::vector<candidate>			s_candidates;
+		inline static std::vector<point_shadow_block>	s_blocks;
+		// casters near the light being rendered, from scene::query_sphere
+		inline static std::vector<entt::entity>			s_nearby;
+		inline static std::vector<entt::entity>			s_casters;
+		inline static aabb_soa							s_bounds;
+		inline static std::vector<aabb>					s_changed_bounds;
+		inline static std::vector<u32>					s_visible;
+		inline static std::vector<u8>					s_kept;
+
+		inline static gl_handle	s_atlas = 0;
+		inline static gl_handle	s_framebuffer = 0;
+		inline static gl_handle	s_block_buffer = 0;
+		inline static u32		s_allocated_size = 0;
+		// the scene and renderables version the cached depth was drawn against
+		inline static const scene*	s_cached_scene = nullptr;
+		inline static u32		s_cached_renderables_version = 0;
+		// allocator release count after the last allocation round, a light that couldn't grow only retries once it moved
+		inline static u32		s_attempt_release_count = 0;
+	};
+}
@@ -1,47 +1,313 @@
 #include "tech/shadow.h"
-#include "framebuffer.h"
 #include "scene.h"
 #include "gtc/matrix_transform.hpp"
 #include "gtc/quaternion.hpp"
 #include "transform.h"
 #include "mesh.h"
 #include "material.h"
+#include "gl_state.h"
+#include "camera.h"
+#include <algorithm>
 
-void tech::shadow::dispatch_shadow_pass(framebuffer& shadow_fb, shader& shadow_shader, dir_light& sun, scene& current_scene, glm::ivec2 window_res)
+void tech::shadow::dispatch_shadow_pass(shader& shadow_shader, dir_light& sun, camera& cam, scene& current_scene, glm::ivec2 window_res)
 {
-    float near_plane = 0.01f, far_plane = 1000.0f;
-    glm::mat4 lightProjection = glm::ortho(-200.0f, 200.0f, -200.0f, 200.0f, near_plane, far_plane);
+    ensure_targets();
+    s_frame++;
 
-    glm::vec3 dir = glm::quat(glm::radians(sun.direction)) * glm::vec3(0.0f, 0.0f, 1.0f);
+    const u32 cascade_count = s_allocated_count;
+    const glm::vec3 light_dir = glm::normalize(glm::quat(glm::radians(sun.direction)) * glm::vec3(0.0f, 0.0f, 1.0f));
 
-    glm::vec3 lightPos = glm::vec3(0.0) - (dir * 100.0f);
-    glm::mat4 lightView = glm::lookAt(lightPos,
-        glm::vec3(0.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 lightSpaceMatrix = lightProjection * lightView;
+    // any moved static caster (or one added / removed) invalidates every cascade's cache
+    bool static_dirty = false;
+    s_static_casters.clear();
+    s_dynamic_casters.clear();
+    s_static_bounds.clear();
+    s_dynamic_bounds.clear();
+    auto renderables = current_scene.m_registry.view<transform, mesh, material_handle>();
+    for (auto [e, trans, emesh, handle] : renderables.each())
+    {
+        if (current_scene.m_registry.all_of<dynamic_shadow_caster>(e))
+        {
+            s_dynamic_casters.push_back(e);
+            s_dynamic_bounds.push(emesh.m_transformed_aabb);
+            continue;
+        }
+        s_static_casters.push_back(e);
+        s_static_bounds.push(emesh.m_transformed_aabb);
+        static_dirty |= trans.m_changed;
+    }
+    // the count also catches casters switching between static and dynamic, the version an add and a remove in one frame
+    static_dirty |= (u32)s_static_casters.size() != s_cached_static_count;
+    static_dirty |= &current_scene != s_cached_scene || current_scene.m_renderables_version != s_cached_renderables_version;
+    s_cached_static_count = (u32)s_static_casters.size();
+    s_cached_scene = &current_scene;
+    s_cached_renderables_version = current_scene.m_renderables_version;
+    // a far cascade skipping this frame still has to redraw on its next refresh, the change is only seen now
+    if (static_dirty)
+    {
+        invalidate_cache();
+    }
+
+    const bool has_dynamic = !s_dynamic_casters.empty();
+    if (has_dynamic && s_cache == 0)
+    {
+        glGenTextures(1, &s_cache);
+        gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, s_cache);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, s_allocated_resolution, s_allocated_resolution, cascade_count);
+        invalidate_cache();
+    }
+    // without a cache texture the cascade layers hold the static casters themselves
+    const gl_handle static_target = s_cache != 0 ? s_cache : s_cascades;
+
+    // practical split scheme, blending uniform and logarithmic splits
+    const float split_min = cam.m_near;
+    const float split_max = std::min(cam.m_far, s_max_distance);
+    float split_near = split_min;
+
+    bool state_set = false;
+    s_static_redrawn_last_frame = false;
+    for (u32 c = 0; c < cascade_count; c++)
+    {
+        shadow_cascade& state = s_cascade_state[c];
+        float fraction = (float)(c + 1) / (float)cascade_count;
+        float split_far = glm::mix(split_min + (split_max - split_min) * fraction, split_min * std::pow(split_max / split_min, fraction), s_split_lambda);
+
+        // far cascades refresh at a lower rate, staggered so they don't all land on the same frame
+        bool refresh = !state.m_valid || c < s_full_rate_cascades || s_far_cascade_interval <= 1 || (s_frame + c) % s_far_cascade_interval == 0;
+        if (refresh)
+        {
+            state.m_light_space = fit_cascade(cam, light_dir, split_near, split_far);
+            state.m_split = split_far;
+            state.m_valid = true;
+            state.m_receivers = receiver_frustum(cam, light_dir, split_near, split_far);
+            state.m_receiver_view = s_receiver_culling ? cam.m_view : glm::mat4(0.0f);
+        }
+        split_near = split_far;
+        sun.cascade_matrices[c] = state.m_light_space;
+        sun.cascade_splits[c] = state.m_split;
+
+        // the receiver volume turns with the camera while the light matrix doesn't, so it's part of the cache key
+        bool static_redraw = !state.m_cache_valid || state.m_light_space != state.m_cached_light_space || state.m_receiver_view != state.m_cached_receiver_view;
+        if (!refresh || (!static_redraw && !has_dynamic && !state.m_target_dirty))
+        {
+            continue;
+        }
+
+        if (!state_set)
+        {
+            gl_state::bind_framebuffer(s_framebuffer);
+            gl_state::viewport(0, 0, s_allocated_resolution, s_allocated_resolution);
+            gl_state::enable(GL_CULL_FACE);
+            // casters between the light and the cascade are flattened onto its near plane instead of clipped
+            gl_state::enable(GL_DEPTH_CLAMP);
+            glCullFace(GL_FRONT);
+            shadow_shader.use();
+            state_set = true;
+        }
+        shadow_shader.set_mat4("lightSpaceMatrix", state.m_light_space);
+
+        frustum light_frustum;
+        light_frustum.extract(state.m_light_space);
+        light_frustum.m_planes[frustum::near_plane] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+        if (static_redraw)
+        {
+            s_visible.clear();
+            frustum_culling::cull(light_frustum, s_static_bounds, s_visible);
+            state.m_receiver_culled = (u32)s_visible.size();
+            if (s_receiver_culling)
+            {
+                frustum_culling::refine(state.m_receivers, s_static_bounds, s_visible);
+            }
+            state.m_receiver_culled -= (u32)s_visible.size();
+            draw_casters(static_target, c, s_static_casters, s_visible, shadow_shader, current_scene, state.m_light_space, true);
+            state.m_cached_light_space = state.m_light_space;
+            state.m_cached_receiver_view = state.m_receiver_view;
+            state.m_cache_valid = true;
+            state.m_static_casters = (u32)s_visible.size();
+            s_static_redrawn_last_frame = true;
+        }
+        s_last_cascade_casters[c] = state.m_static_casters;
+        s_last_cascade_receiver_culled[c] = state.m_receiver_culled;
+
+        // dynamic casters go over a copy so the cache itself stays static only
+        if (s_cache != 0)
+        {
+            glCopyImageSubData(s_cache, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c, s_cascades, GL_TEXTURE_2D_ARRAY, 0, 0, 0, c, s_allocated_resolution, s_allocated_resolution, 1);
+            if (has_dynamic)
+            {
+                s_visible.clear();
+                frustum_culling::cull(light_frustum, s_dynamic_bounds, s_visible);
+                u32 light_visible = (u32)s_visible.size();
+                if (s_receiver_culling)
+                {
+                    frustum_culling::refine(state.m_receivers, s_dynamic_bounds, s_visible);
+                }
+                s_last_cascade_receiver_culled[c] += light_visible - (u32)s_visible.size();
+                draw_casters(s_cascades, c, s_dynamic_casters, s_visible, shadow_shader, current_scene, state.m_light_space, false);
+                s_last_cascade_casters[c] += (u32)s_visible.size();
+            }
+            state.m_target_dirty = has_dynamic;
+        }
+    }
+    s_static_redraw_count += s_static_redrawn_last_frame ? 1 : 0;
+
+    sun.cascade_count = cascade_count;
+    sun.light_space_matrix = sun.cascade_matrices[0];
+
+    if (state_set)
+    {
+        gl_state::bind_framebuffer(0);
+        gl_state::disable(GL_DEPTH_CLAMP);
+        gl_state::disable(GL_CULL_FACE);
+        gl_state::viewport(0, 0, window_res.x, window_res.y);
+    }
+}
+
+frustum tech::shadow::receiver_frustum(camera& cam, glm::vec3 light_dir, float split_near, float split_far)
+{
+    // the camera's side planes closed at the slice depths, the near plane normal is the view direction
+    frustum slice = cam.m_frustum;
+    glm::vec3 forward = glm::vec3(slice.m_planes[frustum::near_plane]);
+    slice.m_planes[frustum::near_plane] = glm::vec4(forward, -glm::dot(forward, cam.m_pos) - split_near);
+    slice.m_planes[frustum::far_plane] = glm::vec4(-forward, glm::dot(forward, cam.m_pos) + split_far);
+
+    // a caster shadows the slice if it's inside once swept along the light. sliding along light_dir only
+    // moves a box further behind the planes facing away from the light, every other plane can't reject it.
+    // (without the silhouette planes this is conservative)
+    for (glm::vec4& p : slice.m_planes)
+    {
+        if (glm::dot(glm::vec3(p), light_dir) > 0.0f)
+        {
+            p = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+    return slice;
+}
+
+glm::mat4 tech::shadow::fit_cascade(camera& cam, glm::vec3 light_dir, float split_near, float split_far)
+{
+    // slice corners : the camera frustum's edges cut at both split depths, view depth is linear along an edge
+    const glm::mat4 inverse_view_proj = glm::inverse(cam.m_proj * cam.m_view);
+    const float t_near = (split_near - cam.m_near) / (cam.m_far - cam.m_near);
+    const float t_far = (split_far - cam.m_near) / (cam.m_far - cam.m_near);
+    glm::vec3 corners[8];
+    glm::vec3 center = glm::vec3(0.0f);
+    for (u32 i = 0; i < 4; i++)
+    {
+        glm::vec2 ndc = glm::vec2(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f);
+        glm::vec4 edge_near = inverse_view_proj * glm::vec4(ndc, -1.0f, 1.0f);
+        glm::vec4 edge_far = inverse_view_proj * glm::vec4(ndc, 1.0f, 1.0f);
+        glm::vec3 from = glm::vec3(edge_near) / edge_near.w;
+        glm::vec3 to = glm::vec3(edge_far) / edge_far.w;
+        corners[i * 2] = glm::mix(from, to, t_near);
+        corners[i * 2 + 1] = glm::mix(from, to, t_far);
+        center += corners[i * 2] + corners[i * 2 + 1];
+    }
+    center /= 8.0f;
+
+    // a bounding sphere doesn't change size as the camera turns, so neither does the texel footprint
+    float radius = 0.0f;
+    for (const glm::vec3& corner : corners)
+    {
+        radius = std::max(radius, glm::distance(corner, center));
+    }
+    radius = std::ceil(radius * 16.0f) / 16.0f;
 
-    sun.light_space_matrix = lightSpaceMatrix;
+    glm::vec3 up = std::abs(light_dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(center - light_dir * radius, center, up);
+    glm::mat4 proj = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
 
-    shadow_fb.bind();
-    glClear(GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, shadow_fb.m_width, shadow_fb.m_height);
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
-    shadow_shader.use();
-    shadow_shader.set_mat4("lightSpaceMatrix", lightSpaceMatrix);
+    // move the projection by less than a texel so the world origin lands on a texel corner, the grid then
+    // stays put while the camera translates
+    glm::vec4 origin = proj * view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec2 texel_origin = glm::vec2(origin) * (float)s_allocated_resolution * 0.5f;
+    glm::vec2 offset = (glm::round(texel_origin) - texel_origin) * 2.0f / (float)s_allocated_resolution;
+    proj[3][0] += offset.x;
+    proj[3][1] += offset.y;
+    return proj * view;
+}
 
-    auto renderables = current_scene.m_registry.view<transform, mesh, material>();
+void tech::shadow::draw_casters(gl_handle texture, u32 layer, const std::vector<entt::entity>& casters, const std::vector<u32>& visible, shader& shadow_shader, scene& current_scene, const glm::mat4& light_space, bool clear)
+{
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+    if (clear)
+    {
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // depth only, so material is irrelevant : group by geometry then front to back along the light.
+    // the key depth is the cascade's own ndc depth, casters clamped onto the near plane sort first
+    s_queue.clear();
+    for (u32 index : visible)
+    {
+        auto [trans, emesh, handle] = current_scene.m_registry.get<transform, mesh, material_handle>(casters[index]);
+        glm::vec3 center = trans.m_model * glm::vec4((emesh.m_original_aabb.min + emesh.m_original_aabb.max) * 0.5f, 1.0f);
+        float depth = glm::clamp((light_space * glm::vec4(center, 1.0f)).z * 0.5f + 0.5f, 0.0f, 1.0f);
+        u64 key = render_queue::make_key(render_queue::shadow, shadow_shader.m_shader_id, 0, render_queue::make_geometry_id(emesh.m_vao.m_vao_id, emesh.m_first_index), depth);
+        s_queue.push(key, &material_registry::get(handle), &emesh, &trans, handle.m_index);
+    }
+    s_queue.sort();
+
+    // material is ignored, so every copy of a mesh is one instanced command and every geometry heap one multi draw
+    s_draws.clear();
+    s_draws.record(s_queue.m_packets, false);
+    s_draws.upload();
+    s_draws.bind();
+
+    for (indirect_draw_buffer::draw_range& range : s_draws.m_ranges)
+    {
+        s_queue.m_packets[range.first_packet].geometry->m_vao.use();
+        s_draws.draw(range.first_command, range.command_count);
+    }
+}
 
-    for (auto [e, trans, emesh, ematerial] : renderables.each())
+void tech::shadow::ensure_targets()
+{
+    const u32 cascade_count = std::clamp(s_cascade_count, 1u, dir_light::s_max_cascades);
+    if (s_cascades != 0 && cascade_count == s_allocated_count && s_resolution == s_allocated_resolution)
     {
-        shadow_shader.set_mat4("model", trans.m_model);
-        emesh.draw();
+        return;
     }
 
+    if (s_cascades != 0)
+    {
+        glDeleteTextures(1, &s_cascades);
+    }
+    if (s_cache != 0)
+    {
+        glDeleteTextures(1, &s_cache);
+        s_cache = 0;
+    }
+    if (s_framebuffer == 0)
+    {
+        glGenFramebuffers(1, &s_framebuffer);
+        gl_state::bind_framebuffer(s_framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        gl_state::bind_framebuffer(0);
+    }
 
-    shadow_fb.unbind();
-    glDisable(GL_CULL_FACE);
-    glViewport(0, 0, window_res.x, window_res.y);
+    glGenTextures(1, &s_cascades);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, s_cascades);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, s_resolution, s_resolution, cascade_count);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
+    s_allocated_count = cascade_count;
+    s_allocated_resolution = s_resolution;
+    for (shadow_cascade& state : s_cascade_state)
+    {
+        state = shadow_cascade{};
+    }
 }
 
+void tech::shadow::invalidate_cache()
+{
+    for (shadow_cascade& state : s_cascade_state)
+    {
+        state.m_cache_valid = false;
+    }
+}
@@ -1,14 +1,100 @@
 #pragma once
 #include "shader.h"
 #include "lights.h"
-class framebuffer;
+#include "shape.h"
+#include "render_queue.h"
+#include "indirect_draw.h"
+#include "frustum_culling.h"
+#include "entt.hpp"
 class scene;
+class camera;
+
+// tag : the entity is drawn into the shadow map every frame instead of being baked into the static cache,
+// for anything that moves often. untagged casters still work when moved, they just invalidate the cache
+struct dynamic_shadow_caster {};
 
 namespace tech
 {
+	// per cascade state of tech::shadow
+	struct shadow_cascade
+	{
+		glm::mat4	m_light_space = glm::mat4(1.0f);
+		float		m_split = 0.0f;
+		bool		m_valid = false;
+		// static casters in the cache layer were drawn with this matrix
+		glm::mat4	m_cached_light_space = glm::mat4(0.0f);
+		bool		m_cache_valid = false;
+		u32			m_static_casters = 0;
+		u32			m_receiver_culled = 0;
+		// casters outside this (the slice extruded along the light) can't shadow anything the camera sees
+		frustum		m_receivers = {};
+		// camera view the receivers were built from, zero when receiver culling is off
+		glm::mat4	m_receiver_view = glm::mat4(0.0f);
+		glm::mat4	m_cached_receiver_view = glm::mat4(0.0f);
+		// the target layer holds dynamic casters from last frame
+		bool		m_target_dirty = false;
+	};
+
+	// cascaded directional shadows. the view frustum up to s_max_distance is split (blend of log and uniform
+	// splits), every cascade is an ortho projection around the bounding sphere of its slice, snapped to whole
+	// texels so it doesn't shimmer while the camera moves. cascades are layers of one depth texture array and
+	// only draw the casters inside their own light space frustum that can also shadow the camera's slice
 	class shadow
 	{
 	public:
-		static void dispatch_shadow_pass(framebuffer& shadow_fb, shader& shadow_shader, dir_light& sun, scene& current_scene, glm::ivec2 window_res);
+		// static casters of each cascade are cached and only redrawn when its matrix, the static caster set or one
+		// of their transforms changes. dynamic casters are drawn over a copy of the cache each frame, with neither
+		// a cascade does no work at all. fills sun.cascade_* for the lighting pass
+		static void dispatch_shadow_pass(shader& shadow_shader, dir_light& sun, camera& cam, scene& current_scene, glm::ivec2 window_res);
+		// forces the static casters to be redrawn next frame
+		static void invalidate_cache();
+
+		// GL_TEXTURE_2D_ARRAY, a layer per cascade
+		static gl_handle get_cascade_texture() { return s_cascades; }
+
+		// settings, changes are picked up on the next dispatch
+		inline static u32	s_cascade_count = 4;
+		inline static u32	s_resolution = 1024;
+		inline static float	s_max_distance = 150.0f;
+		// 0 = uniform splits, 1 = logarithmic
+		inline static float	s_split_lambda = 0.75f;
+		// cascades from s_full_rate_cascades on are refreshed every s_far_cascade_interval frames (staggered)
+		inline static u32	s_full_rate_cascades = 2;
+		inline static u32	s_far_cascade_interval = 1;
+		// also cull casters that can't shadow the camera's view of their cascade's slice
+		inline static bool	s_receiver_culling = true;
+
+		inline static u32	s_static_redraw_count = 0;
+		inline static bool	s_static_redrawn_last_frame = false;
+		inline static u32	s_last_cascade_casters[dir_light::s_max_cascades] = {};
+		inline static u32	s_last_cascade_receiver_culled[dir_light::s_max_cascades] = {};
+
+	private:
+		static void ensure_targets();
+		static frustum receiver_frustum(camera& cam, glm::vec3 light_dir, float split_near, float split_far);
+		static glm::mat4 fit_cascade(camera& cam, glm::vec3 light_dir, float split_near, float split_far);
+		// draws casters[i] for every i in visible into layer of texture
+		static void draw_casters(gl_handle texture, u32 layer, const std::vector<entt::entity>& casters, const std::vector<u32>& visible, shader& shadow_shader, scene& current_scene, const glm::mat4& light_space, bool clear);
+
+		inline static render_queue			s_queue;
+		inline static indirect_draw_buffer	s_draws;
+
+		inline static std::vector<entt::entity>	s_static_casters;
+		inline static std::vector<entt::entity>	s_dynamic_casters;
+		inline static aabb_soa					s_static_bounds;
+		inline static aabb_soa					s_dynamic_bounds;
+		inline static std::vector<u32>			s_visible;
+
+		inline static shadow_cascade	s_cascade_state[dir_light::s_max_cascades];
+		inline static gl_handle		s_cascades = 0;
+		// static casters only, allocated once dynamic casters show up
+		inline static gl_handle		s_cache = 0;
+		inline static gl_handle		s_framebuffer = 0;
+		inline static u32			s_allocated_count = 0;
+		inline static u32			s_allocated_resolution = 0;
+		inline static u32			s_cached_static_count = 0;
+		inline static const scene*	s_cached_scene = nullptr;
+		inline static u32			s_cached_renderables_version = 0;
+		inline static u32			s_frame = 0;
 	};
-}
\ No newline at end of file
+}
@@ -3,6 +3,9 @@
 #include "shape.h"
 #include "texture.h"
 #include "framebuffer.h"
+#include "camera.h"
+#include "uniform_buffer.h"
+#include "gl.h"
 
 void tech::utils::dispatch_denoise_image(shader& denoise_shader, framebuffer& input, framebuffer& denoised, float aSigma, float aThreshold, float aKSigma, glm::ivec2 window_res)
 {
@@ -36,3 +39,16 @@ void tech::utils::blit_to_fb(framebuffer& fb, shader& present_shader, const std:
     fb.unbind();
 }
 
+void tech::utils::upload_frame_data(camera& cam, u32 frame_index, glm::ivec2 resolution)
+{
+    frame_block block{};
+    block.vp = cam.m_proj * cam.m_view;
+    block.last_vp = cam.m_last_vp;
+    block.view = cam.m_view;
+    block.proj = cam.m_proj;
+    block.cam_pos = cam.m_pos;
+    block.delta_time = engine::get_frame_time();
+    block.resolution = resolution;
+    block.frame_index = (i32)frame_index;
+    uniform_ring_buffer::push_and_bind(uniform_ring_buffer::frame, block);
+}
@@ -4,6 +4,7 @@
 #include "glm.hpp"
 class shader;
 class framebuffer;
+class camera;
 
 namespace tech
 {
@@ -12,6 +13,8 @@ namespace tech
 	public:
 		static void dispatch_denoise_image(shader& denoise_shader, framebuffer& input, framebuffer& denoised, float aSigma, float aThreshold, float aKSigma, glm::ivec2 window_res);
 		static void dispatch_present_image(shader& present_shader, const std::string& uniform_name, const int texture_slot, gl_handle texture);
+		// uploads and binds the frame_data block, call once per frame after the camera update
+		static void upload_frame_data(camera& cam, u32 frame_index, glm::ivec2 resolution);
 		static void blit_to_fb(framebuffer& fb, shader& present_shader, const std::string& uniform_name, const int texture_slot, gl_handle texture);
 	};
 }
\ No newline at end of file
@@ -1,13 +1,24 @@
 #include "tech/vxgi.h"
 #include "gl.h"
-#include "camera.h"
+#include "gl_state.h"
+#include "uniform_buffer.h"
+
+void tech::vxgi::upload_vxgi_data(aabb& bounding_volume, glm::vec3 voxel_resolution, glm::ivec2 input_resolution, float max_trace_distance, float diffuse_spec_mix)
+{
+    vxgi_block block{};
+    block.aabb_min = bounding_volume.min;
+    block.aabb_max = bounding_volume.max;
+    block.voxel_resolution = voxel_resolution;
+    block.max_trace_distance = max_trace_distance;
+    block.input_resolution = input_resolution;
+    block.diffuse_spec_mix = diffuse_spec_mix;
+    uniform_ring_buffer::push_and_bind(uniform_ring_buffer::pass, block);
+}
 
 void tech::vxgi::dispatch_gbuffer_voxelization(shader& voxelization, aabb& volume_bounding_box, voxel::grid& voxel_data, framebuffer& gbuffer, framebuffer& lightpass_buffer, glm::ivec2 window_res)
 {
     voxelization.use();
-    voxelization.set_vec2("u_input_resolution", { window_res.x, window_res.y });
-    voxelization.set_vec3("u_aabb.min", volume_bounding_box.min);
-    voxelization.set_vec3("u_aabb.max", volume_bounding_box.max);
+    upload_vxgi_data(volume_bounding_box, voxel_data.resolution, window_res);
     texture::bind_image_handle(voxel_data.voxel_texture.m_handle, 0, 0, GL_RGBA32F);
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[1], GL_TEXTURE0);
     texture::bind_sampler_handle(lightpass_buffer.m_colour_attachments[0], GL_TEXTURE1);
@@ -24,7 +35,7 @@ void tech::vxgi::dispatch_gen_voxel_mips(shader& voxelization_mips, voxel::grid&
     glm::vec3 current_mip_resolution = _3d_tex_res_vec / 2.0f;
     for (int i = 1; i < MAX_MIPS; i++)
     {
-        glBindTexture(GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
+        gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
         texture::bind_image_handle(voxel_data.voxel_texture.m_handle, 0, i, GL_RGBA32F);
         texture::bind_image_handle(voxel_data.voxel_texture.m_handle, 1, i - 1, GL_RGBA32F);
         voxelization_mips.set_vec3("u_current_resolution", current_mip_resolution);
@@ -38,21 +49,16 @@ void tech::vxgi::dispatch_gen_voxel_mips(shader& voxelization_mips, voxel::grid&
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
-void tech::vxgi::dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::grid& voxel_data, framebuffer& buffer_conetracing, framebuffer& gbuffer, glm::ivec2 window_res, aabb& bounding_volume, glm::vec3 _3d_tex_res, camera& cam, float max_trace_distance, float resolution_scale, float diffuse_spec_mix)
+void tech::vxgi::dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::grid& voxel_data, framebuffer& buffer_conetracing, framebuffer& gbuffer, glm::ivec2 window_res, aabb& bounding_volume, glm::vec3 _3d_tex_res, float max_trace_distance, float resolution_scale, float diffuse_spec_mix)
 {
-    glBindTexture(GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
+    gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_3D, voxel_data.voxel_texture.m_handle);
 
-    glViewport(0, 0, window_res.x* resolution_scale, window_res.y* resolution_scale);
+    gl_state::viewport(0, 0, window_res.x* resolution_scale, window_res.y* resolution_scale);
     shapes::s_screen_quad.use();
     buffer_conetracing.bind();
     voxel_cone_tracing.use();
-    voxel_cone_tracing.set_vec3("u_aabb.min", bounding_volume.min);
-    voxel_cone_tracing.set_vec3("u_aabb.max", bounding_volume.max);
-    voxel_cone_tracing.set_vec3("u_voxel_resolution", _3d_tex_res);
+    upload_vxgi_data(bounding_volume, _3d_tex_res, window_res, max_trace_distance, diffuse_spec_mix);
     voxel_cone_tracing.set_int("u_position_map", 0);
-    voxel_cone_tracing.set_vec3("u_cam_position", cam.m_pos);
-    voxel_cone_tracing.set_float("u_max_trace_distance", max_trace_distance);
-    voxel_cone_tracing.set_float("u_diffuse_spec_mix", diffuse_spec_mix);
 
     texture::bind_sampler_handle(gbuffer.m_colour_attachments[1], GL_TEXTURE0);
     voxel_cone_tracing.set_int("u_normal_map", 1);
@@ -64,5 +70,5 @@ void tech::vxgi::dispatch_cone_tracing_pass(shader& voxel_cone_tracing, voxel::g
     texture::bind_sampler_handle(0, GL_TEXTURE0);
     texture::bind_sampler_handle(0, GL_TEXTURE1);
     texture::bind_sampler_handle(0, GL_TEXTURE2);
-    glViewport(0, 0, window_res.x, window_res.y);
+    gl_state::viewport(0, 0, window_res.x, window_res.y);
 }
\ No newline at end of file
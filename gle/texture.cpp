@@ -3,6 +3,7 @@
 #include <iostream>
 #include "GL/glew.h"
 #include "gl.h"
+#include "gl_state.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "utils.h"
@@ -64,7 +65,7 @@ texture::texture(const std::string& path)
 		m_height = dds_tex.extent().y;
 
 		glGenTextures(1, &m_handle);
-		glBindTexture(target, m_handle);
+		gl_state::bind_texture(GL_TEXTURE0, target, m_handle);
 		glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
 		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(dds_tex.levels() - 1));
 		glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, &format.Swizzles[0]);
@@ -94,7 +95,7 @@ texture::texture(const std::string& path)
 			return;
 		}
 		glGenTextures(1, &m_handle);
-		glBindTexture(GL_TEXTURE_2D, m_handle);
+		gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, m_handle);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -119,8 +120,7 @@ void texture::bind_sampler(GLenum texture_slot, GLenum texture_target)
 
 void texture::bind_sampler_handle(gl_handle handle, GLenum texture_slot, GLenum texture_target)
 {
-	glAssert(glActiveTexture(texture_slot));
-	glAssert(glBindTexture(texture_target, handle));
+	gl_state::bind_texture(texture_slot, texture_target, handle);
 }
 
 void texture::bind_image_handle(gl_handle handle, uint32_t binding, uint32_t mip_level, GLenum format)
@@ -138,7 +138,7 @@ texture texture::from_data(unsigned int* data, unsigned int count, int width, in
 {
 	texture t{};
 	glGenTextures(1, &t.m_handle);
-	glBindTexture(GL_TEXTURE_2D, t.m_handle);
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_2D, t.m_handle);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -155,7 +155,7 @@ texture texture::create_3d_texture(glm::ivec3 dim, GLenum format, GLenum pixel_f
 {
 	texture t{};
 	glAssert(glGenTextures(1, &t.m_handle));
-	glAssert(glBindTexture(GL_TEXTURE_3D, t.m_handle));
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_3D, t.m_handle);
 
 	glAssert(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap_mode));
 	glAssert(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap_mode));
@@ -174,7 +174,7 @@ texture texture::create_3d_texture_empty(glm::ivec3 dim, GLenum format, GLenum p
 {
 	texture t{};
 	glAssert(glGenTextures(1, &t.m_handle));
-	glAssert(glBindTexture(GL_TEXTURE_3D, t.m_handle));
+	gl_state::bind_texture(GL_TEXTURE0, GL_TEXTURE_3D, t.m_handle);
 
 	glAssert(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap_mode));
 	glAssert(glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap_mode));
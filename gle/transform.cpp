@@ -1,16 +1,210 @@
 #include "transform.h"
 #include "scene.h"
 #include "utils.h"
+#include "transform_buffer.h"
+#include "transform_kernel.h"
+#include "job_system.h"
+#include "system_scheduler.h"
+#include "mesh.h"
+#include <iostream>
 
+bool transform::set_parent(scene& current_scene, entt::entity child, entt::entity parent)
+{
+	entt::registry& registry = current_scene.m_registry;
 
-void transform::update_transforms(scene& current_scene)
+	for (entt::entity ancestor = parent; ancestor != entt::null; )
+	{
+		if (ancestor == child)
+		{
+			std::cerr << "transform::set_parent would create a cycle, ignoring it" << std::endl;
+			return false;
+		}
+		transform* ancestor_transform = registry.try_get<transform>(ancestor);
+		ancestor = ancestor_transform ? ancestor_transform->m_parent : entt::null;
+	}
+
+	transform& trans = registry.get<transform>(child);
+	trans.m_parent = parent;
+	trans.m_dirty = true;
+	current_scene.m_hierarchy_dirty = true;
+	return true;
+}
+
+void transform::sort_hierarchy(scene& current_scene)
 {
-	auto transform_view = current_scene.m_registry.view<transform>();
+	entt::registry& registry = current_scene.m_registry;
+
+	for (auto [e, trans] : registry.view<transform>().each())
+	{
+		// the parent's transform was destroyed, the child becomes a root and keeps its local trs as its world
+		if (trans.m_parent != entt::null && !registry.all_of<transform>(trans.m_parent))
+		{
+			trans.m_parent = entt::null;
+			trans.m_dirty = true;
+		}
+
+		u32 depth = 0;
+		for (entt::entity ancestor = trans.m_parent; ancestor != entt::null; depth++)
+		{
+			transform* ancestor_transform = registry.try_get<transform>(ancestor);
+			ancestor = ancestor_transform ? ancestor_transform->m_parent : entt::null;
+		}
+		trans.m_depth = depth;
+	}
+
+	registry.sort<transform>([](const transform& a, const transform& b) { return a.m_depth < b.m_depth; });
+}
+
+// rebuilds are gathered into fixed size chunks of local trs streams for transform_kernel,
+// a chunk only ever holds one depth so parents are final before their children are composed
+struct transform_chunk
+{
+	static constexpr u32 s_capacity = 256;
+
+	float				streams[9][s_capacity];
+	glm::mat4			local_model[s_capacity];
+	glm::mat3			local_normal[s_capacity];
+	transform*			targets[s_capacity];
+	const transform*	parents[s_capacity];
+	u32					count = 0;
+};
+
+static void flush_transform_chunk(transform_chunk& chunk)
+{
+	if (chunk.count == 0)
+	{
+		return;
+	}
+
+	transform_kernel::batch input{};
+	for (u32 axis = 0; axis < 3; axis++)
+	{
+		input.position[axis] = chunk.streams[axis];
+		input.euler[axis] = chunk.streams[3 + axis];
+		input.scale[axis] = chunk.streams[6 + axis];
+	}
+	input.model = chunk.local_model;
+	input.normal = chunk.local_normal;
+	input.count = chunk.count;
+	transform_kernel::compute(input);
 
-	for (auto [e, trans] : transform_view.each())
+	for (u32 i = 0; i < chunk.count; i++)
 	{
+		transform& trans = *chunk.targets[i];
+		const transform* parent = chunk.parents[i];
 		trans.m_last_model = trans.m_model;
-		trans.m_model = utils::get_model_matrix(trans.m_position, trans.m_euler, trans.m_scale);
-		trans.m_normal_matrix = utils::get_normal_matrix(trans.m_model);
+		if (parent)
+		{
+			// normal matrix of a product is the product of the normal matrices
+			trans.m_model = parent->m_model * chunk.local_model[i];
+			trans.m_normal_matrix = parent->m_normal_matrix * chunk.local_normal[i];
+		}
+		else
+		{
+			trans.m_model = chunk.local_model[i];
+			trans.m_normal_matrix = chunk.local_normal[i];
+		}
 	}
+	chunk.count = 0;
 }
+
+// rebuilds and uploads storage[first, last), every transform in the range has the same depth
+static void update_transform_range(entt::registry& registry, entt::storage<transform>& storage, u32 first, u32 last)
+{
+	const u32 segment_count = transform_buffer::get_segment_count();
+	// one chunk per worker, they're too big for the stack
+	static thread_local transform_chunk chunk;
+	chunk.count = 0;
+
+	for (u32 i = first; i < last; i++)
+	{
+		transform& trans = storage.begin()[i];
+		const transform* parent = trans.m_parent != entt::null ? registry.try_get<transform>(trans.m_parent) : nullptr;
+		bool changed_last_frame = trans.m_changed;
+		trans.m_changed = false;
+
+		if (trans.m_dirty || (parent && parent->m_changed))
+		{
+			if (chunk.count == transform_chunk::s_capacity)
+			{
+				flush_transform_chunk(chunk);
+			}
+
+			u32 slot = chunk.count++;
+			for (u32 axis = 0; axis < 3; axis++)
+			{
+				chunk.streams[axis][slot] = trans.m_position[axis];
+				chunk.streams[3 + axis][slot] = trans.m_euler[axis];
+				chunk.streams[6 + axis][slot] = trans.m_scale[axis];
+			}
+			chunk.targets[slot] = &trans;
+			chunk.parents[slot] = parent;
+
+			trans.m_dirty = false;
+			trans.m_changed = true;
+			trans.m_gpu_pending = segment_count;
+		}
+		else if (changed_last_frame)
+		{
+			// stopped moving, velocity goes back to zero
+			trans.m_last_model = trans.m_model;
+			trans.m_gpu_pending = segment_count;
+		}
+	}
+	flush_transform_chunk(chunk);
+
+	for (u32 i = first; i < last; i++)
+	{
+		transform& trans = storage.begin()[i];
+		// transforms left on the null slot by an overflow retry until a slot is released
+		if (trans.m_gpu_index == transform::s_no_gpu_index || trans.m_gpu_index == transform_buffer::s_null_slot)
+		{
+			trans.m_gpu_index = transform_buffer::allocate();
+			trans.m_gpu_pending = segment_count;
+		}
+		if (trans.m_gpu_pending > 0 && trans.m_gpu_index != transform_buffer::s_null_slot)
+		{
+			transform_buffer::write(trans.m_gpu_index, trans);
+			trans.m_gpu_pending--;
+		}
+	}
+}
+
+void transform::update_transforms(scene& current_scene)
+{
+	entt::registry& registry = current_scene.m_registry;
+	if (current_scene.m_hierarchy_dirty)
+	{
+		sort_hierarchy(current_scene);
+		current_scene.m_hierarchy_dirty = false;
+	}
+
+	// storage is in depth order : each depth is split across the workers, and a depth only starts once
+	// the one above it is done, so every parent's m_model and m_changed are final when its children read them
+	entt::storage<transform>& storage = registry.storage<transform>();
+	const u32 count = (u32)storage.size();
+	for (u32 level_first = 0; level_first < count; )
+	{
+		u32 depth = storage.begin()[level_first].m_depth;
+		u32 level_last = level_first + 1;
+		while (level_last < count && storage.begin()[level_last].m_depth == depth)
+		{
+			level_last++;
+		}
+
+		job_system::parallel_for(level_first, level_last, s_update_grain_size, [&](u32 first, u32 last)
+		{
+			update_transform_range(registry, storage, first, last);
+		});
+		level_first = level_last;
+	}
+
+	// world bounds of every mesh that moved, once its final matrix is known
+	system_scheduler::parallel_each<transform, mesh>(registry, s_update_grain_size, [](entt::entity, transform& trans, mesh& emesh)
+	{
+		if (trans.m_changed)
+		{
+			emesh.m_transformed_aabb = utils::transform_aabb_arvo(emesh.m_original_aabb, trans.m_model);
+		}
+	});
+}
\ No newline at end of file
@@ -2,11 +2,20 @@
 
 #include "glm.hpp"
 #include "gtc/quaternion.hpp"
+#include "entt.hpp"
+#include "alias.h"
 
 class scene;
 
+// m_position / m_euler / m_scale are local to m_parent, m_model is the world matrix.
+// only dirty transforms and the subtrees under them are rebuilt, so anything writing the local
+// values directly has to call mark_dirty() (the set_* helpers do)
 struct transform
 {
+	static constexpr u32 s_no_gpu_index = 0xFFFFFFFF;
+	// transforms per update job
+	static constexpr u32 s_update_grain_size = 512;
+
 	glm::vec3 m_position	{ 0.0, 0.0, 0.0 };
 	glm::vec3 m_euler		{ 0.0, 0.0, 0.0 };
 	glm::vec3 m_scale		{ 1.0, 1.0, 1.0 };
@@ -17,5 +26,27 @@ struct transform
 
 	glm::mat3 m_normal_matrix;
 
+	entt::entity	m_parent = entt::null;
+	// distance from the root, the transform storage is kept sorted on it so parents update before children
+	u32				m_depth = 0;
+	bool			m_dirty = true;
+	// world matrix was rebuilt during the last update, children follow and m_last_model catches up next frame
+	bool			m_changed = false;
+
+	// persistent transform_buffer slot, and how many of its segments still hold stale matrices
+	u32				m_gpu_index = s_no_gpu_index;
+	u32				m_gpu_pending = 0;
+
+	void set_position(glm::vec3 position)	{ m_position = position; m_dirty = true; }
+	void set_euler(glm::vec3 euler)			{ m_euler = euler; m_dirty = true; }
+	void set_scale(glm::vec3 scale)			{ m_scale = scale; m_dirty = true; }
+	void mark_dirty()						{ m_dirty = true; }
+
+	// parent = entt::null detaches the child, returns false if it would create a cycle
+	static bool set_parent(scene& current_scene, entt::entity child, entt::entity parent);
+	// rebuilds changed world matrices, uploads them and refreshes mesh::m_transformed_aabb of moved meshes
 	static void update_transforms(scene& current_scene);
-};
\ No newline at end of file
+
+private:
+	static void sort_hierarchy(scene& current_scene);
+};
@@ -0,0 +1,110 @@
+#include "transform_buffer.h"
+#include "transform.h"
+#include <iostream>
+
+void transform_buffer::init(u32 max_transforms, u32 segment_count)
+{
+	int alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	u32 offset_alignment = alignment > 0 ? (u32)alignment : 256;
+
+	if (segment_count > 8)
+	{
+		std::cerr << "transform_buffer supports at most 8 segments" << std::endl;
+		segment_count = 8;
+	}
+
+	// each segment starts on an aligned offset so it can be bound with glBindBufferRange
+	s_max_transforms = max_transforms;
+	s_segment_size = (u32)(sizeof(transform_data) * max_transforms + offset_alignment - 1) / offset_alignment * offset_alignment;
+	s_segment_count = segment_count;
+	s_segment = 0;
+	s_allocated = s_null_slot + 1;
+	s_free_slots.clear();
+	s_overflow_reported = false;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glGenBuffers(1, &s_handle);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, s_handle);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)s_segment_size * s_segment_count, nullptr, flags);
+	s_mapped = (transform_data*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)s_segment_size * s_segment_count, flags);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (s_mapped == nullptr)
+	{
+		std::cerr << "transform_buffer failed to map its storage" << std::endl;
+		return;
+	}
+	for (u32 segment = 0; segment < s_segment_count; segment++)
+	{
+		transform_data* data = (transform_data*)((u8*)s_mapped + (size_t)segment * s_segment_size);
+		data[s_null_slot] = { glm::mat4(0.0f), glm::mat4(0.0f), glm::mat4(0.0f) };
+	}
+}
+
+void transform_buffer::begin_frame()
+{
+	s_segment = (s_segment + 1) % s_segment_count;
+
+	GLsync& fence = s_fences[s_segment];
+	if (fence != nullptr)
+	{
+		// normally already signalled, we only stall if the gpu is more than segment_count frames behind
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, s_binding, s_handle, (GLintptr)s_segment * s_segment_size, s_segment_size);
+}
+
+void transform_buffer::end_frame()
+{
+	s_fences[s_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+u32 transform_buffer::allocate()
+{
+	std::lock_guard<std::mutex> lock(s_allocation_mutex);
+	if (!s_free_slots.empty())
+	{
+		u32 index = s_free_slots.back();
+		s_free_slots.pop_back();
+		return index;
+	}
+	if (s_allocated < s_max_transforms)
+	{
+		return s_allocated++;
+	}
+	if (!s_overflow_reported)
+	{
+		std::cerr << "transform_buffer overflow, increase max_transforms passed to init" << std::endl;
+		s_overflow_reported = true;
+	}
+	return s_null_slot;
+}
+
+void transform_buffer::release(u32 index)
+{
+	if (index == s_null_slot || index >= s_max_transforms)
+	{
+		return;
+	}
+	// the gpu may still read the old matrices from in flight segments, the next owner rewrites every segment
+	// before it's drawn from them so nothing stale is ever visible
+	std::lock_guard<std::mutex> lock(s_allocation_mutex);
+	s_free_slots.push_back(index);
+}
+
+void transform_buffer::write(u32 index, const transform& trans)
+{
+	transform_data* segment = (transform_data*)((u8*)s_mapped + (size_t)s_segment * s_segment_size);
+	transform_data& data = segment[index];
+	data.model = trans.m_model;
+	data.last_model = trans.m_last_model;
+	data.normal = glm::mat4(trans.m_normal_matrix);
+}
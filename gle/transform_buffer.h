@@ -0,0 +1,61 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "alias.h"
+
+struct transform;
+
+// std430 mirror of transform_data in assets/shaders/common/transform_data.glsl
+struct transform_data
+{
+	glm::mat4	model;
+	glm::mat4	last_model;
+	glm::mat4	normal;
+};
+
+static_assert(sizeof(transform_data) == 192, "transform_data must match the std430 layout of transform_data");
+
+// every transform lives in one persistently mapped storage buffer, split into a segment per frame in flight.
+// each transform owns a slot for its lifetime and is written straight into the mapping, a fence per segment
+// stops the cpu from overwriting matrices the gpu is still reading. a changed transform has to be written
+// once per segment before every segment agrees again. shaders index it through instance_data.transform_index
+class transform_buffer
+{
+public:
+	inline static constexpr u32 s_binding = 1;
+	// reserved, holds zero matrices in every segment. allocate hands it out once every slot is taken, so a
+	// transform that didn't get a slot draws nothing instead of overwriting someone else's matrix
+	inline static constexpr u32 s_null_slot = 0;
+
+	static void		init(u32 max_transforms = 16 * 1024, u32 segment_count = 3);
+	// waits for the gpu to release the next segment and binds it to s_binding
+	static void		begin_frame();
+	// fences the current segment, call after the frame's last draw
+	static void		end_frame();
+
+	// reserves a slot, it keeps the same index in every segment. s_null_slot when full. safe to call from worker jobs
+	static u32		allocate();
+	// gives a slot back for reuse, ignores s_null_slot
+	static void		release(u32 index);
+	// writes the transform into slot index of the current segment, jobs may write distinct slots concurrently
+	static void		write(u32 index, const transform& trans);
+
+	static u32		get_segment_count() { return s_segment_count; }
+	static u32		get_max_transforms() { return s_max_transforms; }
+
+	inline static gl_handle	s_handle = 0;
+
+private:
+	inline static transform_data*	s_mapped = nullptr;
+	inline static GLsync			s_fences[8] = {};
+	inline static u32				s_max_transforms = 0;
+	inline static u32				s_segment_size = 0;
+	inline static u32				s_segment_count = 0;
+	inline static u32				s_segment = 0;
+	inline static std::mutex		s_allocation_mutex;
+	inline static std::vector<u32>	s_free_slots;
+	inline static u32				s_allocated = 0;
+	inline static bool				s_overflow_reported = false;
+};
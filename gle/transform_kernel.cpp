@@ -0,0 +1,115 @@
+#include "transform_kernel.h"
+#include <cmath>
+#if GLE_TRANSFORM_KERNEL_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+void transform_kernel::compute(const batch& input)
+{
+	switch (get_path())
+	{
+#if GLE_TRANSFORM_KERNEL_X86
+		case path::avx2:
+		{
+			u32 wide = input.count & ~7u;
+			compute_avx2(input, 0, wide);
+			compute_scalar(input, wide, input.count - wide);
+			return;
+		}
+		case path::sse4:
+		{
+			u32 wide = input.count & ~3u;
+			compute_sse4(input, 0, wide);
+			compute_scalar(input, wide, input.count - wide);
+			return;
+		}
+#endif
+		default:
+			compute_scalar(input, 0, input.count);
+			return;
+	}
+}
+
+transform_kernel::path transform_kernel::get_path()
+{
+	static const path s_path = detect_path();
+	return s_path;
+}
+
+const char* transform_kernel::get_path_name(path kernel_path)
+{
+	switch (kernel_path)
+	{
+		case path::avx2:
+			return "avx2";
+		case path::sse4:
+			return "sse4.1";
+		default:
+			return "scalar";
+	}
+}
+
+transform_kernel::path transform_kernel::detect_path()
+{
+#if GLE_TRANSFORM_KERNEL_X86
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	bool fma = (info[2] & (1 << 12)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	// the os also has to save the ymm registers
+	if (max_leaf >= 7 && fma && osxsave && avx && (_xgetbv(0) & 6) == 6)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse41 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+	if (avx2)
+	{
+		return path::avx2;
+	}
+	if (sse41)
+	{
+		return path::sse4;
+	}
+#endif
+	return path::scalar;
+}
+
+void transform_kernel::compute_scalar(const batch& input, u32 first, u32 count)
+{
+	constexpr float deg_to_rad = 3.14159265358979f / 180.0f;
+	for (u32 i = first; i < first + count; i++)
+	{
+		float sx = std::sin(input.euler[0][i] * deg_to_rad), cx = std::cos(input.euler[0][i] * deg_to_rad);
+		float sy = std::sin(input.euler[1][i] * deg_to_rad), cy = std::cos(input.euler[1][i] * deg_to_rad);
+		float sz = std::sin(input.euler[2][i] * deg_to_rad), cz = std::cos(input.euler[2][i] * deg_to_rad);
+
+		// columns of rz * ry * rx
+		glm::vec3 r0(cz * cy, sz * cy, -sy);
+		glm::vec3 r1(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx);
+		glm::vec3 r2(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx);
+
+		float scale_x = input.scale[0][i], scale_y = input.scale[1][i], scale_z = input.scale[2][i];
+
+		glm::mat4& model = input.model[i];
+		model[0] = glm::vec4(r0 * scale_x, 0.0f);
+		model[1] = glm::vec4(r1 * scale_y, 0.0f);
+		model[2] = glm::vec4(r2 * scale_z, 0.0f);
+		model[3] = glm::vec4(input.position[0][i], input.position[1][i], input.position[2][i], 1.0f);
+
+		glm::mat3& normal = input.normal[i];
+		normal[0] = r0 / scale_x;
+		normal[1] = r1 / scale_y;
+		normal[2] = r2 / scale_z;
+	}
+}
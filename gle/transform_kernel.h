@@ -0,0 +1,59 @@
+#pragma once
+#include "glm.hpp"
+#include "alias.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GLE_TRANSFORM_KERNEL_X86 1
+#else
+#define GLE_TRANSFORM_KERNEL_X86 0
+#endif
+
+// simd paths are compiled for their instruction set per function, not per file : inline code a per file flag would
+// also cover (glm, the standard library) can't end up as an avx copy the linker then picks for the whole program.
+// msvc accepts every intrinsic without /arch, so there it expands to nothing
+#if GLE_TRANSFORM_KERNEL_X86 && (defined(__GNUC__) || defined(__clang__))
+#define GLE_TARGET_SSE4 __attribute__((target("sse4.1")))
+#define GLE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define GLE_TARGET_SSE4
+#define GLE_TARGET_AVX2
+#endif
+
+// batched local TRS -> model / normal matrix kernel over structure of arrays inputs.
+// rotation is built straight from the euler sines / cosines (same z * y * x order as utils::get_quat_from_euler),
+// the normal matrix is R * S^-1 so no inverse is needed. x86 builds pick the widest path the cpu supports at runtime
+class transform_kernel
+{
+public:
+	enum class path : u32
+	{
+		scalar	= 0,
+		sse4	= 1,
+		avx2	= 2
+	};
+
+	// euler angles are in degrees, every stream holds count floats
+	struct batch
+	{
+		const float*	position[3];
+		const float*	euler[3];
+		const float*	scale[3];
+		glm::mat4*		model;
+		glm::mat3*		normal;
+		u32				count;
+	};
+
+	static void			compute(const batch& input);
+	static path			get_path();
+	static const char*	get_path_name(path kernel_path);
+
+	// the simd paths live in their own translation units, see GLE_TARGET_SSE4 / GLE_TARGET_AVX2
+	static void			compute_scalar(const batch& input, u32 first, u32 count);
+#if GLE_TRANSFORM_KERNEL_X86
+	static void			compute_sse4(const batch& input, u32 first, u32 count);
+	static void			compute_avx2(const batch& input, u32 first, u32 count);
+#endif
+
+private:
+	static path			detect_path();
+};
@@ -0,0 +1,45 @@
+// compiled for avx2 + fma (GLE_TARGET_AVX2), only called when the cpu reports support for both
+#include "transform_kernel.h"
+
+#if GLE_TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+
+// internal linkage, these are only ever compiled for this target
+namespace
+{
+struct avx2_ops
+{
+	using vec = __m256;
+	using ivec = __m256i;
+	static constexpr u32 width = 8;
+
+	GLE_TARGET_AVX2 static vec	load(const float* p)				{ return _mm256_loadu_ps(p); }
+	GLE_TARGET_AVX2 static void	store(float* p, vec a)				{ _mm256_store_ps(p, a); }
+	GLE_TARGET_AVX2 static vec	set(float f)						{ return _mm256_set1_ps(f); }
+	GLE_TARGET_AVX2 static vec	add(vec a, vec b)					{ return _mm256_add_ps(a, b); }
+	GLE_TARGET_AVX2 static vec	sub(vec a, vec b)					{ return _mm256_sub_ps(a, b); }
+	GLE_TARGET_AVX2 static vec	mul(vec a, vec b)					{ return _mm256_mul_ps(a, b); }
+	GLE_TARGET_AVX2 static vec	div(vec a, vec b)					{ return _mm256_div_ps(a, b); }
+	GLE_TARGET_AVX2 static vec	fmadd(vec a, vec b, vec c)			{ return _mm256_fmadd_ps(a, b, c); }
+	GLE_TARGET_AVX2 static vec	fmsub(vec a, vec b, vec c)			{ return _mm256_fmsub_ps(a, b, c); }
+	GLE_TARGET_AVX2 static vec	round(vec a)						{ return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	GLE_TARGET_AVX2 static ivec	to_int(vec a)						{ return _mm256_cvtps_epi32(a); }
+	GLE_TARGET_AVX2 static ivec	and_int(ivec a, int b)				{ return _mm256_and_si256(a, _mm256_set1_epi32(b)); }
+	GLE_TARGET_AVX2 static ivec	add_int(ivec a, int b)				{ return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+	GLE_TARGET_AVX2 static vec	int_mask(ivec a, int b)				{ return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_set1_epi32(b))); }
+	// bit 1 set -> sign bit set
+	GLE_TARGET_AVX2 static vec	sign_from_bit(ivec a)				{ return _mm256_castsi256_ps(_mm256_slli_epi32(a, 30)); }
+	GLE_TARGET_AVX2 static vec	xor_bits(vec a, vec b)				{ return _mm256_xor_ps(a, b); }
+	GLE_TARGET_AVX2 static vec	blend(vec a, vec b, vec mask)		{ return _mm256_blendv_ps(a, b, mask); }
+};
+}
+
+#define GLE_SIMD_TARGET GLE_TARGET_AVX2
+#include "transform_kernel_simd.inl"
+#undef GLE_SIMD_TARGET
+
+GLE_TARGET_AVX2 void transform_kernel::compute_avx2(const batch& input, u32 first, u32 count)
+{
+	simd_compute_transforms<avx2_ops>(input, first, count);
+}
+#endif
@@ -0,0 +1,108 @@
+// shared body of the sse4 / avx2 transform kernels, _Ops wraps one register width worth of intrinsics.
+// included by transform_kernel_sse4.cpp and transform_kernel_avx2.cpp only, with GLE_SIMD_TARGET set to their target.
+// no glm in here, results are written through raw floats
+
+// sine and cosine of x (radians) in one go : cody-waite reduction to [-pi/4, pi/4] then minimax polynomials
+template<typename _Ops>
+GLE_SIMD_TARGET static void simd_sincos(typename _Ops::vec x, typename _Ops::vec& out_sin, typename _Ops::vec& out_cos)
+{
+	using vec = typename _Ops::vec;
+	using ivec = typename _Ops::ivec;
+
+	vec quadrant = _Ops::round(_Ops::mul(x, _Ops::set(0.636619772f)));
+	vec r = _Ops::fmadd(quadrant, _Ops::set(-1.5707963705062866f), x);
+	r = _Ops::fmadd(quadrant, _Ops::set(4.371139000186243e-8f), r);
+	vec r2 = _Ops::mul(r, r);
+
+	vec s = _Ops::fmadd(r2, _Ops::set(-1.9515295891e-4f), _Ops::set(8.3321608736e-3f));
+	s = _Ops::fmadd(s, r2, _Ops::set(-1.6666654611e-1f));
+	s = _Ops::fmadd(_Ops::mul(s, r2), r, r);
+
+	vec c = _Ops::fmadd(r2, _Ops::set(2.443315711809948e-5f), _Ops::set(-1.388731625493765e-3f));
+	c = _Ops::fmadd(c, r2, _Ops::set(4.166664568298827e-2f));
+	c = _Ops::fmadd(_Ops::mul(c, r2), r2, _Ops::fmadd(r2, _Ops::set(-0.5f), _Ops::set(1.0f)));
+
+	// odd quadrants swap sine and cosine, the sign bits come straight from the quadrant index
+	ivec q = _Ops::to_int(quadrant);
+	vec swap = _Ops::int_mask(_Ops::and_int(q, 1), 1);
+	vec sin_sign = _Ops::sign_from_bit(_Ops::and_int(q, 2));
+	vec cos_sign = _Ops::sign_from_bit(_Ops::and_int(_Ops::add_int(q, 1), 2));
+
+	out_sin = _Ops::xor_bits(_Ops::blend(s, c, swap), sin_sign);
+	out_cos = _Ops::xor_bits(_Ops::blend(c, s, swap), cos_sign);
+}
+
+template<typename _Ops>
+GLE_SIMD_TARGET static void simd_compute_transforms(const transform_kernel::batch& input, u32 first, u32 count)
+{
+	using vec = typename _Ops::vec;
+	constexpr u32 width = _Ops::width;
+	const vec deg_to_rad = _Ops::set(3.14159265358979f / 180.0f);
+	const vec one = _Ops::set(1.0f);
+
+	// lanes are computed as structure of arrays, then scattered into the glm matrices
+	alignas(32) float model_lanes[12][width];
+	alignas(32) float normal_lanes[9][width];
+
+	for (u32 i = first; i < first + count; i += width)
+	{
+		vec sx, cx, sy, cy, sz, cz;
+		simd_sincos<_Ops>(_Ops::mul(_Ops::load(input.euler[0] + i), deg_to_rad), sx, cx);
+		simd_sincos<_Ops>(_Ops::mul(_Ops::load(input.euler[1] + i), deg_to_rad), sy, cy);
+		simd_sincos<_Ops>(_Ops::mul(_Ops::load(input.euler[2] + i), deg_to_rad), sz, cz);
+
+		vec scale_x = _Ops::load(input.scale[0] + i);
+		vec scale_y = _Ops::load(input.scale[1] + i);
+		vec scale_z = _Ops::load(input.scale[2] + i);
+		vec inv_x = _Ops::div(one, scale_x);
+		vec inv_y = _Ops::div(one, scale_y);
+		vec inv_z = _Ops::div(one, scale_z);
+
+		// columns of rz * ry * rx
+		vec szsy = _Ops::mul(sz, sy);
+		vec czsy = _Ops::mul(cz, sy);
+		vec rot[9] =
+		{
+			_Ops::mul(cz, cy),
+			_Ops::mul(sz, cy),
+			_Ops::sub(_Ops::set(0.0f), sy),
+			_Ops::fmsub(czsy, sx, _Ops::mul(sz, cx)),
+			_Ops::fmadd(szsy, sx, _Ops::mul(cz, cx)),
+			_Ops::mul(cy, sx),
+			_Ops::fmadd(czsy, cx, _Ops::mul(sz, sx)),
+			_Ops::fmsub(szsy, cx, _Ops::mul(cz, sx)),
+			_Ops::mul(cy, cx)
+		};
+		vec scales[3] = { scale_x, scale_y, scale_z };
+		vec inv_scales[3] = { inv_x, inv_y, inv_z };
+
+		for (u32 element = 0; element < 9; element++)
+		{
+			_Ops::store(model_lanes[element], _Ops::mul(rot[element], scales[element / 3]));
+			_Ops::store(normal_lanes[element], _Ops::mul(rot[element], inv_scales[element / 3]));
+		}
+		_Ops::store(model_lanes[9], _Ops::load(input.position[0] + i));
+		_Ops::store(model_lanes[10], _Ops::load(input.position[1] + i));
+		_Ops::store(model_lanes[11], _Ops::load(input.position[2] + i));
+
+		// glm::mat4 / mat3 are column major floats, 16 / 9 per matrix
+		for (u32 lane = 0; lane < width; lane++)
+		{
+			float* model = reinterpret_cast<float*>(input.model + i + lane);
+			float* normal = reinterpret_cast<float*>(input.normal + i + lane);
+			for (u32 column = 0; column < 3; column++)
+			{
+				for (u32 row = 0; row < 3; row++)
+				{
+					model[column * 4 + row] = model_lanes[column * 3 + row][lane];
+					normal[column * 3 + row] = normal_lanes[column * 3 + row][lane];
+				}
+				model[column * 4 + 3] = 0.0f;
+			}
+			model[12] = model_lanes[9][lane];
+			model[13] = model_lanes[10][lane];
+			model[14] = model_lanes[11][lane];
+			model[15] = 1.0f;
+		}
+	}
+}
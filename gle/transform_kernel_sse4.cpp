@@ -0,0 +1,45 @@
+// compiled for sse4.1 (GLE_TARGET_SSE4), only called when the cpu reports support for it
+#include "transform_kernel.h"
+
+#if GLE_TRANSFORM_KERNEL_X86
+#include <smmintrin.h>
+
+// internal linkage, these are only ever compiled for this target
+namespace
+{
+struct sse4_ops
+{
+	using vec = __m128;
+	using ivec = __m128i;
+	static constexpr u32 width = 4;
+
+	GLE_TARGET_SSE4 static vec	load(const float* p)				{ return _mm_loadu_ps(p); }
+	GLE_TARGET_SSE4 static void	store(float* p, vec a)				{ _mm_store_ps(p, a); }
+	GLE_TARGET_SSE4 static vec	set(float f)						{ return _mm_set1_ps(f); }
+	GLE_TARGET_SSE4 static vec	add(vec a, vec b)					{ return _mm_add_ps(a, b); }
+	GLE_TARGET_SSE4 static vec	sub(vec a, vec b)					{ return _mm_sub_ps(a, b); }
+	GLE_TARGET_SSE4 static vec	mul(vec a, vec b)					{ return _mm_mul_ps(a, b); }
+	GLE_TARGET_SSE4 static vec	div(vec a, vec b)					{ return _mm_div_ps(a, b); }
+	GLE_TARGET_SSE4 static vec	fmadd(vec a, vec b, vec c)			{ return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	GLE_TARGET_SSE4 static vec	fmsub(vec a, vec b, vec c)			{ return _mm_sub_ps(_mm_mul_ps(a, b), c); }
+	GLE_TARGET_SSE4 static vec	round(vec a)						{ return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	GLE_TARGET_SSE4 static ivec	to_int(vec a)						{ return _mm_cvtps_epi32(a); }
+	GLE_TARGET_SSE4 static ivec	and_int(ivec a, int b)				{ return _mm_and_si128(a, _mm_set1_epi32(b)); }
+	GLE_TARGET_SSE4 static ivec	add_int(ivec a, int b)				{ return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+	GLE_TARGET_SSE4 static vec	int_mask(ivec a, int b)				{ return _mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_set1_epi32(b))); }
+	// bit 1 set -> sign bit set
+	GLE_TARGET_SSE4 static vec	sign_from_bit(ivec a)				{ return _mm_castsi128_ps(_mm_slli_epi32(a, 30)); }
+	GLE_TARGET_SSE4 static vec	xor_bits(vec a, vec b)				{ return _mm_xor_ps(a, b); }
+	GLE_TARGET_SSE4 static vec	blend(vec a, vec b, vec mask)		{ return _mm_blendv_ps(a, b, mask); }
+};
+}
+
+#define GLE_SIMD_TARGET GLE_TARGET_SSE4
+#include "transform_kernel_simd.inl"
+#undef GLE_SIMD_TARGET
+
+GLE_TARGET_SSE4 void transform_kernel::compute_sse4(const batch& input, u32 first, u32 count)
+{
+	simd_compute_transforms<sse4_ops>(input, first, count);
+}
+#endif
@@ -0,0 +1,694 @@
+#include "triangle_bvh.h"
+#include "transform_kernel.h"
+#include "job_system.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <istream>
+#include <ostream>
+#if GLE_TRANSFORM_KERNEL_X86
+#include <xmmintrin.h>
+#endif
+
+static constexpr u32	s_bin_count = 16;
+// subtrees with more triangles than this are built on another worker
+static constexpr u32	s_parallel_build_threshold = 16 * 1024;
+static constexpr u32	s_file_magic = 0x48564254; // "TBVH"
+static constexpr u32	s_file_version = 1;
+
+static float surface_area(glm::vec3 min, glm::vec3 max)
+{
+	glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+struct triangle_bvh::build_context
+{
+	std::vector<glm::vec3>	tri_min;
+	std::vector<glm::vec3>	tri_max;
+	std::vector<glm::vec3>	centroids;
+	std::vector<u32>		order;
+	node*					nodes;
+	std::atomic<u32>		node_count;
+	job_counter				counter;
+};
+
+void triangle_bvh::build(const glm::vec3* positions, const u32* indices, u32 triangle_count)
+{
+	m_nodes.clear();
+	m_wide_nodes.clear();
+	m_vertices.clear();
+	m_triangle_ids.clear();
+	if (triangle_count == 0)
+	{
+		return;
+	}
+
+	build_context ctx;
+	ctx.tri_min.resize(triangle_count);
+	ctx.tri_max.resize(triangle_count);
+	ctx.centroids.resize(triangle_count);
+	ctx.order.resize(triangle_count);
+	for (u32 i = 0; i < triangle_count; i++)
+	{
+		glm::vec3 a = positions[indices[i * 3 + 0]];
+		glm::vec3 b = positions[indices[i * 3 + 1]];
+		glm::vec3 c = positions[indices[i * 3 + 2]];
+		ctx.tri_min[i] = glm::min(a, glm::min(b, c));
+		ctx.tri_max[i] = glm::max(a, glm::max(b, c));
+		ctx.centroids[i] = (a + b + c) * (1.0f / 3.0f);
+		ctx.order[i] = i;
+	}
+
+	// a binary tree with at least one triangle per leaf never needs more than 2n - 1 nodes
+	m_nodes.resize(triangle_count * 2 - 1);
+	ctx.nodes = m_nodes.data();
+	ctx.node_count = 1;
+	build_node(ctx, 0, 0, triangle_count, 0);
+	job_system::wait(ctx.counter);
+	m_nodes.resize(ctx.node_count);
+
+	m_triangle_ids = std::move(ctx.order);
+	m_vertices.resize(triangle_count * 3);
+	for (u32 i = 0; i < triangle_count; i++)
+	{
+		u32 triangle = m_triangle_ids[i];
+		for (u32 corner = 0; corner < 3; corner++)
+		{
+			m_vertices[i * 3 + corner] = positions[indices[triangle * 3 + corner]];
+		}
+	}
+
+	build_wide();
+}
+
+void triangle_bvh::build_node(build_context& ctx, u32 node_index, u32 first, u32 count, u32 depth)
+{
+	glm::vec3 bounds_min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 bounds_max = glm::vec3(-std::numeric_limits<float>::max());
+	glm::vec3 centroid_min = bounds_min;
+	glm::vec3 centroid_max = bounds_max;
+	for (u32 i = first; i < first + count; i++)
+	{
+		u32 triangle = ctx.order[i];
+		bounds_min = glm::min(bounds_min, ctx.tri_min[triangle]);
+		bounds_max = glm::max(bounds_max, ctx.tri_max[triangle]);
+		centroid_min = glm::min(centroid_min, ctx.centroids[triangle]);
+		centroid_max = glm::max(centroid_max, ctx.centroids[triangle]);
+	}
+
+	node& n = ctx.nodes[node_index];
+	n.min = bounds_min;
+	n.max = bounds_max;
+	if (count <= s_max_leaf_size || depth >= s_max_depth)
+	{
+		n.first = first;
+		n.count = count;
+		return;
+	}
+
+	// binned sah on every axis, cost = area * triangle count of both sides
+	u32 best_axis = 0;
+	u32 best_split = 0;
+	float best_cost = std::numeric_limits<float>::max();
+	glm::vec3 extent = centroid_max - centroid_min;
+	for (u32 axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		glm::vec3 bin_min[s_bin_count];
+		glm::vec3 bin_max[s_bin_count];
+		u32 bin_counts[s_bin_count] = {};
+		std::fill(std::begin(bin_min), std::end(bin_min), glm::vec3(std::numeric_limits<float>::max()));
+		std::fill(std::begin(bin_max), std::end(bin_max), glm::vec3(-std::numeric_limits<float>::max()));
+
+		float scale = (float)s_bin_count / extent[axis];
+		for (u32 i = first; i < first + count; i++)
+		{
+			u32 triangle = ctx.order[i];
+			u32 bin = std::min((u32)((ctx.centroids[triangle][axis] - centroid_min[axis]) * scale), s_bin_count - 1);
+			bin_min[bin] = glm::min(bin_min[bin], ctx.tri_min[triangle]);
+			bin_max[bin] = glm::max(bin_max[bin], ctx.tri_max[triangle]);
+			bin_counts[bin]++;
+		}
+
+		float right_cost[s_bin_count] = {};
+		glm::vec3 right_min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 right_max = glm::vec3(-std::numeric_limits<float>::max());
+		u32 right_count = 0;
+		for (u32 bin = s_bin_count - 1; bin > 0; bin--)
+		{
+			right_min = glm::min(right_min, bin_min[bin]);
+			right_max = glm::max(right_max, bin_max[bin]);
+			right_count += bin_counts[bin];
+			right_cost[bin] = right_count ? surface_area(right_min, right_max) * (float)right_count : 0.0f;
+		}
+
+		glm::vec3 left_min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 left_max = glm::vec3(-std::numeric_limits<float>::max());
+		u32 left_count = 0;
+		for (u32 bin = 0; bin < s_bin_count - 1; bin++)
+		{
+			left_min = glm::min(left_min, bin_min[bin]);
+			left_max = glm::max(left_max, bin_max[bin]);
+			left_count += bin_counts[bin];
+			if (left_count == 0 || left_count == count)
+			{
+				continue;
+			}
+			float cost = surface_area(left_min, left_max) * (float)left_count + right_cost[bin + 1];
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_split = bin;
+			}
+		}
+	}
+
+	u32 mid = first + count / 2;
+	if (best_cost < std::numeric_limits<float>::max())
+	{
+		float scale = (float)s_bin_count / extent[best_axis];
+		auto split = std::partition(ctx.order.begin() + first, ctx.order.begin() + first + count, [&](u32 triangle)
+		{
+			return std::min((u32)((ctx.centroids[triangle][best_axis] - centroid_min[best_axis]) * scale), s_bin_count - 1) <= best_split;
+		});
+		mid = (u32)(split - ctx.order.begin());
+	}
+	else
+	{
+		// every centroid in the same spot, any split is as good as another
+		std::nth_element(ctx.order.begin() + first, ctx.order.begin() + mid, ctx.order.begin() + first + count);
+	}
+
+	u32 left = ctx.node_count.fetch_add(2, std::memory_order_relaxed);
+	n.first = left;
+	n.count = 0;
+
+	u32 left_count = mid - first;
+	u32 right_count = count - left_count;
+	if (left_count > s_parallel_build_threshold)
+	{
+		job_system::run([&ctx, left, first, left_count, depth]() { build_node(ctx, left, first, left_count, depth + 1); }, &ctx.counter);
+	}
+	else
+	{
+		build_node(ctx, left, first, left_count, depth + 1);
+	}
+	build_node(ctx, left + 1, mid, right_count, depth + 1);
+}
+
+void triangle_bvh::build_wide()
+{
+	m_wide_nodes.clear();
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	struct pending
+	{
+		u32	wide_index;
+		u32	binary_index;
+	};
+	std::vector<pending> stack;
+	m_wide_nodes.emplace_back();
+	stack.push_back({ 0, 0 });
+
+	while (!stack.empty())
+	{
+		pending current = stack.back();
+		stack.pop_back();
+
+		// open the biggest internal child until there are four
+		u32 children[4];
+		u32 child_count = 0;
+		const node& root = m_nodes[current.binary_index];
+		if (root.count > 0)
+		{
+			children[child_count++] = current.binary_index;
+		}
+		else
+		{
+			children[child_count++] = root.first;
+			children[child_count++] = root.first + 1;
+		}
+
+		while (child_count < 4)
+		{
+			int best = -1;
+			float best_area = -1.0f;
+			for (u32 i = 0; i < child_count; i++)
+			{
+				const node& candidate = m_nodes[children[i]];
+				float area = surface_area(candidate.min, candidate.max);
+				if (candidate.count == 0 && area > best_area)
+				{
+					best = (int)i;
+					best_area = area;
+				}
+			}
+			if (best < 0)
+			{
+				break;
+			}
+			u32 opened = children[best];
+			children[best] = m_nodes[opened].first;
+			children[child_count++] = m_nodes[opened].first + 1;
+		}
+
+		for (u32 slot = 0; slot < 4; slot++)
+		{
+			wide_node& wide = m_wide_nodes[current.wide_index];
+			if (slot >= child_count)
+			{
+				wide.min_x[slot] = wide.min_y[slot] = wide.min_z[slot] = 0.0f;
+				wide.max_x[slot] = wide.max_y[slot] = wide.max_z[slot] = 0.0f;
+				wide.first[slot] = 0;
+				wide.count[slot] = s_empty;
+				continue;
+			}
+
+			const node& child = m_nodes[children[slot]];
+			wide.min_x[slot] = child.min.x;
+			wide.min_y[slot] = child.min.y;
+			wide.min_z[slot] = child.min.z;
+			wide.max_x[slot] = child.max.x;
+			wide.max_y[slot] = child.max.y;
+			wide.max_z[slot] = child.max.z;
+			wide.count[slot] = child.count;
+			if (child.count > 0)
+			{
+				wide.first[slot] = child.first;
+			}
+			else
+			{
+				u32 wide_child = (u32)m_wide_nodes.size();
+				// wide is dangling after this
+				m_wide_nodes.emplace_back();
+				m_wide_nodes[current.wide_index].first[slot] = wide_child;
+				stack.push_back({ wide_child, children[slot] });
+			}
+		}
+	}
+}
+
+bool triangle_bvh::intersect_triangle(u32 index, glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const
+{
+	// moller trumbore
+	const glm::vec3& v0 = m_vertices[index * 3 + 0];
+	glm::vec3 e1 = m_vertices[index * 3 + 1] - v0;
+	glm::vec3 e2 = m_vertices[index * 3 + 2] - v0;
+	glm::vec3 p = glm::cross(direction, e2);
+	float det = glm::dot(e1, p);
+	if (std::abs(det) < 1e-12f)
+	{
+		return false;
+	}
+
+	float inv_det = 1.0f / det;
+	glm::vec3 s = origin - v0;
+	float u = glm::dot(s, p) * inv_det;
+	if (u < 0.0f || u > 1.0f)
+	{
+		return false;
+	}
+	glm::vec3 q = glm::cross(s, e1);
+	float v = glm::dot(direction, q) * inv_det;
+	if (v < 0.0f || u + v > 1.0f)
+	{
+		return false;
+	}
+	float t = glm::dot(e2, q) * inv_det;
+	if (t < 0.0f || t >= max_distance)
+	{
+		return false;
+	}
+
+	result.distance = t;
+	result.u = u;
+	result.v = v;
+	result.triangle = m_triangle_ids[index];
+	return true;
+}
+
+static bool ray_box(glm::vec3 min, glm::vec3 max, glm::vec3 origin, glm::vec3 inv_direction, float max_distance, float& entry)
+{
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 near_t = glm::min(t0, t1);
+	glm::vec3 far_t = glm::max(t0, t1);
+	entry = std::max(std::max(near_t.x, near_t.y), std::max(near_t.z, 0.0f));
+	float exit = std::min(std::min(far_t.x, far_t.y), std::min(far_t.z, max_distance));
+	return entry <= exit;
+}
+
+bool triangle_bvh::intersect_closest_binary(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const
+{
+	return traverse_binary<false>(origin, direction, max_distance, result);
+}
+
+// visits the binary tree nearer child first. any_hit stops at the first triangle instead of the closest
+template<bool any_hit>
+bool triangle_bvh::traverse_binary(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const
+{
+	if (m_nodes.empty())
+	{
+		return false;
+	}
+
+	glm::vec3 inv_direction = 1.0f / direction;
+	bool found = false;
+	u32 stack[s_max_depth * 2];
+	u32 stack_size = 0;
+	stack[stack_size++] = 0;
+
+	while (stack_size > 0)
+	{
+		const node& n = m_nodes[stack[--stack_size]];
+		float entry;
+		if (!ray_box(n.min, n.max, origin, inv_direction, max_distance, entry))
+		{
+			continue;
+		}
+
+		if (n.count > 0)
+		{
+			for (u32 i = n.first; i < n.first + n.count; i++)
+			{
+				if (intersect_triangle(i, origin, direction, max_distance, result))
+				{
+					max_distance = result.distance;
+					found = true;
+					if (any_hit)
+					{
+						return true;
+					}
+				}
+			}
+			continue;
+		}
+
+		// nearer child on top of the stack
+		float left_entry, right_entry;
+		bool left_hit = ray_box(m_nodes[n.first].min, m_nodes[n.first].max, origin, inv_direction, max_distance, left_entry);
+		bool right_hit = ray_box(m_nodes[n.first + 1].min, m_nodes[n.first + 1].max, origin, inv_direction, max_distance, right_entry);
+		if (left_hit && right_hit)
+		{
+			bool left_first = left_entry <= right_entry;
+			stack[stack_size++] = left_first ? n.first + 1 : n.first;
+			stack[stack_size++] = left_first ? n.first : n.first + 1;
+		}
+		else if (left_hit)
+		{
+			stack[stack_size++] = n.first;
+		}
+		else if (right_hit)
+		{
+			stack[stack_size++] = n.first + 1;
+		}
+	}
+	return found;
+}
+
+#if GLE_TRANSFORM_KERNEL_X86
+// visits the wide tree nearest child first. any_hit stops at the first triangle instead of the closest
+template<bool any_hit>
+bool triangle_bvh::traverse_wide(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const
+{
+	glm::vec3 inv_direction = 1.0f / direction;
+	__m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+	__m128 ix = _mm_set1_ps(inv_direction.x), iy = _mm_set1_ps(inv_direction.y), iz = _mm_set1_ps(inv_direction.z);
+
+	struct entry
+	{
+		u32		node;
+		float	distance;
+	};
+	// a node pops one entry and pushes up to four
+	entry stack[s_max_depth * 3 + 4];
+	u32 stack_size = 0;
+	stack[stack_size++] = { 0, 0.0f };
+	bool found = false;
+
+	while (stack_size > 0)
+	{
+		entry current = stack[--stack_size];
+		if (current.distance > max_distance)
+		{
+			continue;
+		}
+
+		const wide_node& n = m_wide_nodes[current.node];
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_x), ox), ix);
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_x), ox), ix);
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_y), oy), iy);
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_y), oy), iy);
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.min_z), oz), iz);
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(n.max_z), oz), iz);
+
+		__m128 near_t = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+		__m128 far_t = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(max_distance)));
+		int mask = _mm_movemask_ps(_mm_cmple_ps(near_t, far_t));
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		alignas(16) float distances[4];
+		_mm_store_ps(distances, near_t);
+
+		// hit children sorted near to far
+		u32 order[4];
+		u32 order_count = 0;
+		for (u32 slot = 0; slot < 4; slot++)
+		{
+			if ((mask & (1 << slot)) && n.count[slot] != s_empty)
+			{
+				u32 position = order_count++;
+				while (position > 0 && distances[order[position - 1]] > distances[slot])
+				{
+					order[position] = order[position - 1];
+					position--;
+				}
+				order[position] = slot;
+			}
+		}
+
+		// leaves are tested right away, internal children pushed far first so the nearest pops next
+		for (u32 i = 0; i < order_count; i++)
+		{
+			u32 slot = order[i];
+			if (n.count[slot] == 0 || distances[slot] > max_distance)
+			{
+				continue;
+			}
+			for (u32 triangle = n.first[slot]; triangle < n.first[slot] + n.count[slot]; triangle++)
+			{
+				if (intersect_triangle(triangle, origin, direction, max_distance, result))
+				{
+					found = true;
+					max_distance = result.distance;
+					if (any_hit)
+					{
+						return true;
+					}
+				}
+			}
+		}
+		for (u32 i = order_count; i > 0; i--)
+		{
+			u32 slot = order[i - 1];
+			if (n.count[slot] == 0)
+			{
+				stack[stack_size++] = { n.first[slot], distances[slot] };
+			}
+		}
+	}
+	return found;
+}
+#endif
+
+bool triangle_bvh::intersect_closest(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const
+{
+#if GLE_TRANSFORM_KERNEL_X86
+	if (m_wide_nodes.empty())
+	{
+		return false;
+	}
+	return traverse_wide<false>(origin, direction, max_distance, result);
+#else
+	return intersect_closest_binary(origin, direction, max_distance, result);
+#endif
+}
+
+bool triangle_bvh::intersect_any(glm::vec3 origin, glm::vec3 direction, float max_distance) const
+{
+	hit result;
+#if GLE_TRANSFORM_KERNEL_X86
+	if (m_wide_nodes.empty())
+	{
+		return false;
+	}
+	return traverse_wide<true>(origin, direction, max_distance, result);
+#else
+	return traverse_binary<true>(origin, direction, max_distance, result);
+#endif
+}
+
+template<typename _Ty>
+static void write_array(std::ostream& out, const std::vector<_Ty>& values)
+{
+	u32 count = (u32)values.size();
+	out.write((const char*)&count, sizeof(count));
+	out.write((const char*)values.data(), (std::streamsize)(sizeof(_Ty) * count));
+}
+
+// remaining is the bytes left in the stream, a count that doesn't fit is rejected before anything is allocated
+template<typename _Ty>
+static bool read_array(std::istream& in, std::vector<_Ty>& values, u64& remaining)
+{
+	u32 count = 0;
+	if (remaining < sizeof(count) || !in.read((char*)&count, sizeof(count)))
+	{
+		return false;
+	}
+	remaining -= sizeof(count);
+	if ((u64)count * sizeof(_Ty) > remaining)
+	{
+		return false;
+	}
+	remaining -= (u64)count * sizeof(_Ty);
+	values.resize(count);
+	return (bool)in.read((char*)values.data(), (std::streamsize)(sizeof(_Ty) * count));
+}
+
+bool triangle_bvh::validate() const
+{
+	const u32 node_count = (u32)m_nodes.size();
+	const u32 wide_count = (u32)m_wide_nodes.size();
+	const u32 triangle_count = (u32)m_triangle_ids.size();
+	if ((node_count == 0) != (wide_count == 0))
+	{
+		return false;
+	}
+	for (u32 id : m_triangle_ids)
+	{
+		if (id >= triangle_count)
+		{
+			return false;
+		}
+	}
+
+	// children always come after their parent, so one forward pass sees every parent before its children.
+	// every node needs exactly one parent and a depth the fixed traversal stacks can hold
+	std::vector<u32> depth(node_count, s_empty);
+	if (node_count > 0)
+	{
+		depth[0] = 0;
+	}
+	for (u32 i = 0; i < node_count; i++)
+	{
+		const node& n = m_nodes[i];
+		if (depth[i] == s_empty || depth[i] > s_max_depth)
+		{
+			return false;
+		}
+		if (n.count > 0)
+		{
+			if (n.first > triangle_count || n.count > triangle_count - n.first)
+			{
+				return false;
+			}
+			continue;
+		}
+		if (n.first <= i || n.first >= node_count - 1 || depth[n.first] != s_empty || depth[n.first + 1] != s_empty)
+		{
+			return false;
+		}
+		depth[n.first] = depth[n.first + 1] = depth[i] + 1;
+	}
+
+	std::vector<u32> wide_depth(wide_count, s_empty);
+	if (wide_count > 0)
+	{
+		wide_depth[0] = 0;
+	}
+	for (u32 i = 0; i < wide_count; i++)
+	{
+		const wide_node& n = m_wide_nodes[i];
+		if (wide_depth[i] == s_empty || wide_depth[i] > s_max_depth)
+		{
+			return false;
+		}
+		for (u32 slot = 0; slot < 4; slot++)
+		{
+			if (n.count[slot] == s_empty)
+			{
+				continue;
+			}
+			if (n.count[slot] > 0)
+			{
+				if (n.first[slot] > triangle_count || n.count[slot] > triangle_count - n.first[slot])
+				{
+					return false;
+				}
+				continue;
+			}
+			if (n.first[slot] <= i || n.first[slot] >= wide_count || wide_depth[n.first[slot]] != s_empty)
+			{
+				return false;
+			}
+			wide_depth[n.first[slot]] = wide_depth[i] + 1;
+		}
+	}
+	return true;
+}
+
+void triangle_bvh::save(std::ostream& out) const
+{
+	u32 header[2] = { s_file_magic, s_file_version };
+	out.write((const char*)header, sizeof(header));
+	write_array(out, m_nodes);
+	write_array(out, m_wide_nodes);
+	write_array(out, m_vertices);
+	write_array(out, m_triangle_ids);
+}
+
+bool triangle_bvh::load(std::istream& in)
+{
+	const std::streampos start = in.tellg();
+	if (start == std::streampos(-1) || !in.seekg(0, std::ios::end))
+	{
+		return false;
+	}
+	const std::streampos end = in.tellg();
+	in.seekg(start);
+	u64 remaining = (u64)(end - start);
+
+	u32 header[2] = {};
+	if (remaining < sizeof(header) || !in.read((char*)header, sizeof(header)) || header[0] != s_file_magic || header[1] != s_file_version)
+	{
+		return false;
+	}
+	remaining -= sizeof(header);
+
+	bool ok = read_array(in, m_nodes, remaining)
+		&& read_array(in, m_wide_nodes, remaining)
+		&& read_array(in, m_vertices, remaining)
+		&& read_array(in, m_triangle_ids, remaining)
+		&& m_vertices.size() == m_triangle_ids.size() * 3
+		&& validate();
+	if (!ok)
+	{
+		m_nodes.clear();
+		m_wide_nodes.clear();
+		m_vertices.clear();
+		m_triangle_ids.clear();
+	}
+	return ok;
+}
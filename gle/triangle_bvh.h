@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <iosfwd>
+#include "glm.hpp"
+#include "alias.h"
+
+// static bvh over the triangles of one mesh in its local space. built with a binned sah, big subtrees are
+// split across the job system. triangles are copied in leaf order so traversal never touches the index buffer.
+// a 4 wide copy (collapsed from the binary tree) is traversed with sse, testing the 4 child boxes at once
+class triangle_bvh
+{
+public:
+	// 32 bytes : internal nodes have count 0 and children at first, first + 1
+	struct node
+	{
+		glm::vec3	min;
+		u32			first;
+		glm::vec3	max;
+		u32			count;
+	};
+
+	// child bounds as structure of arrays, count[i] = 0 is an internal child, s_empty an unused slot
+	struct wide_node
+	{
+		float	min_x[4], min_y[4], min_z[4];
+		float	max_x[4], max_y[4], max_z[4];
+		u32		first[4];
+		u32		count[4];
+	};
+
+	struct hit
+	{
+		float	distance;
+		// barycentrics of vertex 1 and 2
+		float	u, v;
+		// index of the triangle in the source index buffer (index / 3)
+		u32		triangle;
+	};
+
+	static constexpr u32 s_max_leaf_size = 4;
+	// deeper nodes become (larger) leaves, keeps the fixed traversal stacks safe on degenerate meshes
+	static constexpr u32 s_max_depth = 64;
+	static constexpr u32 s_empty = 0xFFFFFFFF;
+
+	void	build(const glm::vec3* positions, const u32* indices, u32 triangle_count);
+	bool	empty() const { return m_nodes.empty(); }
+
+	// direction doesn't need to be normalised, distances are in units of it
+	bool	intersect_closest(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const;
+	bool	intersect_any(glm::vec3 origin, glm::vec3 direction, float max_distance) const;
+	// same queries walking the binary tree, kept as the reference and for non x86 builds
+	bool	intersect_closest_binary(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const;
+
+	void	save(std::ostream& out) const;
+	bool	load(std::istream& in);
+
+	u32		get_triangle_count() const { return (u32)m_triangle_ids.size(); }
+	u32		get_node_count() const { return (u32)m_nodes.size(); }
+
+	std::vector<node>		m_nodes;
+	std::vector<wide_node>	m_wide_nodes;
+	// three vertices per triangle, in leaf order
+	std::vector<glm::vec3>	m_vertices;
+	std::vector<u32>		m_triangle_ids;
+
+private:
+	struct build_context;
+
+	static void	build_node(build_context& ctx, u32 node_index, u32 first, u32 count, u32 depth);
+	void		build_wide();
+	// loaded data only : every node index, leaf range and depth is in bounds
+	bool		validate() const;
+	bool		intersect_triangle(u32 index, glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const;
+	template<bool any_hit>
+	bool		traverse_binary(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const;
+	template<bool any_hit>
+	bool		traverse_wide(glm::vec3 origin, glm::vec3 direction, float max_distance, hit& result) const;
+};
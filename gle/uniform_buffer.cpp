@@ -0,0 +1,46 @@
+#include "uniform_buffer.h"
+#include <iostream>
+
+void uniform_ring_buffer::init(u32 segment_size, u32 segment_count)
+{
+	int alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	s_alignment = alignment > 0 ? (u32)alignment : 256;
+
+	// segments start on an aligned offset too, otherwise the first block of each frame couldn't be bound
+	s_segment_size = (segment_size + s_alignment - 1) / s_alignment * s_alignment;
+	s_segment_count = segment_count;
+	s_segment = 0;
+	s_head = 0;
+
+	glGenBuffers(1, &s_handle);
+	glBindBuffer(GL_UNIFORM_BUFFER, s_handle);
+	glBufferStorage(GL_UNIFORM_BUFFER, (GLsizeiptr)s_segment_size * s_segment_count, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void uniform_ring_buffer::begin_frame()
+{
+	s_segment = (s_segment + 1) % s_segment_count;
+	s_head = 0;
+}
+
+u32 uniform_ring_buffer::push(const void* data, u32 size)
+{
+	if (s_head + size > s_segment_size)
+	{
+		std::cerr << "uniform_ring_buffer segment overflow, increase the segment size passed to init" << std::endl;
+		s_head = 0;
+	}
+
+	u32 offset = s_segment * s_segment_size + s_head;
+	glBindBuffer(GL_UNIFORM_BUFFER, s_handle);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	s_head += (size + s_alignment - 1) / s_alignment * s_alignment;
+	return offset;
+}
+
+void uniform_ring_buffer::bind(binding point, u32 offset, u32 size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, point, s_handle, offset, size);
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include "GL/glew.h"
+#include "glm.hpp"
+#include "alias.h"
+#include "lights.h"
+
+// std140 mirrors of the blocks in assets/shaders/common/*_data.glsl, keep both sides in sync
+struct frame_block
+{
+	glm::mat4	vp;
+	glm::mat4	last_vp;
+	glm::mat4	view;
+	glm::mat4	proj;
+	glm::vec3	cam_pos;
+	f32			delta_time;
+	glm::vec2	resolution;
+	i32			frame_index;
+	i32			_pad0;
+};
+
+struct dir_light_block
+{
+	glm::vec3	direction;
+	f32			intensity;
+	glm::vec3	colour;
+	f32			_pad0;
+	glm::mat4	light_space_matrix;
+};
+
+struct point_light_block
+{
+	glm::vec3	position;
+	f32			radius;
+	glm::vec3	colour;
+	f32			intensity;
+	i32			shadow_index;
+	i32			_pad[3];
+};
+
+// point lights themselves live in storage buffers, see light_clusters
+struct light_block
+{
+	dir_light_block		dir_light;
+	i32					point_light_count;
+	f32					cluster_slice_scale;
+	f32					cluster_slice_bias;
+	i32					_pad0;
+	glm::ivec3			cluster_grid;
+	i32					_pad1;
+	glm::mat4			cascade_matrices[dir_light::s_max_cascades];
+	glm::vec4			cascade_splits;
+	i32					cascade_count;
+	i32					_pad2[3];
+};
+
+struct vxgi_block
+{
+	glm::vec3	aabb_min;
+	f32			_pad0;
+	glm::vec3	aabb_max;
+	f32			_pad1;
+	glm::vec3	voxel_resolution;
+	f32			max_trace_distance;
+	glm::vec2	input_resolution;
+	f32			diffuse_spec_mix;
+	f32			_pad2;
+};
+
+static_assert(sizeof(frame_block) == 288, "frame_block must match the std140 layout of frame_data");
+static_assert(sizeof(dir_light_block) == 96, "dir_light_block must match the std140 layout of DirLight");
+static_assert(sizeof(point_light_block) == 48, "point_light_block must match the std140 layout of PointLight");
+static_assert(sizeof(light_block) == 416, "light_block must match the std140 layout of light_data");
+static_assert(sizeof(vxgi_block) == 64, "vxgi_block must match the std140 layout of vxgi_data");
+
+// one uniform buffer split into a segment per frame in flight. blocks are sub-allocated from the
+// current frame's segment and bound with glBindBufferRange, so a pass only pays for one upload and
+// one bind no matter how many values it carries, and never overwrites a range an earlier frame may still read
+class uniform_ring_buffer
+{
+public:
+	// binding points, match the layout(binding = N) of the glsl blocks
+	enum binding : u32
+	{
+		frame	= 0,
+		lights	= 1,
+		pass	= 2
+	};
+
+	static void		init(u32 segment_size = 64 * 1024, u32 segment_count = 3);
+	static void		begin_frame();
+
+	// copies the block into the current segment and returns its offset in the buffer
+	static u32		push(const void* data, u32 size);
+	static void		bind(binding point, u32 offset, u32 size);
+
+	template<typename _Ty>
+	static void		push_and_bind(binding point, const _Ty& block)
+	{
+		u32 offset = push(&block, sizeof(_Ty));
+		bind(point, offset, sizeof(_Ty));
+	}
+
+	inline static gl_handle	s_handle = 0;
+
+private:
+	inline static u32		s_segment_size = 0;
+	inline static u32		s_segment_count = 0;
+	inline static u32		s_segment = 0;
+	inline static u32		s_head = 0;
+	inline static u32		s_alignment = 256;
+};
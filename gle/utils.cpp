@@ -191,6 +191,19 @@ aabb utils::transform_aabb(aabb& box, glm::mat4& M)
     return rbox;
 }
 
+aabb utils::transform_aabb_arvo(const aabb& box, const glm::mat4& M)
+{
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+
+    glm::vec3 world_center = glm::vec3(M * glm::vec4(center, 1.0f));
+    glm::vec3 world_extent = glm::abs(glm::vec3(M[0])) * extent.x
+        + glm::abs(glm::vec3(M[1])) * extent.y
+        + glm::abs(glm::vec3(M[2])) * extent.z;
+
+    return aabb{ world_center - world_extent, world_center + world_extent };
+}
+
 void utils::validate_euler_angles(glm::vec3& input)
 {
     if (input.x <= 0.0001f && input.x >= 0.0001f) {
@@ -205,3 +218,15 @@ void utils::validate_euler_angles(glm::vec3& input)
         input.z += 0.0001f;
     }
 }
+
+u64 utils::hash_fnv1a(const void* data, size_t size, u64 seed)
+{
+    const u8* bytes = static_cast<const u8*>(data);
+    u64 hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -25,6 +25,9 @@ public:
 	[[always_inline]] static glm::vec3			get_mouse_world_pos(glm::vec2 mouse_pos, glm::vec2 resolution, glm::mat4& proj, glm::mat4& view);
 	[[always_inline]] static float				round_up(float value, int decimal_places);
 	[[always_inline]] static aabb				transform_aabb(aabb& in, glm::mat4& model);
+	// arvo's method : transforms center / extent, extent goes through |upper 3x3| instead of 8 corners
+	static aabb									transform_aabb_arvo(const aabb& in, const glm::mat4& model);
 	[[always_inline]] static void				validate_euler_angles(glm::vec3& input);
+	[[always_inline]] static u64				hash_fnv1a(const void* data, size_t size, u64 seed = 14695981039346656037ull);
 
 };
\ No newline at end of file
@@ -1,9 +1,10 @@
 #include "vertex.h"
+#include "gl_state.h"
 
 
 void VAO::use()
 {
-	glBindVertexArray(m_vao_id);
+	gl_state::bind_vao(m_vao_id);
 }
 
 void vao_builder::begin()
@@ -12,7 +13,7 @@ void vao_builder::begin()
 	m_ibo = 0;
 	m_vbos.clear();
 	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
+	gl_state::bind_vao(m_vao);
 }
 
 void vao_builder::add_index_buffer(uint32_t* data, uint32_t data_count)